@@ -0,0 +1,96 @@
+#include "EglContext.hpp"
+
+#include "ErrorString.hpp"
+
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+namespace
+{
+  // the surfaceless platform needs neither a display server nor a GPU device
+  EGLDisplay
+  getDisplay()
+  {
+    const auto getPlatformDisplay =
+        reinterpret_cast< PFNEGLGETPLATFORMDISPLAYEXTPROC >( eglGetProcAddress( "eglGetPlatformDisplayEXT" ));
+
+    if( getPlatformDisplay )
+      if( EGLDisplay display = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr );
+          display != EGL_NO_DISPLAY )
+        return display;
+
+    return eglGetDisplay( EGL_DEFAULT_DISPLAY );
+  }
+} // namespace
+
+EglContext::EglContext( int width, int height )
+{
+  display = getDisplay();
+  if( display == EGL_NO_DISPLAY )
+    throw ErrorString( "no EGL display" );
+
+  if( EGLint major, minor; !eglInitialize( display, &major, &minor ))
+    throw ErrorString( "eglInitialize(..) failed: EGL error ", eglGetError());
+  _display = Destroyer{ [ this ] { eglTerminate( this->display ); }};
+
+  if( !eglBindAPI( EGL_OPENGL_API ))
+    throw ErrorString( "eglBindAPI( EGL_OPENGL_API ) failed" );
+
+  // no surfaces at all: 0 matches every surface type
+  const EGLint configAttributes[]{
+      EGL_SURFACE_TYPE, 0,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_NONE };
+  EGLConfig config{};
+  if( EGLint nConfigs = 0; !eglChooseConfig( display, configAttributes, &config, 1, &nConfigs ) || nConfigs < 1 )
+    throw ErrorString( "no EGL config for desktop OpenGL" );
+
+  // the same version and profile as the window asks GLFW for
+  const EGLint contextAttributes[]{
+      EGL_CONTEXT_MAJOR_VERSION, 4,
+      EGL_CONTEXT_MINOR_VERSION, 1,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE };
+  context = eglCreateContext( display, config, EGL_NO_CONTEXT, contextAttributes );
+  if( context == EGL_NO_CONTEXT )
+    throw ErrorString( "eglCreateContext(..) failed: EGL error ", eglGetError());
+  _context = Destroyer{ [ this ]
+  {
+    eglMakeCurrent( this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+    eglDestroyContext( this->display, this->context );
+  }};
+
+  if( !eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context ))
+    throw ErrorString( "eglMakeCurrent(..) failed: EGL error ", eglGetError());
+
+  // GLEW built for GLX loads the GL functions, then complains that there is no GLX display
+  glewExperimental = GL_TRUE;
+  if( const GLenum result = glewInit(); result != GLEW_OK )
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    if( result != GLEW_ERROR_NO_GLX_DISPLAY )
+#endif
+      throw ErrorString( "glewInit() failed: ", glewGetErrorString( result ));
+
+  glGenRenderbuffers( 1, &renderbuffer );
+  _renderbuffer = Destroyer{ [ this ] { glDeleteRenderbuffers( 1, &this->renderbuffer ); }};
+  glBindRenderbuffer( GL_RENDERBUFFER, renderbuffer );
+  glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width, height );
+
+  glGenFramebuffers( 1, &framebuffer );
+  _framebuffer = Destroyer{ [ this ] { glDeleteFramebuffers( 1, &this->framebuffer ); }};
+  glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+  glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer );
+  if( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+    throw ErrorString( "offscreen framebuffer incomplete" );
+
+  glViewport( 0, 0, width, height );
+}
+
+const char *
+EglContext::getRenderer() const
+{
+  return reinterpret_cast< const char * >( glGetString( GL_RENDERER ));
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Destroyer.hpp"
+#include "NoCopy.hpp"
+
+#define GL_SILENCE_DEPRECATION
+#include <gl/glew.h>
+
+#include <EGL/egl.h>
+
+// An OpenGL 4.1 core context without any window, made current on the calling thread, for running the renderers
+// where there is no display (or no GPU: Mesa's llvmpipe will do). Renders into a framebuffer object
+// of the given size, which is also the viewport.
+
+struct EglContext : NoCopy
+{
+  EglContext( int width, int height )
+  noexcept( false ); // throws ErrorString
+
+  // e.g. "llvmpipe (LLVM 15.0.7, 256 bits)"
+  const char *getRenderer() const;
+
+private:
+  EGLDisplay display{};
+  Destroyer _display;
+
+  EGLContext context{};
+  Destroyer _context;
+
+  GLuint renderbuffer{};
+  Destroyer _renderbuffer;
+
+  GLuint framebuffer{};
+  Destroyer _framebuffer;
+};
@@ -0,0 +1,906 @@
+// Headless benchmark of the load -> decode -> upload pipeline, for catching performance regressions
+// on machines without a display or a GPU (the renderers run on an offscreen EGL context, e.g. Mesa's llvmpipe).
+//
+// usage: imageviewergl_bench [--iterations N] [images or directories of them...]
+// Without any images, a synthetic corpus of JPEGs (with restart markers, as cameras write them) and PNGs of several
+// sizes and channel counts is written to the temporary directory (once) and used. Prints the median and 99th percentile
+// of each stage per image and the peak memory of each way of loading it, and checks that each of the multithreaded
+// and streaming decoders gives the same pixels as stb_image, exiting with 1 if one doesn't.
+
+#include "EglContext.hpp"
+#include "ErrorString.hpp"
+#include "GifDecoder.hpp"
+#include "GlRenderer_ImageRenderer.hpp"
+#include "ImageSource.hpp"
+#include "MappedFile.hpp"
+#include "ProgressiveImage.hpp"
+#include "TextureUploadRing.hpp"
+#include "compressBc1.hpp"
+#include "convertPixels.hpp"
+#include "decodeJpegInParallel.hpp"
+#include "decodePngPipelined.hpp"
+#include "getGlTextureFormat.hpp"
+#include "loadImageFile.hpp"
+#include "makeGlRendererMaker.hpp"
+#include "pixelBufferPool.hpp"
+
+#include <stb_image.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  // the size of a typical screen's work area, for the renderers' viewport and for decoding to fit
+  constexpr int viewportWidth = 1920, viewportHeight = 1080;
+
+  // like the window's default, so an image which would be tiled there is skipped here
+  constexpr std::size_t textureBudgetBytes = std::size_t{ 512 } << 20;
+
+  constexpr int defaultIterations = 10;
+
+  struct CorpusImage
+  {
+    const char *format;
+    int width, height, nChannels;
+  };
+
+  constexpr CorpusImage syntheticCorpus[]{
+      { "jpg", 1024, 768, 3 },
+      { "jpg", 4000, 3000, 3 },
+      { "jpg", 6000, 4000, 3 },
+      { "jpg", 4000, 3000, 1 },
+      { "png", 1024, 768, 3 },
+      { "png", 4000, 3000, 3 },
+      { "png", 4000, 3000, 4 },
+      { "png", 4000, 3000, 1 },
+  };
+
+//==============================================================================
+
+  // smooth gradients plus some noise, so the files compress about as well as photos do
+  std::vector< unsigned char >
+  makeSyntheticPixels( const CorpusImage &spec )
+  {
+    std::vector< unsigned char > pixels( (std::size_t)spec.width * spec.height * spec.nChannels );
+    uint32_t noise = 12345;
+
+    unsigned char *p = pixels.data();
+    for( int y = 0; y < spec.height; ++y )
+      for( int x = 0; x < spec.width; ++x )
+        for( int c = 0; c < spec.nChannels; ++c )
+        {
+          noise = noise * 1664525u + 1013904223u;
+          const double wave = std::sin( x * 0.004 * ( c + 1 )) * std::cos( y * 0.006 + c );
+          *p++ = (unsigned char)std::clamp( 128 + 100 * wave + (int)( noise >> 28 ) - 8, 0.0, 255.0 );
+        }
+
+    return pixels;
+  }
+
+  // a baseline JPEG's Huffman code for each symbol, and the symbol of each code (see the JPEG spec's F.2.2.3)
+  struct HuffmanTable
+  {
+    int minCode[ 17 ]{}, maxCode[ 17 ]{}, firstValue[ 17 ]{}; // by code length
+    std::vector< unsigned char > values;
+    std::pair< int, int > codes[ 256 ]{}; // length and code by symbol, length 0 when it has none
+
+    explicit HuffmanTable( const unsigned char *counts )
+      : values( counts + 16, counts + 16 + std::accumulate( counts, counts + 16, 0 ))
+    {
+      for( int length = 1, code = 0, k = 0; length <= 16; ++length, code <<= 1 )
+      {
+        firstValue[ length ] = k;
+        minCode[ length ] = code;
+        for( int i = 0; i < counts[ length - 1 ]; ++i, ++code, ++k )
+          codes[ values[ k ]] = { length, code };
+        maxCode[ length ] = counts[ length - 1 ] ? code - 1 : -1;
+      }
+    }
+  };
+
+  // entropy-coded data, skipping the 0 stuffed after each 0xff
+  struct BitReader
+  {
+    const unsigned char *p, *end;
+    int byte{}, nBits{};
+
+    int read( int n )
+    {
+      int value = 0;
+      for( ; n > 0; --n )
+      {
+        if( !nBits )
+        {
+          if( p == end || ( *p == 0xff && ( p + 1 == end || p[ 1 ] != 0 )))
+            throw ErrorString( "entropy-coded data ends too soon" );
+          byte = *p;
+          p += *p == 0xff ? 2 : 1;
+          nBits = 8;
+        }
+        value = ( value << 1 ) | (( byte >> --nBits ) & 1 );
+      }
+      return value;
+    }
+
+    int decode( const HuffmanTable &table )
+    {
+      for( int length = 1, code = read( 1 ); length <= 16; ++length, code = ( code << 1 ) | read( 1 ))
+        if( code <= table.maxCode[ length ] )
+          return table.values[ table.firstValue[ length ] + code - table.minCode[ length ]];
+      throw ErrorString( "bad Huffman code" );
+    }
+  };
+
+  struct BitWriter
+  {
+    std::vector< unsigned char > &out;
+    int byte{}, nBits{};
+
+    void write( int value, int n )
+    {
+      for( int i = n - 1; i >= 0; --i )
+      {
+        byte = ( byte << 1 ) | (( value >> i ) & 1 );
+        if( ++nBits < 8 )
+          continue;
+        out.push_back( (unsigned char)byte );
+        if( byte == 0xff )
+          out.push_back( 0 );
+        byte = nBits = 0;
+      }
+    }
+
+    void encode( const HuffmanTable &table, int symbol )
+    {
+      const auto [ length, code ] = table.codes[ symbol ];
+      if( !length )
+        throw ErrorString( "no Huffman code for ", symbol );
+      write( code, length );
+    }
+
+    // padded with ones to the byte
+    void flush()
+    {
+      while( nBits )
+        write( 1, 1 );
+    }
+  };
+
+  // stb_image_write's JPEGs have no restart markers, which decodeJpegInParallel needs to split one (as most cameras'
+  // JPEGs have them): this gives one a restart interval of an MCU row, decoding its blocks' Huffman codes and encoding
+  // them again with the same tables, DC predictions starting over with each row. The pixels are the same.
+  // A JPEG which isn't a single-scan baseline one, or already has restart markers, is returned as it is.
+  std::vector< unsigned char >
+  addRestartMarkers( const std::vector< unsigned char > &jpeg )
+  {
+    struct Component
+    {
+      int id, h, v;
+      const HuffmanTable *dc, *ac;
+      int predictionIn, predictionOut;
+    };
+
+    auto readU16 = [ & ]( std::size_t at ) { return ( jpeg.at( at ) << 8 ) | jpeg.at( at + 1 ); };
+
+    std::optional< HuffmanTable > tables[ 2 ][ 4 ]; // DC then AC
+    std::vector< Component > components;
+    int width = 0, height = 0;
+    std::size_t at = 2, scanStart = 0, dataStart = 0;
+    while( !dataStart )
+    {
+      if( jpeg.at( at ) != 0xff )
+        throw ErrorString( "not a marker at ", at );
+      const int marker = jpeg.at( at + 1 );
+      if( marker == 0xff )
+      {
+        ++at;
+        continue;
+      }
+
+      const std::size_t length = readU16( at + 2 ), segment = at + 4, end = at + 2 + length;
+      switch( marker )
+      {
+        case 0xc0: // baseline
+          height = readU16( segment + 1 );
+          width = readU16( segment + 3 );
+          for( int i = 0; i < jpeg.at( segment + 5 ); ++i )
+          {
+            const unsigned char *c = &jpeg.at( segment + 6 + 3 * i );
+            components.push_back( { c[ 0 ], c[ 1 ] >> 4, c[ 1 ] & 15, nullptr, nullptr, 0, 0 } );
+          }
+          break;
+        case 0xc4:
+          for( std::size_t table = segment; table < end; )
+          {
+            const int tableClass = jpeg.at( table ) >> 4, id = jpeg.at( table ) & 3;
+            tables[ tableClass & 1 ][ id ].emplace( &jpeg.at( table + 1 ));
+            table += 17 + tables[ tableClass & 1 ][ id ]->values.size();
+          }
+          break;
+        case 0xda:
+          if( jpeg.at( segment ) != components.size())
+            return jpeg;
+          for( std::size_t i = 0; i < components.size(); ++i )
+          {
+            Component &component = components[ i ];
+            const int selectors = jpeg.at( segment + 2 + 2 * i );
+            if( jpeg.at( segment + 1 + 2 * i ) != component.id || !tables[ 0 ][ selectors >> 4 & 3 ] || !tables[ 1 ][ selectors & 3 ] )
+              return jpeg;
+            component.dc = &*tables[ 0 ][ selectors >> 4 & 3 ];
+            component.ac = &*tables[ 1 ][ selectors & 3 ];
+          }
+          scanStart = at;
+          dataStart = end;
+          break;
+        case 0xc1: case 0xc2: case 0xc3: case 0xc5: case 0xc6: case 0xc7:
+        case 0xc9: case 0xca: case 0xcb: case 0xcd: case 0xce: case 0xcf: // not baseline
+        case 0xdd: // already has restart markers
+          return jpeg;
+      }
+      at = end;
+    }
+
+    if( components.empty())
+      throw ErrorString( "no frame header" );
+
+    // a single component's blocks are its MCUs, whatever its sampling factors
+    int hMax = 1, vMax = 1;
+    for( const Component &component : components )
+      hMax = std::max( hMax, component.h ), vMax = std::max( vMax, component.v );
+    if( components.size() == 1 )
+      components[ 0 ].h = components[ 0 ].v = 1;
+    const int mcuWidth = 8 * hMax, mcuHeight = 8 * vMax;
+    const int mcusX = components.size() == 1 ? ( width * components[ 0 ].h / hMax + 7 ) / 8 : ( width + mcuWidth - 1 ) / mcuWidth;
+    const int mcusY = components.size() == 1 ? ( height * components[ 0 ].v / vMax + 7 ) / 8 : ( height + mcuHeight - 1 ) / mcuHeight;
+
+    std::vector< unsigned char > out( jpeg.begin(), jpeg.begin() + (std::ptrdiff_t)scanStart );
+    out.insert( out.end(), { 0xff, 0xdd, 0, 4, (unsigned char)( mcusX >> 8 ), (unsigned char)mcusX } );
+    out.insert( out.end(), jpeg.begin() + (std::ptrdiff_t)scanStart, jpeg.begin() + (std::ptrdiff_t)dataStart );
+
+    BitReader in{ jpeg.data() + dataStart, jpeg.data() + jpeg.size() };
+    BitWriter writer{ out };
+    for( int mcuY = 0; mcuY < mcusY; ++mcuY )
+    {
+      if( mcuY > 0 )
+      {
+        writer.flush();
+        out.insert( out.end(), { 0xff, (unsigned char)( 0xd0 + ( mcuY - 1 ) % 8 ) } );
+        for( Component &component : components )
+          component.predictionOut = 0;
+      }
+
+      for( int mcuX = 0; mcuX < mcusX; ++mcuX )
+        for( Component &component : components )
+          for( int block = 0; block < component.h * component.v; ++block )
+          {
+            // the DC difference from the last block, to the one from the last block since the restart
+            const int dcSize = in.decode( *component.dc );
+            int difference = dcSize ? in.read( dcSize ) : 0;
+            if( dcSize && difference < 1 << ( dcSize - 1 ))
+              difference -= ( 1 << dcSize ) - 1;
+            component.predictionIn += difference;
+            difference = component.predictionIn - component.predictionOut;
+            component.predictionOut = component.predictionIn;
+
+            int size = 0;
+            while( std::abs( difference ) >> size )
+              ++size;
+            writer.encode( *component.dc, size );
+            writer.write( difference < 0 ? difference + ( 1 << size ) - 1 : difference, size );
+
+            // the AC coefficients as they are, up to the end of the block
+            for( int k = 1; k < 64; ++k )
+            {
+              const int runSize = in.decode( *component.ac );
+              writer.encode( *component.ac, runSize );
+              if( !( runSize & 15 ))
+              {
+                if( runSize != 0xf0 )
+                  break;
+                k += 15;
+                continue;
+              }
+              writer.write( in.read( runSize & 15 ), runSize & 15 );
+              k += runSize >> 4;
+            }
+          }
+    }
+
+    writer.flush();
+    out.insert( out.end(), { 0xff, 0xd9 } );
+    return out;
+  }
+
+  std::vector< std::string >
+  writeSyntheticCorpus()
+  {
+    // named for the version of the files written, so ones from an older bench aren't used
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "imageviewergl_bench_corpus_2";
+    std::filesystem::create_directories( directory );
+
+    std::vector< std::string > filenames;
+    for( const CorpusImage &spec : syntheticCorpus )
+    {
+      char name[ 64 ];
+      std::snprintf( name, sizeof( name ), "%dx%dx%d.%s", spec.width, spec.height, spec.nChannels, spec.format );
+      const std::string filename = ( directory / name ).string();
+      filenames.push_back( filename );
+
+      if( std::filesystem::exists( filename ))
+        continue;
+
+      std::cerr << "writing " << filename << std::endl;
+      const std::vector< unsigned char > pixels = makeSyntheticPixels( spec );
+      if( std::strcmp( spec.format, "jpg" ) == 0 )
+      {
+        std::vector< unsigned char > jpeg;
+        stbi_write_jpg_to_func( []( void *context, void *data, int size )
+        {
+          static_cast< std::vector< unsigned char > * >( context )->insert(
+              static_cast< std::vector< unsigned char > * >( context )->end(), static_cast< unsigned char * >( data ), static_cast< unsigned char * >( data ) + size );
+        }, &jpeg, spec.width, spec.height, spec.nChannels, pixels.data(), 90 );
+
+        // so the parallel decoder has something to split
+        jpeg = addRestartMarkers( jpeg );
+        if( !std::ofstream{ filename, std::ios::binary }.write( reinterpret_cast< const char * >( jpeg.data()), (std::streamsize)jpeg.size()))
+          throw ErrorString( "failed to write ", filename );
+      }
+      else if( !stbi_write_png( filename.c_str(), spec.width, spec.height, spec.nChannels, pixels.data(), spec.width * spec.nChannels ))
+        throw ErrorString( "failed to write ", filename );
+    }
+
+    return filenames;
+  }
+
+  std::vector< std::string >
+  listImages( const std::vector< std::string > &arguments )
+  {
+    std::vector< std::string > filenames;
+    for( const std::string &argument : arguments )
+      if( std::filesystem::is_directory( argument ))
+      {
+        for( const auto &entry : std::filesystem::directory_iterator( argument ))
+          if( entry.is_regular_file())
+            filenames.push_back( entry.path().string());
+      }
+      else
+        filenames.push_back( argument );
+
+    std::sort( filenames.begin(), filenames.end());
+    return filenames;
+  }
+
+//==============================================================================
+
+  struct Stage
+  {
+    std::string name;
+    std::vector< double > milliseconds;
+  };
+
+  double
+  getPercentile( std::vector< double > samples, double percentile )
+  {
+    std::sort( samples.begin(), samples.end());
+    // nearest rank
+    const std::size_t rank = (std::size_t)std::ceil( percentile / 100 * samples.size());
+    return samples[ std::clamp< std::size_t >( rank, 1, samples.size()) - 1 ];
+  }
+
+  // times each stage of one image, iterations times over
+  struct ImageBench
+  {
+    std::string filename;
+    ImageDimensions dimensions;
+    std::vector< Stage > stages;
+    std::vector< std::pair< std::string, long > > peakKilobytes; // by stage: resident at most, over what a fresh process has
+
+    // stage returns false when it doesn't apply to this image (and then isn't timed again);
+    // cleanUp runs after each time it's timed, without being timed itself
+    void time( const std::string &name, int iterations, const std::function< bool() > &stage, const std::function< void() > &cleanUp = {} )
+    {
+      Stage timed{ name, {} };
+      for( int i = 0; i < iterations; ++i )
+      {
+        const auto start = std::chrono::steady_clock::now();
+        if( !stage())
+          return;
+        timed.milliseconds.push_back( std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count());
+
+        if( cleanUp )
+          cleanUp();
+      }
+
+      stages.push_back( std::move( timed ));
+    }
+
+    void print() const
+    {
+      const double megapixels = (double)dimensions.width * dimensions.height / 1e6;
+      std::printf( "\n%s: %dx%d, %d channel(s), %.1f MP\n", filename.c_str(), dimensions.width, dimensions.height, dimensions.nChannels, megapixels );
+      std::printf( "  %-48s %10s %10s %10s\n", "stage", "median ms", "p99 ms", "MP/s" );
+
+      for( const Stage &stage : stages )
+      {
+        const double median = getPercentile( stage.milliseconds, 50 );
+        std::printf( "  %-48s %10.2f %10.2f %10.1f\n",
+                     stage.name.c_str(), median, getPercentile( stage.milliseconds, 99 ), megapixels / ( median / 1000 ));
+      }
+
+      for( const auto &[ name, kilobytes ] : peakKilobytes )
+        std::printf( "  peak RSS, %-38s %10.1f MiB\n", name.c_str(), kilobytes / 1024.0 );
+
+      // what the texture takes with its mipmaps: as RGBA8 (whatever the channels), in the format it gets, and as BC1
+      const GlTextureFormat format = getGlTextureFormat( dimensions );
+      const double texels = (double)dimensions.width * dimensions.height * 4 / 3, mebibyte = 1 << 20;
+      std::printf( "  texture memory with mipmaps: RGBA8 %.1f MiB, %s %.1f MiB, BC1 %.1f MiB\n",
+                   texels * 4 / mebibyte, format.name, texels * (double)format.texelBytes / mebibyte,
+                   (double)getBc1Bytes( dimensions.width, dimensions.height ) * 4 / 3 / mebibyte );
+    }
+  };
+
+  // the most this process has had resident, in KiB: of its address space since it was last exec'd, unlike getrusage's
+  // ru_maxrss, which is carried over from the process which exec'd it; 0 where there's no /proc
+  long
+  getPeakResidentKilobytes()
+  {
+    std::ifstream status{ "/proc/self/status" };
+    for( std::string line; std::getline( status, line ); )
+      if( line.rfind( "VmHWM:", 0 ) == 0 )
+        return std::strtol( line.c_str() + 6, nullptr, 10 );
+    return 0;
+  }
+
+  // a fresh process's run of loadImageFile: prints how much more it had resident at most than before, in KiB
+  int
+  printPeakKilobytes( const char *access, const char *filename )
+  {
+    const long before = getPeakResidentKilobytes();
+    try
+    {
+      loadImageFile( filename, std::strcmp( access, "read" ) == 0 ? MappedFile::Access::read : MappedFile::Access::mapOrRead );
+    }
+    catch( const std::exception &e )
+    {
+      std::cerr << filename << ": " << e.what() << std::endl;
+      return 1;
+    }
+
+    std::printf( "%ld\n", getPeakResidentKilobytes() - before );
+    return 0;
+  }
+
+  // the most loading the file with access ("map" or "read") has resident at once, in KiB: run by this executable
+  // started again (see printPeakKilobytes), so neither the bench's earlier stages nor its pools count; nullopt on failure
+  std::optional< long >
+  measurePeakKilobytes( const char *access, const std::string &filename )
+  {
+    int fds[ 2 ];
+    if( pipe( fds ) != 0 )
+      return std::nullopt;
+
+    const pid_t child = fork();
+    if( child == 0 )
+    {
+      dup2( fds[ 1 ], STDOUT_FILENO );
+      close( fds[ 0 ] );
+      close( fds[ 1 ] );
+      execl( "/proc/self/exe", "imageviewergl_bench", "--peak-kilobytes", access, filename.c_str(), (char *)nullptr );
+      _exit( 127 );
+    }
+
+    close( fds[ 1 ] );
+    std::string output;
+    char buffer[ 64 ];
+    for( ssize_t n; ( n = read( fds[ 0 ], buffer, sizeof( buffer ))) > 0; )
+      output.append( buffer, (std::size_t)n );
+    close( fds[ 0 ] );
+
+    int status = 0;
+    if( child < 0 || waitpid( child, &status, 0 ) != child || !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+      return std::nullopt;
+    return std::strtol( output.c_str(), nullptr, 10 );
+  }
+
+  std::shared_ptr< ProgressiveImage >
+  decodeFully( const std::string &filename )
+  {
+    const MappedFile file{ filename.c_str() };
+    auto image = std::make_shared< ProgressiveImage >( readImageHeader( file, filename.c_str()));
+    image->requestFullResolution();
+    decodeImageFile( file, filename.c_str(), *image );
+    return image;
+  }
+
+  // a whole image into a texture of its size, then waits for the GPU to have it;
+  // with rgba, an RGB image's pixels are expanded to RGBA first (into it), and uploaded as those
+  void
+  uploadTexture( ProgressiveImage &image, const ImageDimensions &dimensions, TextureUploadRing *ring, std::vector< unsigned char > *rgba = nullptr )
+  {
+    GLuint texture{};
+    glGenTextures( 1, &texture );
+    Destroyer _texture{ [ & ] { glDeleteTextures( 1, &texture ); }};
+    glBindTexture( GL_TEXTURE_2D, texture );
+    const GlTextureFormat format = getGlTextureFormat( dimensions );
+    allocateTextureStorage( format, dimensions.width, dimensions.height, 1 );
+
+    if( rgba )
+    {
+      rgba->resize( (std::size_t)dimensions.width * dimensions.height * 4 );
+      getPixelConversions().expandRgbToRgba( image.getPixels(), rgba->data(), (std::size_t)dimensions.width * dimensions.height );
+      ring->upload(
+          GL_TEXTURE_2D, 0, 0, dimensions.width, dimensions.height, GL_RGBA, format.type,
+          rgba->data(), (std::size_t)dimensions.width * 4 );
+    }
+    else if( ring )
+      ring->upload(
+          GL_TEXTURE_2D, 0, 0, dimensions.width, dimensions.height, format.format, format.type,
+          image.getPixels(), image.getRowBytes());
+    else
+    {
+      glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+      glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+      glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+      glTexSubImage2D(
+          GL_TEXTURE_2D, 0, 0, 0, dimensions.width, dimensions.height, format.format, format.type,
+          image.getPixels());
+    }
+
+    glFinish();
+  }
+
+//==============================================================================
+
+  ImageBench
+  benchImage( const std::string &filename, int iterations, GLint maxTextureSize )
+  {
+    ImageBench bench{ filename, {}, {}, {} };
+    {
+      const MappedFile file{ filename.c_str() };
+      bench.dimensions = readImageHeader( file, filename.c_str());
+    }
+    const ImageDimensions &dimensions = bench.dimensions;
+
+    // the file's bytes reaching the decoder either way
+    bench.time( "loadImageFile, mapped", iterations, [ & ] { return (bool)loadImageFile( filename.c_str()); } );
+    bench.time( "loadImageFile, read", iterations, [ & ] { return (bool)loadImageFile( filename.c_str(), MappedFile::Access::read ); } );
+
+    // and the memory each takes: a mapped file's pages count while they're resident, a read one's buffer does
+    for( const auto &[ name, access ] : { std::pair{ "loadImageFile, mapped", "map" }, std::pair{ "loadImageFile, read", "read" } } )
+      if( const std::optional< long > kilobytes = measurePeakKilobytes( access, filename ))
+        bench.peakKilobytes.emplace_back( name, *kilobytes );
+
+    bench.time( "loadImageFile to fit the viewport", iterations, [ & ]
+    {
+      return (bool)loadImageFile( filename.c_str(), TargetSize{ viewportWidth, viewportHeight } );
+    } );
+
+    // how decoding scales with threads, for the formats with a multithreaded decoder
+    bench.time( "stb_image, 1 thread", iterations, [ & ]
+    {
+      const MappedFile file{ filename.c_str() };
+      int w, h, n;
+      stbi_uc *pixels = stbi_load_from_memory( file.data(), (int)file.size(), &w, &h, &n, 0 );
+      stbi_image_free( pixels );
+      return pixels != nullptr;
+    } );
+
+    // an animation's frames in turn, each a whole canvas as the renderer gets it
+    if( const MappedFile file{ filename.c_str() }; isAnimatedGif( { file.data(), file.size() } ))
+    {
+      std::optional< GifDecoder > decoder;
+      std::vector< unsigned char > rgba( (std::size_t)dimensions.width * dimensions.height * 4 );
+      bench.time( "GifDecoder, next frame", iterations, [ & ]
+      {
+        if( decoder && decoder->decodeNextFrame( rgba.data()))
+          return true;
+
+        // one which doesn't loop forever starts over
+        decoder.emplace( std::span{ file.data(), file.size() } );
+        return decoder->decodeNextFrame( rgba.data()).has_value();
+      } );
+    }
+
+    // a decoded image's buffer, written all over as a decoder does: fresh from the heap as before, or recycled
+    const std::size_t pixelBytes = (std::size_t)dimensions.width * dimensions.height * dimensions.getPixelBytes();
+    bench.time( "pixel buffer, new[]", iterations, [ & ]
+    {
+      std::unique_ptr< unsigned char[] > pixels{ new unsigned char[ pixelBytes ] };
+      std::memset( pixels.get(), 1, pixelBytes );
+      return pixels[ pixelBytes - 1 ] == 1;
+    } );
+    bench.time( "pixel buffer, pooled", iterations, [ & ]
+    {
+      unsigned char *pixels = static_cast< unsigned char * >( allocatePixelBuffer( pixelBytes ));
+      std::memset( pixels, 1, pixelBytes );
+      const bool written = pixels[ pixelBytes - 1 ] == 1;
+      freePixelBuffer( pixels );
+      return written;
+    } );
+
+    for( unsigned nThreads = 2, most = std::max( 2u, std::thread::hardware_concurrency()); nThreads <= most; nThreads *= 2 )
+      bench.time( "parallel decoder, " + std::to_string( nThreads ) + " threads", iterations, [ & ]
+      {
+        const MappedFile file{ filename.c_str() };
+        ProgressiveImage image{ dimensions };
+        return decodeJpegInParallel( file, nThreads, image ) || decodePngPipelined( file, nThreads, image );
+      } );
+
+    // what the render thread waits for before it can make the renderer (the header, and the preview when decoded to fit);
+    // the decoding carries on untimed
+    std::shared_ptr< ImageSource > source;
+    bench.time( "ImageSource ready, makeGlRendererMaker", iterations, [ & ]
+    {
+      source = std::make_shared< ImageSource >( filename );
+      source->startLoading();
+      const std::unique_ptr< IGlRendererMaker > maker = makeGlRendererMaker( source );
+      source->getFutureImage().wait();
+      return maker->isReady();
+    }, [ & ] { source.reset(); } );
+
+    // what the tiled renderer adds to building each tile when compressing them, here over the whole image at once
+    if( dimensions.channelType == ChannelType::uint8 && ( dimensions.nChannels == 1 || dimensions.nChannels == 3 ))
+    {
+      const std::shared_ptr< ProgressiveImage > image = decodeFully( filename );
+      bench.time( "compressBc1, 1 thread", iterations, [ & ]
+      {
+        return !compressBc1( image->getPixels(), dimensions.width, dimensions.height, dimensions.nChannels, image->getRowBytes()).empty();
+      } );
+    }
+
+    // uploads: the image is decoded once, then shown again and again from the start by a new renderer each time
+    const std::size_t textureBytes = (std::size_t)dimensions.width * dimensions.height * getGlTextureFormat( dimensions ).texelBytes * 4 / 3;
+    if( dimensions.width > maxTextureSize || dimensions.height > maxTextureSize || textureBytes > textureBudgetBytes )
+    {
+      std::cerr << filename << ": would be tiled, upload stages skipped" << std::endl;
+      return bench;
+    }
+
+    const std::shared_ptr< ProgressiveImage > image = decodeFully( filename );
+
+    TextureUploadRing ring;
+    bench.time( "glTexSubImage2D from client memory", iterations, [ & ] { uploadTexture( *image, dimensions, nullptr ); return true; } );
+    bench.time( "TextureUploadRing", iterations, [ & ] { uploadTexture( *image, dimensions, &ring ); return true; } );
+
+    // whether this driver's RGB uploads are slow enough to be worth expanding them to RGBA on the CPU
+    std::vector< unsigned char > rgba;
+    bench.time( "expandRgbToRgba, TextureUploadRing", iterations, [ & ]
+    {
+      if( dimensions.nChannels != 3 || dimensions.channelType != ChannelType::uint8 )
+        return false;
+      uploadTexture( *image, dimensions, &ring, &rgba );
+      return true;
+    } );
+
+    TextureCache textureCache{ textureBudgetBytes }; // unused: no key, so every renderer uploads
+    bench.time( "makeGlRenderer_ImageRenderer to first frame", iterations, [ & ]
+    {
+      std::unique_ptr< IGlRenderer > renderer = makeGlRenderer_ImageRenderer( image, textureCache, std::nullopt );
+      while( renderer->getNextUpdateTime())
+        renderer->update();
+      renderer->render();
+      glFinish();
+      return true;
+    } );
+
+    return bench;
+  }
+
+  // the pixels of each decoder of this repo's which applies to the image, against stb_image's (premultiplied, as a
+  // ProgressiveImage's rows are when published, if the image has alpha): prints a line for each, false if any differs
+  bool
+  checkDecoders( const std::string &filename, const ImageDimensions &dimensions )
+  {
+    const MappedFile file{ filename.c_str() };
+    int width, height, nChannels;
+    const std::unique_ptr< stbi_uc, void ( * )( void * ) > decoded{
+        stbi_load_from_memory( file.data(), (int)file.size(), &width, &height, &nChannels, 0 ), stbi_image_free };
+    if( !decoded )
+    {
+      std::printf( "  decoders not checked: %s\n", stbi_failure_reason());
+      return true;
+    }
+
+    const std::size_t nPixels = (std::size_t)width * height;
+    const std::vector< unsigned char > expected( decoded.get(), decoded.get() + nPixels * nChannels );
+    std::vector< unsigned char > premultiplied = expected;
+    if( nChannels == 2 || nChannels == 4 )
+      getPixelConversions().premultiplyAlpha( premultiplied.data(), nPixels, nChannels );
+
+    bool same = true;
+    int nChecked = 0;
+    auto compare = [ & ]( const std::string &decoder, const ImageDimensions &got, const unsigned char *pixels, const std::vector< unsigned char > &reference )
+    {
+      ++nChecked;
+      if( got.width != width || got.height != height || got.nChannels != nChannels || got.channelType != ChannelType::uint8 )
+      {
+        std::printf( "  %-48s %dx%d, %d channel(s), not stb_image's %dx%d, %d\n",
+                     decoder.c_str(), got.width, got.height, got.nChannels, width, height, nChannels );
+        same = false;
+        return;
+      }
+
+      std::size_t nDiffering = 0;
+      int mostDifferent = 0;
+      for( std::size_t i = 0; i < reference.size(); ++i )
+        if( pixels[ i ] != reference[ i ] )
+        {
+          ++nDiffering;
+          mostDifferent = std::max( mostDifferent, std::abs( pixels[ i ] - reference[ i ] ));
+        }
+
+      if( nDiffering )
+        std::printf( "  %-48s %zu of %zu bytes differ from stb_image's, by up to %d\n", decoder.c_str(), nDiffering, reference.size(), mostDifferent );
+      else
+        std::printf( "  %-48s same pixels as stb_image\n", decoder.c_str());
+      same = same && !nDiffering;
+    };
+
+    // the multithreaded decoders only write 8 bits per channel, so they don't take anything else
+    const unsigned nThreads = std::max( 2u, std::thread::hardware_concurrency());
+    const std::string threads = ", " + std::to_string( nThreads ) + " threads";
+    if( dimensions.channelType == ChannelType::uint8 )
+    {
+      if( ProgressiveImage image{ dimensions }; decodeJpegInParallel( file, nThreads, image ))
+        compare( "decodeJpegInParallel" + threads, dimensions, image.getPixels(), premultiplied );
+      if( ProgressiveImage image{ dimensions }; decodePngPipelined( file, nThreads, image ))
+        compare( "decodePngPipelined" + threads, dimensions, image.getPixels(), premultiplied );
+    }
+
+    // its strips gathered into a whole image, as they are before premultiplying
+    std::vector< unsigned char > strips;
+    ImageDimensions stripDimensions;
+    if( decodePngInStrips( file, 64, [ & ]( const ImageDimensions &whole, int firstRow, int nRows, unsigned char *rows )
+        {
+          stripDimensions = whole;
+          const std::size_t rowBytes = (std::size_t)whole.width * whole.nChannels;
+          strips.resize( (std::size_t)whole.height * rowBytes );
+          std::memcpy( strips.data() + firstRow * rowBytes, rows, nRows * rowBytes );
+          return true;
+        } ))
+      compare( "decodePngInStrips", stripDimensions, strips.data(), expected );
+
+    if( !nChecked )
+      std::printf( "  decoders not checked: none but stb_image applies\n" );
+    return same;
+  }
+
+  // each conversion in each instruction set this CPU has, over an image's worth of pixels, against the scalar one
+  void
+  benchPixelConversions( int iterations )
+  {
+    constexpr std::size_t nPixels = 4000 * 3000;
+    std::vector< unsigned char > rgba( nPixels * 4 ), rgb( nPixels * 3 );
+    std::vector< uint16_t > channels16( nPixels * 3 );
+    for( std::size_t i = 0; i < rgba.size(); ++i )
+      rgba[ i ] = (unsigned char)( i * 7 );
+    for( std::size_t i = 0; i < channels16.size(); ++i )
+      channels16[ i ] = (uint16_t)( i * 263 );
+
+    struct Kernel
+    {
+      const char *name;
+      std::size_t bytes; // read and written
+      std::function< void( const PixelConversions & ) > run;
+    };
+    const Kernel kernels[]{
+        { "premultiplyAlpha, RGBA", nPixels * 8, [ & ]( const PixelConversions &p ) { p.premultiplyAlpha( rgba.data(), nPixels, 4 ); } },
+        { "expandRgbToRgba", nPixels * 7, [ & ]( const PixelConversions &p ) { p.expandRgbToRgba( rgb.data(), rgba.data(), nPixels ); } },
+        { "reduce16To8, RGB", nPixels * 9, [ & ]( const PixelConversions &p ) { p.reduce16To8( channels16.data(), rgb.data(), nPixels * 3 ); } },
+    };
+
+    std::printf( "\npixel conversions, %.1f MP:\n", nPixels / 1e6 );
+    std::printf( "  %-32s %-8s %10s %10s %10s\n", "kernel", "version", "median ms", "GB/s", "speedup" );
+    for( const Kernel &kernel : kernels )
+    {
+      double scalarMedian = 0;
+      for( const PixelConversions *conversions : getSupportedPixelConversions())
+      {
+        std::vector< double > milliseconds;
+        for( int i = 0; i < iterations; ++i )
+        {
+          const auto start = std::chrono::steady_clock::now();
+          kernel.run( *conversions );
+          milliseconds.push_back( std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count());
+        }
+
+        const double median = getPercentile( milliseconds, 50 );
+        if( !scalarMedian )
+          scalarMedian = median;
+        std::printf( "  %-32s %-8s %10.2f %10.2f %9.1fx\n",
+                     kernel.name, conversions->name, median, kernel.bytes / ( median / 1000 ) / 1e9, scalarMedian / median );
+      }
+    }
+  }
+} // namespace
+
+//==============================================================================
+
+int
+main( int argc, char *argv[] )
+{
+  if( argc == 4 && std::strcmp( argv[ 1 ], "--peak-kilobytes" ) == 0 )
+    return printPeakKilobytes( argv[ 2 ], argv[ 3 ] );
+
+  int iterations = defaultIterations;
+  std::vector< std::string > arguments;
+  for( int i = 1; i < argc; ++i )
+    if( std::strcmp( argv[ i ], "--iterations" ) == 0 && i + 1 < argc )
+      iterations = std::max( 1, std::atoi( argv[ ++i ] ));
+    else
+      arguments.emplace_back( argv[ i ] );
+
+  try
+  {
+    const std::vector< std::string > filenames = arguments.empty() ? writeSyntheticCorpus() : listImages( arguments );
+
+    const EglContext context{ viewportWidth, viewportHeight };
+    std::printf( "renderer: %s, %u hardware threads, %d iterations\n", context.getRenderer(), std::thread::hardware_concurrency(), iterations );
+
+    // only once per process: the programs are kept, and the next run loads them from the program binary cache
+    {
+      const auto start = std::chrono::steady_clock::now();
+      prepareGlRenderers();
+      std::printf( "shader programs: %.2f ms\n", std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count());
+    }
+
+    benchPixelConversions( iterations );
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv( GL_MAX_TEXTURE_SIZE, &maxTextureSize );
+
+    bool decodersAgree = true;
+    for( const std::string &filename : filenames )
+      try
+      {
+        const ImageBench bench = benchImage( filename, iterations, maxTextureSize );
+        bench.print();
+        decodersAgree = checkDecoders( filename, bench.dimensions ) && decodersAgree;
+      }
+      catch( const std::exception &e )
+      {
+        std::cerr << filename << ": " << e.what() << std::endl;
+      }
+
+    const PixelBufferPoolCounters pool = getPixelBufferPoolCounters();
+    std::printf(
+        "pixel buffers: %llu of %llu reused (%.0f%%), %llu MiB mapped fresh\n",
+        (unsigned long long)pool.reuses, (unsigned long long)pool.allocations,
+        pool.allocations ? 100.0 * pool.reuses / pool.allocations : 0.0, (unsigned long long)( pool.mappedBytes >> 20 ));
+
+    if( !decodersAgree )
+    {
+      std::cerr << "a decoder's pixels differ from stb_image's" << std::endl;
+      return 1;
+    }
+  }
+  catch( const std::exception &e )
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
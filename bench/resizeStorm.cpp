@@ -0,0 +1,300 @@
+// Microbenchmark of the window's event thread -> render thread handoff during a resize storm: one thread sends
+// framebuffer sizes as fast as a window manager does while the window is dragged, the other renders an image
+// with each latest size, like GlfwWindow's render thread (on an offscreen EGL context, glFinish then a sleep standing
+// in for glfwSwapBuffers waiting for the display). Compares the CommandQueue the window uses with the mutex it used to share with the
+// render thread, which was held for the whole frame.
+//
+// usage: imageviewergl_resize_bench [--events N] [--interval-us N] [--present-us N]
+// Prints how long sending each event took the event thread, and how long each event took to be presented.
+
+#include "CommandQueue.hpp"
+#include "EglContext.hpp"
+#include "GlRenderer_ImageRenderer.hpp"
+#include "Mutexed.hpp"
+#include "ProgressiveImage.hpp"
+#include "makeGlRendererMaker.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  constexpr int viewportWidth = 1920, viewportHeight = 1080;
+  constexpr int defaultEvents = 5000, defaultIntervalMicroseconds = 250; // 4 kHz: a fast mouse drag
+  constexpr int defaultPresentMicroseconds = 8000; // half a 60 Hz refresh: how long a swap may block for
+
+  struct FrameSize
+  {
+    int width, height;
+    Clock::time_point sent;
+  };
+
+  // the n-th of a storm growing and shrinking the window between half and full size
+  FrameSize
+  makeFrameSize( int n, Clock::time_point sent )
+  {
+    const int step = n % 200 < 100 ? n % 100 : 100 - n % 100;
+    return { viewportWidth / 2 + viewportWidth * step / 200, viewportHeight / 2 + viewportHeight * step / 200, sent };
+  }
+
+  double
+  getMilliseconds( Clock::duration duration )
+  {
+    return std::chrono::duration< double, std::milli >( duration ).count();
+  }
+
+  double
+  getPercentile( std::vector< double > values, double percentile )
+  {
+    if( values.empty())
+      return 0;
+
+    std::sort( values.begin(), values.end());
+    return values[ std::min( values.size() - 1, (std::size_t)( percentile / 100 * values.size())) ];
+  }
+
+  std::shared_ptr< ProgressiveImage >
+  makeImage()
+  {
+    const ImageDimensions dimensions{ 1024, 768, 3 };
+    auto image = std::make_shared< ProgressiveImage >( dimensions );
+
+    unsigned char *p = image->allocatePixels();
+    for( int y = 0; y < dimensions.height; ++y )
+      for( int x = 0; x < dimensions.width; ++x, p += 3 )
+        p[ 0 ] = (unsigned char)x, p[ 1 ] = (unsigned char)y, p[ 2 ] = (unsigned char)( x ^ y );
+
+    image->requestFullResolution();
+    image->publishRows( dimensions.height );
+    return image;
+  }
+
+//==============================================================================
+
+  struct Results
+  {
+    std::vector< double > sendMilliseconds, presentMilliseconds;
+    int nFrames = 0;
+
+    void print( const char *name ) const
+    {
+      std::printf( "\n%s: %zu events, %d frames\n", name, sendMilliseconds.size(), nFrames );
+      std::printf( "  %-28s %10s %10s %10s\n", "", "median ms", "p99 ms", "max ms" );
+      for( const auto &[ stage, milliseconds ] : { std::pair{ "send (event thread)", &sendMilliseconds },
+                                                   std::pair{ "event to present", &presentMilliseconds }} )
+        std::printf( "  %-28s %10.3f %10.3f %10.3f\n", stage, getPercentile( *milliseconds, 50 ),
+                     getPercentile( *milliseconds, 99 ), getPercentile( *milliseconds, 100 ));
+    }
+  };
+
+  // the render thread's side of both: a context, a renderer, and a frame of a given size
+  struct RenderThread
+  {
+    EglContext context{ viewportWidth, viewportHeight };
+    TextureCache textureCache{ std::size_t{ 64 } << 20 };
+    std::unique_ptr< IGlRenderer > renderer;
+    const std::chrono::microseconds present;
+
+    RenderThread( std::shared_ptr< ProgressiveImage > image, std::chrono::microseconds present )
+        : present{ present }
+    {
+      prepareGlRenderers();
+      renderer = makeGlRenderer_ImageRenderer( std::move( image ), textureCache, std::nullopt );
+      while( renderer->getNextUpdateTime())
+        renderer->update();
+      // the first frame isn't part of the storm
+      glViewport( 0, 0, viewportWidth, viewportHeight );
+      renderer->render();
+      glFinish();
+    }
+
+    // returns when the frame is "presented"
+    Clock::time_point
+    renderFrame( const FrameSize &frameSize )
+    {
+      glViewport( 0, 0, frameSize.width, frameSize.height );
+      renderer->render();
+      glFinish();
+      std::this_thread::sleep_for( present );
+      return Clock::now();
+    }
+  };
+
+  // sends the events from this thread (the event thread), as it gets them, once the render thread is ready
+  void
+  sendStorm(
+      int nEvents, std::chrono::microseconds interval, std::future< void > renderThreadReady, Results &results,
+      const std::function< void( const FrameSize & ) > &send )
+  {
+    renderThreadReady.get();
+    results.sendMilliseconds.reserve( nEvents );
+    for( auto next = Clock::now(); nEvents--; next += interval )
+    {
+      std::this_thread::sleep_until( next );
+
+      // stamped with when the window system had it, so an event thread still stuck sending the last one delays it
+      const FrameSize frameSize = makeFrameSize( nEvents, next );
+      const Clock::time_point start = Clock::now();
+      send( frameSize );
+      results.sendMilliseconds.push_back( getMilliseconds( Clock::now() - start ));
+    }
+  }
+
+//==============================================================================
+
+  Results
+  benchCommandQueue(
+      const std::shared_ptr< ProgressiveImage > &image, int nEvents, std::chrono::microseconds interval,
+      std::chrono::microseconds present )
+  {
+    CommandQueue< std::optional< FrameSize >> commands{ 256 }; // nullopt quits
+    Results results;
+    std::promise< void > renderThreadReady;
+
+    std::thread renderThread{
+        [ & ]
+        {
+          RenderThread rt{ image, present };
+          renderThreadReady.set_value();
+          std::vector< Clock::time_point > pending;
+          for( bool quit = false; !quit; )
+          {
+            std::optional< FrameSize > frameSize;
+            commands.drain(
+                [ & ]( std::optional< FrameSize > command )
+                {
+                  if( !command )
+                    quit = true;
+                  else
+                    frameSize = command, pending.push_back( command->sent );
+                } );
+
+            if( frameSize )
+            {
+              const Clock::time_point presented = rt.renderFrame( *frameSize );
+              for( const Clock::time_point sent : pending )
+                results.presentMilliseconds.push_back( getMilliseconds( presented - sent ));
+              pending.clear();
+              ++results.nFrames;
+            }
+
+            if( !quit )
+              commands.waitUntil( std::nullopt );
+          }
+        }};
+
+    sendStorm( nEvents, interval, renderThreadReady.get_future(), results, [ & ]( const FrameSize &frameSize ) { commands.push( frameSize ); } );
+
+    commands.push( std::nullopt );
+    while( !commands.flush())
+      std::this_thread::yield();
+    renderThread.join();
+
+    return results;
+  }
+
+  // how GlfwWindow shared its state with the render thread before CommandQueue
+  Results
+  benchMutexed(
+      const std::shared_ptr< ProgressiveImage > &image, int nEvents, std::chrono::microseconds interval,
+      std::chrono::microseconds present )
+  {
+    struct Shared
+    {
+      bool shouldRender = false, shouldQuit = false;
+      std::optional< FrameSize > frameSizeUpdate;
+      std::vector< Clock::time_point > pending;
+    };
+    Mutexed< Shared > shared;
+    Results results;
+    std::promise< void > renderThreadReady;
+
+    std::thread renderThread{
+        [ & ]
+        {
+          RenderThread rt{ image, present };
+          renderThreadReady.set_value();
+          auto waitPredicate = []( const Shared &s ) { return s.shouldRender || s.shouldQuit; };
+          auto whileLocked = [ & ]( Shared &s ) -> bool
+          {
+            if( s.shouldQuit )
+              return false;
+
+            const Clock::time_point presented = rt.renderFrame( *std::exchange( s.frameSizeUpdate, std::nullopt ));
+            for( const Clock::time_point sent : s.pending )
+              results.presentMilliseconds.push_back( getMilliseconds( presented - sent ));
+            s.pending.clear();
+            s.shouldRender = false;
+            ++results.nFrames;
+            return true;
+          };
+
+          while( shared.waitThen( waitPredicate, whileLocked ));
+        }};
+
+    sendStorm( nEvents, interval, renderThreadReady.get_future(), results, [ & ]( const FrameSize &frameSize )
+    {
+      shared.withLockThenNotify(
+          [ & ]( Shared &s )
+          {
+            s.frameSizeUpdate = frameSize;
+            s.pending.push_back( frameSize.sent );
+            s.shouldRender = true;
+          } );
+    } );
+
+    shared.withLockThenNotify( []( Shared &s ) { s.shouldQuit = true; } );
+    renderThread.join();
+
+    return results;
+  }
+} // namespace
+
+//==============================================================================
+
+int
+main( int argc, char *argv[] )
+{
+  int nEvents = defaultEvents, intervalMicroseconds = defaultIntervalMicroseconds, presentMicroseconds = defaultPresentMicroseconds;
+  for( int i = 1; i + 1 < argc; i += 2 )
+    if( std::strcmp( argv[ i ], "--events" ) == 0 )
+      nEvents = std::max( 1, std::atoi( argv[ i + 1 ] ));
+    else if( std::strcmp( argv[ i ], "--interval-us" ) == 0 )
+      intervalMicroseconds = std::max( 0, std::atoi( argv[ i + 1 ] ));
+    else if( std::strcmp( argv[ i ], "--present-us" ) == 0 )
+      presentMicroseconds = std::max( 0, std::atoi( argv[ i + 1 ] ));
+
+  try
+  {
+    const std::shared_ptr< ProgressiveImage > image = makeImage();
+    const std::chrono::microseconds interval{ intervalMicroseconds }, present{ presentMicroseconds };
+
+    std::printf( "%d framebuffer size events, one every %d us, %d us per present, on %u hardware threads\n",
+                 nEvents, intervalMicroseconds, presentMicroseconds, std::thread::hardware_concurrency());
+
+    // not reported: the first contexts of the process are much slower than the rest (e.g. llvmpipe's JIT)
+    benchCommandQueue( image, std::min( nEvents, 500 ), interval, present );
+
+    benchCommandQueue( image, nEvents, interval, present ).print( "CommandQueue" );
+    benchMutexed( image, nEvents, interval, present ).print( "Mutexed, locked for the frame" );
+  }
+  catch( const std::exception &e )
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
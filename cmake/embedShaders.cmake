@@ -0,0 +1,43 @@
+# Run as a script: cmake -DOUTPUT=embeddedShaders.cpp -DSHADERS="a.vert;a.frag;..." -P embedShaders.cmake
+# Writes a C++ source defining getEmbeddedShader(..) (see util/embeddedShaders.hpp) with each shader's contents
+# as a byte array, found by its file name.
+
+set(definitions "")
+set(entries "")
+
+foreach(shader IN LISTS SHADERS)
+  get_filename_component(name ${shader} NAME)
+  string(MAKE_C_IDENTIFIER ${name} identifier)
+
+  file(READ ${shader} hex HEX)
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "'\\\\x\\1'," bytes "${hex}")
+
+  string(APPEND definitions "  constexpr char ${identifier}[]{ ${bytes} };\n")
+  string(APPEND entries "      { \"${name}\", { ${identifier}, sizeof( ${identifier} ) }},\n")
+endforeach()
+
+file(WRITE ${OUTPUT} "// generated by cmake/embedShaders.cmake from the shaders directory: edit those instead
+
+#include \"embeddedShaders.hpp\"
+
+#include \"ErrorString.hpp\"
+
+#include <utility>
+
+namespace
+{
+${definitions}} // namespace
+
+std::string_view
+getEmbeddedShader( std::string_view name )
+{
+  static constexpr std::pair< std::string_view, std::string_view > shaders[]{
+${entries}  };
+
+  for( const auto &[ shaderName, source ] : shaders )
+    if( shaderName == name )
+      return source;
+
+  throw ErrorString( \"no shader named \", name, \" was embedded\" );
+}
+")
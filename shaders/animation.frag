@@ -0,0 +1,29 @@
+#version 410
+
+layout(location = 0) in vec2 uv;
+
+uniform sampler2DArray frames; // a ring of an animation's frames
+uniform float layer; // the one shown
+
+layout(location = 0) out vec4 outColor;
+
+#ifdef TONE_MAPPING // only in the variant for a changed exposure: the rest don't need the extra work
+uniform float exposure; // multiplies the light: 2 to the power of the exposure in stops
+
+// display values (gamma 2.2, near enough sRGB) of the texture's, at the exposure
+vec3 toDisplay( vec3 color )
+{
+  return pow( clamp( pow( color, vec3( 2.2 )) * exposure, 0.0, 1.0 ), vec3( 1.0 / 2.2 ));
+}
+#endif
+
+void main()
+{
+  vec4 frameColor = texture( frames, vec3( uv, layer ));
+#ifdef TONE_MAPPING
+  // the frames are premultiplied by alpha: the curve is for the colour itself
+  if( frameColor.a > 0.0 )
+    frameColor.rgb = toDisplay( frameColor.rgb / frameColor.a ) * frameColor.a;
+#endif
+  outColor = frameColor; // already premultiplied, as the window's compositor wants it
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#version 410
+
+// the frame times HUD: a bar per frame, oldest on the left, over a translucent background (see FrameTimesHud.hpp)
+
+layout(location = 0) in vec2 uv; // x across the frames, y up the milliseconds
+
+uniform sampler2D timings; // one column per frame: the frame's CPU time in row 0, its GPU time (< 0: none) in row 1
+uniform float nFrames;
+uniform float heightMs; // the top of the graph
+uniform float refreshMs; // drawn as a line: frames above it miss a refresh
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+  int column = int( uv.x * nFrames );
+  float frameMs = texelFetch( timings, ivec2( column, 0 ), 0 ).r;
+  float gpuMs = texelFetch( timings, ivec2( column, 1 ), 0 ).r;
+  float ms = uv.y * heightMs;
+
+  // premultiplied, as the window's compositor wants it
+  vec4 color = vec4( 0.0, 0.0, 0.0, 0.6 );
+  if( ms < frameMs )
+    color = frameMs > refreshMs ? vec4( 0.9, 0.3, 0.2, 1.0 ) : vec4( 0.3, 0.8, 0.3, 1.0 );
+  if( ms < gpuMs )
+    color = vec4( 0.3, 0.5, 1.0, 1.0 );
+  if( abs( ms - refreshMs ) < fwidth( ms ))
+    color = vec4( 1.0 );
+
+  outColor = color;
+}
@@ -3,13 +3,42 @@
 layout(location = 0) in vec2 uv;
 
 uniform sampler2D theTexture;
+uniform float loadedFraction; // rows below this (in uv.y) haven't been decoded yet
+uniform sampler2D previewTexture; // shown instead of the rows not decoded yet
+uniform bool hasPreview;
 
 layout(location = 0) out vec4 outColor;
 
+#ifdef TONE_MAPPING // only in the variant for HDR images and a changed exposure: the rest don't need the extra work
+uniform float exposure; // multiplies the light: 2 to the power of the exposure in stops
+uniform bool isLinear; // the texture holds linear light (an HDR image), not values encoded for display
+uniform bool toneMap; // for linear light: compresses what's brighter than white rather than clipping it
+
+// Narkowicz's fit of the ACES filmic curve: white (1.0) comes out at 0.8, and highlights roll off instead of clipping
+vec3 filmic( vec3 x )
+{
+  return clamp(( x * ( 2.51 * x + 0.03 )) / ( x * ( 2.43 * x + 0.59 ) + 0.14 ), 0.0, 1.0 );
+}
+
+// display values (gamma 2.2, near enough sRGB) of the texture's, at the exposure
+vec3 toDisplay( vec3 color )
+{
+  vec3 light = ( isLinear ? color : pow( color, vec3( 2.2 ))) * exposure;
+  light = isLinear && toneMap ? filmic( light ) : clamp( light, 0.0, 1.0 );
+  return pow( light, vec3( 1.0 / 2.2 ));
+}
+#endif
 
 void main()
 {
-  vec4 textureColor = texture( theTexture, uv );
-  outColor = vec4( textureColor.rgb * textureColor.a, textureColor.a );
-//  outColor = texture( theTexture, uv );
+  vec4 textureColor =
+      uv.y <= loadedFraction ? texture( theTexture, uv )
+      : hasPreview ? texture( previewTexture, uv )
+      : vec4( 0.0 );
+#ifdef TONE_MAPPING
+  // the texture is premultiplied by alpha (see ProgressiveImage::publishRows): the curve is for the colour itself
+  if( textureColor.a > 0.0 )
+    textureColor.rgb = toDisplay( textureColor.rgb / textureColor.a ) * textureColor.a;
+#endif
+  outColor = textureColor; // already premultiplied, as the window's compositor wants it
 }
\ No newline at end of file
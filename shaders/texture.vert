@@ -1,5 +1,7 @@
 #version 410
 
+uniform vec4 uvRect; // the part of the image in view: left, top, right, bottom
+
 layout(location = 0) out vec2 uv;
 
 void main()
@@ -11,7 +13,7 @@ void main()
   vec2(1.0, 1.0)
   );
 
-  const vec2 uvs[4] = vec2[](
+  const vec2 corners[4] = vec2[](
   vec2(0.0, 1.0),
   vec2(1.0, 1.0),
   vec2(0.0, 0.0),
@@ -19,5 +21,5 @@ void main()
   );
 
   gl_Position = vec4( xys[ gl_VertexID ], 0.0, 1.0);
-  uv = uvs[ gl_VertexID ];
-}
\ No newline at end of file
+  uv = mix( uvRect.xy, uvRect.zw, corners[ gl_VertexID ] );
+}
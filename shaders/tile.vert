@@ -0,0 +1,24 @@
+#version 410
+
+// one tile of a tiled image: a quad covering positionRect (clip space),
+// textured with the part of the tile texture in uvRect (which leaves out the tile's border texels)
+
+uniform vec4 positionRect; // left, top, right, bottom
+uniform vec4 uvRect; // same corners
+
+layout(location = 0) out vec2 uv;
+
+void main()
+{
+  const vec2 corners[4] = vec2[](
+  vec2(0.0, 1.0),
+  vec2(1.0, 1.0),
+  vec2(0.0, 0.0),
+  vec2(1.0, 0.0)
+  );
+
+  vec2 corner = corners[ gl_VertexID ];
+
+  gl_Position = vec4( mix( positionRect.xy, positionRect.zw, corner ), 0.0, 1.0 );
+  uv = mix( uvRect.xy, uvRect.zw, corner );
+}
@@ -0,0 +1,87 @@
+#include "AnimatedImage.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+AnimatedImage::AnimatedImage( std::shared_ptr< const MappedFile > file )
+    : file{ std::move( file ) }
+    , decoder{ { this->file->data(), this->file->size() } }
+    , dimensions{ decoder.getDimensions() }
+    , nFrames{ (int)std::clamp< std::size_t >( maxBufferBytes / ( (std::size_t)dimensions.width * dimensions.height * 4 ), 2, maxFrames ) }
+    , decoding{ [ this ] { decode(); } } {}
+
+AnimatedImage::~AnimatedImage()
+{
+  stopping = true;
+  ++wakeups;
+  wakeups.notify_all();
+  decoding.join();
+}
+
+void
+AnimatedImage::decode()
+{
+  traceThreadName( "animation" );
+
+  try
+  {
+    for( int nAllocated = 0; !stopping; )
+    {
+      // read before looking for a buffer, so a buffer given back after that still wakes this up
+      const unsigned seen = wakeups.load();
+
+      std::optional< Frame > frame = freeFrames.tryPop();
+      if( !frame && nAllocated < nFrames )
+      {
+        frame.emplace();
+        frame->pixels.resize( (std::size_t)dimensions.width * dimensions.height * 4 );
+        ++nAllocated;
+      }
+
+      if( !frame )
+      {
+        wakeups.wait( seen );
+        continue;
+      }
+
+      TraceScope trace{ "decode frame" };
+      const std::optional< std::chrono::milliseconds > delay = decoder.decodeNextFrame( frame->pixels.data());
+      if( !delay )
+        break;
+
+      // never full: there are only nFrames frames
+      frame->delay = *delay;
+      decodedFrames.tryPush( std::move( *frame ));
+    }
+  }
+  catch( const std::exception &e )
+  {
+    // the animation just ends with the frames decoded so far
+    std::cerr << e.what() << std::endl;
+  }
+
+  finished.store( true, std::memory_order_release );
+}
+
+std::optional< AnimatedImage::Frame >
+AnimatedImage::takeFrame()
+{
+  // read first: the last frame is pushed before finished is set
+  const bool wasFinished = finished.load( std::memory_order_acquire );
+
+  if( std::optional< Frame > frame = decodedFrames.tryPop())
+    return frame;
+
+  ended = wasFinished;
+  return std::nullopt;
+}
+
+void
+AnimatedImage::giveBack( Frame &&frame )
+{
+  freeFrames.tryPush( std::move( frame ));
+  ++wakeups;
+  wakeups.notify_all();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "GifDecoder.hpp"
+#include "ImageDimensions.hpp"
+#include "MappedFile.hpp"
+#include "NoCopy.hpp"
+#include "SpscQueue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// An animated GIF's frames, decoded ahead on a thread of its own for the rendering thread to show in turn.
+// They go round a ring of a few frame buffers (at least 2, and as many as fit in maxBufferBytes, up to maxFrames):
+// however long the animation, no more than those are ever held, and the decoding thread waits for the rendering
+// thread to give one back before decoding into it again.
+// Frames are handed over through lock-free queues, both ways, so neither thread ever waits for the other.
+
+struct AnimatedImage : NoCopy
+{
+  struct Frame
+  {
+    std::vector< unsigned char > pixels; // RGBA, premultiplied
+    std::chrono::milliseconds delay{}; // how long it's shown
+  };
+
+  // file must be an animated GIF (see isAnimatedGif(..)): decoding starts straight away
+  explicit
+  AnimatedImage( std::shared_ptr< const MappedFile > file )
+  noexcept( false ); // throws ErrorString if it isn't a GIF
+
+  ~AnimatedImage(); // stops decoding and waits for it to stop
+
+  ImageDimensions getDimensions() const { return dimensions; }
+
+//------------------------------------------------------------------------------
+// rendering thread
+
+  // the next frame, or nullopt if it isn't decoded yet (or there are no more)
+  std::optional< Frame > takeFrame();
+
+  // done with a frame from takeFrame(): its buffer is decoded into again
+  void giveBack( Frame && );
+
+  // once takeFrame() has come up empty after the last loop's last frame, or after a decoding failure
+  bool isFinished() const { return ended; }
+
+private:
+  static constexpr std::size_t maxBufferBytes = 64 << 20;
+  static constexpr int maxFrames = 8;
+
+  const std::shared_ptr< const MappedFile > file;
+  GifDecoder decoder;
+  const ImageDimensions dimensions;
+  const int nFrames;
+
+  SpscQueue< Frame > decodedFrames{ (std::size_t)nFrames }, freeFrames{ (std::size_t)nFrames };
+  bool ended{}; // rendering thread
+
+  std::atomic< bool > finished{}, stopping{};
+  std::atomic< unsigned > wakeups{}; // bumped by giveBack(..) and the destructor, to wait on both
+  std::thread decoding;
+
+  void decode();
+};
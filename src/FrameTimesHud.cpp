@@ -0,0 +1,97 @@
+#include "Destroyer.hpp"
+#include "FrameTimesHud.hpp"
+#include "getShaderProgram.hpp"
+
+#include <algorithm>
+
+namespace
+{
+  constexpr const char *vertShaderName = "tile.vert"; // just a quad, placed in clip space
+  constexpr const char *fragShaderName = "frameTimes.frag";
+
+  // in framebuffer pixels: a pixel per frame across, from the window's bottom left corner
+  constexpr int hudWidth = FrameTimings::maxFrames, hudHeight = 100, hudMargin = 8;
+
+  struct FrameTimesHud : IFrameTimesHud
+  {
+    GLuint emptyVertexArray{};
+    Destroyer _emptyVertexArray;
+
+    GLuint texture{};
+    Destroyer _texture;
+
+    GLuint program{}; // shared, see getShaderProgram.hpp
+    GLint positionRectUniform{}, uvRectUniform{}, nFramesUniform{}, heightMsUniform{}, refreshMsUniform{};
+
+    float columns[ 2 ][ FrameTimings::maxFrames ]{}; // as uploaded: frame times, then GPU times
+
+    FrameTimesHud()
+    noexcept( false )
+      : program{ getShaderProgram( vertShaderName, fragShaderName ) }
+    {
+      positionRectUniform = glGetUniformLocation( program, "positionRect" );
+      uvRectUniform = glGetUniformLocation( program, "uvRect" );
+      nFramesUniform = glGetUniformLocation( program, "nFrames" );
+      heightMsUniform = glGetUniformLocation( program, "heightMs" );
+      refreshMsUniform = glGetUniformLocation( program, "refreshMs" );
+
+      glGenVertexArrays( 1, &emptyVertexArray );
+      _emptyVertexArray = Destroyer{ [ this ] { glDeleteVertexArrays( 1, &this->emptyVertexArray ); }};
+
+      // read with texelFetch only: no filtering, no mipmaps
+      glGenTextures( 1, &texture );
+      _texture = Destroyer{ [ this ] { glDeleteTextures( 1, &this->texture ); }};
+      glBindTexture( GL_TEXTURE_2D, texture );
+      glTexImage2D( GL_TEXTURE_2D, 0, GL_R32F, FrameTimings::maxFrames, 2, 0, GL_RED, GL_FLOAT, nullptr );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0 );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    }
+
+    void render( const FrameTimings &timings, std::chrono::steady_clock::duration refreshInterval ) override
+    {
+      const int n = timings.getCount();
+      if( !n )
+        return;
+
+      for( int i = 0; i < n; ++i )
+      {
+        columns[ 0 ][ i ] = timings.get( i ).frameMs;
+        columns[ 1 ][ i ] = timings.get( i ).gpuMs;
+      }
+
+      glBindTexture( GL_TEXTURE_2D, texture );
+      glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+      glPixelStorei( GL_UNPACK_ROW_LENGTH, FrameTimings::maxFrames );
+      glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, n, 2, GL_RED, GL_FLOAT, columns );
+      glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+
+      GLint viewport[ 4 ]{};
+      glGetIntegerv( GL_VIEWPORT, viewport );
+      auto clipX = [ & ]( int x ) { return -1 + 2 * (float)x / viewport[ 2 ]; };
+      auto clipY = [ & ]( int y ) { return -1 + 2 * (float)y / viewport[ 3 ]; };
+
+      // room for twice the refresh interval, so a missed refresh shows as such
+      const float refreshMs = std::chrono::duration< float, std::milli >( refreshInterval ).count();
+
+      glUseProgram( program );
+      glUniform4f( positionRectUniform, clipX( hudMargin ), clipY( hudMargin + hudHeight ), clipX( hudMargin + hudWidth ), clipY( hudMargin ));
+      glUniform4f( uvRectUniform, 0, 1, (float)n / FrameTimings::maxFrames, 0 );
+      glUniform1f( nFramesUniform, (float)FrameTimings::maxFrames );
+      glUniform1f( heightMsUniform, std::max( 2 * refreshMs, 1.0f ));
+      glUniform1f( refreshMsUniform, refreshMs );
+
+      glEnable( GL_BLEND );
+      glBlendFunc( GL_ONE, GL_ONE_MINUS_SRC_ALPHA ); // premultiplied
+      glBindVertexArray( emptyVertexArray );
+      glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+      glDisable( GL_BLEND );
+    }
+  };
+} // namespace
+
+std::unique_ptr< IFrameTimesHud >
+makeFrameTimesHud()
+{
+  return std::make_unique< FrameTimesHud >();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "FrameTimings.hpp"
+
+#include <chrono>
+#include <memory>
+
+// An overlay in the bottom left corner of the window graphing the last frames' times (see FrameTimings.hpp),
+// oldest on the left: each frame's CPU time as a bar, green within the display's refresh interval and red beyond it,
+// with its GPU time as a blue bar in front, and the refresh interval as a white line. For telling apart a slow
+// renderer, a slow GPU (e.g. a software one) and a slow present (e.g. a remote desktop) when frames stutter.
+
+struct IFrameTimesHud
+{
+  virtual ~IFrameTimesHud() = default;
+
+  // over whatever is drawn already, into the current viewport
+  virtual void render( const FrameTimings &, std::chrono::steady_clock::duration refreshInterval ) = 0;
+};
+
+// in the current GL context
+std::unique_ptr< IFrameTimesHud >
+makeFrameTimesHud()
+noexcept( false ); // may throw std::exception
@@ -0,0 +1,408 @@
+#include "GifDecoder.hpp"
+
+#include "ErrorString.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+  constexpr unsigned char trailer = 0x3b, extensionIntroducer = 0x21, imageSeparator = 0x2c;
+  constexpr unsigned char graphicControlLabel = 0xf9, applicationLabel = 0xff;
+
+  constexpr int maxCodeBits = 12;
+
+  // disposal methods
+  constexpr int restoreToBackground = 2, restoreToPrevious = 3;
+
+  // frames with a delay of 0 or 10 ms are shown for this long, as every browser does: they were made for that
+  constexpr std::chrono::milliseconds defaultDelay{ 100 };
+
+  // The file's bytes from pos on, checked against their end.
+  struct Reader
+  {
+    std::span< const unsigned char > bytes;
+    std::size_t &pos;
+
+    void need( std::size_t n ) const
+    {
+      if( bytes.size() - pos < n )
+        throw ErrorString( "gif: file ended early" );
+    }
+
+    uint8_t u8()
+    {
+      need( 1 );
+      return bytes[ pos++ ];
+    }
+
+    int u16()
+    {
+      need( 2 );
+      pos += 2;
+      return bytes[ pos - 2 ] | bytes[ pos - 1 ] << 8;
+    }
+
+    std::span< const unsigned char > take( std::size_t n )
+    {
+      need( n );
+      pos += n;
+      return bytes.subspan( pos - n, n );
+    }
+
+    // a color table of 2^(n+1) entries when the flag is set
+    std::span< const unsigned char > colorTable( uint8_t packed )
+    {
+      return packed & 0x80 ? take( 3u << (( packed & 7 ) + 1 )) : std::span< const unsigned char >{};
+    }
+
+    // a chain of data sub-blocks, each prefixed by its size, up to the empty one
+    void skipSubBlocks()
+    {
+      while( const uint8_t size = u8())
+        take( size );
+    }
+  };
+
+  // parses the header and logical screen descriptor
+  void
+  readHeader( Reader &reader, int &width, int &height, std::span< const unsigned char > &globalColorTable )
+  {
+    const std::span< const unsigned char > signature = reader.take( 6 );
+    if( std::memcmp( signature.data(), "GIF87a", 6 ) != 0 && std::memcmp( signature.data(), "GIF89a", 6 ) != 0 )
+      throw ErrorString( "gif: not a GIF" );
+
+    width = reader.u16();
+    height = reader.u16();
+    const uint8_t packed = reader.u8();
+    reader.take( 2 ); // background color index and pixel aspect ratio: browsers ignore both
+    globalColorTable = reader.colorTable( packed );
+
+    if( width <= 0 || height <= 0 )
+      throw ErrorString( "gif: empty logical screen" );
+  }
+
+  // the rows of an interlaced frame come in four passes: every 8th from 0, every 8th from 4, every 4th from 2, then the odd ones
+  int
+  deinterlaceRow( int row, int height )
+  {
+    for( const auto &[ start, step ] : { std::pair{ 0, 8 }, std::pair{ 4, 8 }, std::pair{ 2, 4 }, std::pair{ 1, 2 }} )
+    {
+      const int nRows = ( height - start + step - 1 ) / step;
+      if( row < nRows )
+        return start + row * step;
+      row -= nRows;
+    }
+    return row;
+  }
+} // namespace
+
+//==============================================================================
+
+GifDecoder::GifDecoder( std::span< const unsigned char > bytes )
+    : bytes{ bytes }
+{
+  Reader reader{ bytes, pos };
+  readHeader( reader, width, height, globalColorTable );
+  firstBlockPos = pos;
+
+  canvas.assign( (std::size_t)width * height * 4, 0 );
+}
+
+std::optional< std::chrono::milliseconds >
+GifDecoder::decodeNextFrame( unsigned char *rgba )
+{
+  Reader reader{ bytes, pos };
+  int delayCentiseconds = 0, frameDisposal = 0, transparentIndex = -1;
+
+  for( ;; )
+  {
+    // a file cut short after a frame just ends there
+    const uint8_t block = pos < bytes.size() ? reader.u8() : trailer;
+
+    if( block == trailer )
+    {
+      if( !startNextLoop())
+        return std::nullopt;
+      continue;
+    }
+
+    if( block == extensionIntroducer )
+    {
+      const uint8_t label = reader.u8();
+      if( label == graphicControlLabel )
+      {
+        const std::size_t size = reader.u8();
+        const std::span< const unsigned char > control = reader.take( size );
+        if( size >= 4 )
+        {
+          frameDisposal = ( control[ 0 ] >> 2 ) & 7;
+          delayCentiseconds = control[ 1 ] | control[ 2 ] << 8;
+          transparentIndex = control[ 0 ] & 1 ? control[ 3 ] : -1;
+        }
+      }
+      else if( label == applicationLabel )
+      {
+        const std::size_t size = reader.u8();
+        const std::span< const unsigned char > identifier = reader.take( size );
+        const bool netscape = size == 11 && ( std::memcmp( identifier.data(), "NETSCAPE2.0", 11 ) == 0
+                                              || std::memcmp( identifier.data(), "ANIMEXTS1.0", 11 ) == 0 );
+
+        // its first sub-block is 1, then the loop count
+        if( netscape && pos + 4 <= bytes.size() && bytes[ pos ] >= 3 && bytes[ pos + 1 ] == 1 )
+          loopCount = bytes[ pos + 2 ] | bytes[ pos + 3 ] << 8;
+      }
+      reader.skipSubBlocks();
+      continue;
+    }
+
+    if( block != imageSeparator )
+      throw ErrorString( "gif: unknown block ", (int)block );
+
+    FrameRect rect;
+    rect.left = reader.u16();
+    rect.top = reader.u16();
+    rect.width = reader.u16();
+    rect.height = reader.u16();
+    const uint8_t packed = reader.u8();
+    const std::span< const unsigned char > localColorTable = reader.colorTable( packed );
+    const int minCodeSize = reader.u8();
+
+    dispose();
+
+    if( frameDisposal == restoreToPrevious )
+      previous = canvas;
+
+    // rows below the screen are decoded, but not kept (or drawn); whichever pass they are in, if interlaced
+    const bool interlaced = packed & 0x40;
+    if( interlaced && rect.height > height )
+      throw ErrorString( "gif: interlaced frame taller than the screen" );
+
+    decodeIndices( minCodeSize, (std::size_t)rect.width * std::min( rect.height, height ));
+    drawFrame( rect, localColorTable.empty() ? globalColorTable : localColorTable, interlaced, transparentIndex );
+    std::memcpy( rgba, canvas.data(), canvas.size());
+
+    disposal = frameDisposal;
+    disposalRect = rect;
+    ++framesThisLoop;
+
+    return delayCentiseconds <= 1 ? defaultDelay : std::chrono::milliseconds{ delayCentiseconds * 10 };
+  }
+}
+
+// returns false when there are no more loops to play
+bool
+GifDecoder::startNextLoop()
+{
+  if( framesThisLoop == 0 )
+    throw ErrorString( "gif: no frames" );
+
+  if( !loopCount || ( *loopCount != 0 && loopsDone >= *loopCount ))
+    return false;
+
+  ++loopsDone;
+  framesThisLoop = 0;
+  pos = firstBlockPos;
+
+  // every loop starts from a clear canvas
+  std::fill( canvas.begin(), canvas.end(), 0 );
+  previous.clear();
+  disposal = 0;
+  return true;
+}
+
+void
+GifDecoder::dispose()
+{
+  if( disposal != restoreToBackground && disposal != restoreToPrevious )
+    return;
+
+  // browsers restore to transparent rather than to the background color
+  const int x0 = std::clamp( disposalRect.left, 0, width ), x1 = std::clamp( disposalRect.left + disposalRect.width, 0, width );
+  const int y0 = std::clamp( disposalRect.top, 0, height ), y1 = std::clamp( disposalRect.top + disposalRect.height, 0, height );
+  const std::size_t offset = (std::size_t)x0 * 4, nBytes = (std::size_t)( x1 - x0 ) * 4;
+
+  for( int y = y0; y < y1; ++y )
+  {
+    unsigned char *row = canvas.data() + (std::size_t)y * width * 4 + offset;
+    if( disposal == restoreToPrevious && !previous.empty())
+      std::memcpy( row, previous.data() + (std::size_t)y * width * 4 + offset, nBytes );
+    else
+      std::memset( row, 0, nBytes );
+  }
+
+  previous.clear();
+  disposal = 0;
+}
+
+// LZW with variable-length codes, read least significant bit first from the frame's data sub-blocks;
+// only the first nIndices are kept
+void
+GifDecoder::decodeIndices( int minCodeSize, std::size_t nIndices )
+{
+  if( minCodeSize < 1 || minCodeSize >= maxCodeBits )
+    throw ErrorString( "gif: invalid LZW code size ", minCodeSize );
+
+  Reader reader{ bytes, pos };
+
+  // each code is a string: the one of its prefix code, then its suffix
+  uint16_t prefixes[ 1 << maxCodeBits ];
+  uint8_t suffixes[ 1 << maxCodeBits ], firsts[ 1 << maxCodeBits ];
+  uint8_t string[ 1 << maxCodeBits ];
+
+  const int clearCode = 1 << minCodeSize, endCode = clearCode + 1;
+  for( int code = 0; code < clearCode; ++code )
+  {
+    suffixes[ code ] = firsts[ code ] = (uint8_t)code;
+    prefixes[ code ] = 0;
+  }
+
+  indices.assign( nIndices, 0 );
+  std::size_t nDecoded = 0;
+
+  int codeBits = minCodeSize + 1, nextCode = clearCode + 2, previousCode = -1;
+  uint32_t bitBuffer = 0;
+  int nBits = 0;
+  std::size_t blockRemaining = 0;
+  bool ended = false, terminated = false;
+
+  while( !ended )
+  {
+    // fill up with whole bytes from the sub-blocks; an empty sub-block ends the data
+    while( nBits < codeBits && !terminated )
+    {
+      if( blockRemaining == 0 && ( blockRemaining = reader.u8()) == 0 )
+      {
+        terminated = true;
+        break;
+      }
+
+      bitBuffer |= (uint32_t)reader.u8() << nBits;
+      nBits += 8;
+      --blockRemaining;
+    }
+    if( nBits < codeBits )
+      break;
+
+    const int code = (int)( bitBuffer & (( 1u << codeBits ) - 1 ));
+    bitBuffer >>= codeBits;
+    nBits -= codeBits;
+
+    if( code == clearCode )
+    {
+      codeBits = minCodeSize + 1;
+      nextCode = clearCode + 2;
+      previousCode = -1;
+      continue;
+    }
+    if( code == endCode )
+    {
+      ended = true;
+      continue;
+    }
+    if( code > nextCode || ( previousCode < 0 && code >= clearCode ))
+      throw ErrorString( "gif: invalid LZW code ", code );
+
+    // the code just being made is the previous string and its own first index
+    if( previousCode >= 0 && nextCode < ( 1 << maxCodeBits ))
+    {
+      prefixes[ nextCode ] = (uint16_t)previousCode;
+      firsts[ nextCode ] = firsts[ previousCode ];
+      suffixes[ nextCode ] = firsts[ code == nextCode ? previousCode : code ];
+      if( ++nextCode == ( 1 << codeBits ) && codeBits < maxCodeBits )
+        ++codeBits;
+    }
+
+    // the string comes out last index first
+    int length = 0;
+    for( int c = code; ; c = prefixes[ c ] )
+    {
+      string[ length++ ] = suffixes[ c ];
+      if( c < clearCode )
+        break;
+    }
+
+    for( std::size_t i = 0, n = std::min( (std::size_t)length, nIndices - nDecoded ); i < n; ++i )
+      indices[ nDecoded++ ] = string[ length - 1 - i ];
+
+    previousCode = code;
+  }
+
+  // whatever follows the end code is skipped; indices missing from a frame cut short stay 0
+  if( !terminated )
+  {
+    reader.take( blockRemaining );
+    reader.skipSubBlocks();
+  }
+}
+
+void
+GifDecoder::drawFrame( const FrameRect &rect, std::span< const unsigned char > colorTable, bool interlaced, int transparentIndex )
+{
+  const std::size_t nColors = colorTable.size() / 3;
+
+  for( int row = 0; row < rect.height; ++row )
+  {
+    const int y = rect.top + ( interlaced ? deinterlaceRow( row, rect.height ) : row );
+    if( y >= height )
+      continue;
+
+    const uint8_t *in = indices.data() + (std::size_t)row * rect.width;
+    unsigned char *out = canvas.data() + ( (std::size_t)y * width + rect.left ) * 4;
+    for( int x = 0, n = std::min( rect.width, width - rect.left ); x < n; ++x, out += 4 )
+    {
+      const uint8_t index = in[ x ];
+      if( index == transparentIndex )
+        continue;
+
+      // an index past the end of the table is black, as in browsers
+      const unsigned char *color = index < nColors ? colorTable.data() + index * 3 : nullptr;
+      out[ 0 ] = color ? color[ 0 ] : 0;
+      out[ 1 ] = color ? color[ 1 ] : 0;
+      out[ 2 ] = color ? color[ 2 ] : 0;
+      out[ 3 ] = 255;
+    }
+  }
+}
+
+//==============================================================================
+
+bool
+isAnimatedGif( std::span< const unsigned char > bytes )
+{
+  try
+  {
+    std::size_t pos = 0;
+    Reader reader{ bytes, pos };
+    int width, height;
+    std::span< const unsigned char > globalColorTable;
+    readHeader( reader, width, height, globalColorTable );
+
+    for( int nFrames = 0; pos < bytes.size(); )
+    {
+      const uint8_t block = reader.u8();
+      if( block == extensionIntroducer )
+      {
+        reader.u8();
+        reader.skipSubBlocks();
+      }
+      else if( block == imageSeparator )
+      {
+        reader.take( 8 );
+        reader.colorTable( reader.u8());
+        reader.u8();
+        reader.skipSubBlocks();
+        if( ++nFrames == 2 )
+          return true;
+      }
+      else
+        return false;
+    }
+  }
+  catch( const ErrorString & )
+  {
+    // not a GIF, or corrupt before a second frame: shown as a still image, if at all
+  }
+  return false;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "ImageDimensions.hpp"
+#include "NoCopy.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Decodes a GIF's frames one at a time, in order, each drawn over the ones before it as their disposal methods say,
+// so however many frames there are only the full-size canvas (and for "restore to previous", one copy of it) is held.
+// After the last frame it starts over from the first, as many times as the file's loop count says (forever for 0;
+// once through when there's no loop count at all, as browsers do).
+// Frames come out as 8 bit RGBA, already premultiplied: GIF pixels are either opaque or fully transparent.
+
+class GifDecoder : NoCopy
+{
+public:
+  // bytes must outlive the decoder
+  explicit
+  GifDecoder( std::span< const unsigned char > bytes )
+  noexcept( false ); // throws ErrorString if it isn't a GIF
+
+  // the canvas: 4 channels of uint8
+  ImageDimensions getDimensions() const { return { width, height, 4, ChannelType::uint8 }; }
+
+  // Draws the next frame and copies the canvas to rgba (width * height * 4 bytes), returning how long it's shown for;
+  // nullopt once the last loop is done.
+  std::optional< std::chrono::milliseconds >
+  decodeNextFrame( unsigned char *rgba )
+  noexcept( false ); // throws ErrorString if the file is corrupt
+
+private:
+  struct FrameRect
+  {
+    int left, top, width, height;
+  };
+
+  std::span< const unsigned char > bytes;
+  std::size_t pos{}, firstBlockPos{};
+  int width{}, height{};
+  std::span< const unsigned char > globalColorTable;
+
+  // from the NETSCAPE2.0 extension: 0 is forever
+  std::optional< int > loopCount;
+  int loopsDone{}, framesThisLoop{};
+
+  std::vector< unsigned char > canvas, previous; // RGBA; previous only while a frame is to be restored
+  std::vector< uint8_t > indices; // of the frame being decoded
+
+  // the last frame's, applied before the next one is drawn
+  int disposal{};
+  FrameRect disposalRect{};
+
+  bool startNextLoop();
+  void dispose();
+  void decodeIndices( int minCodeSize, std::size_t nIndices );
+  void drawFrame( const FrameRect &, std::span< const unsigned char > colorTable, bool interlaced, int transparentIndex );
+};
+
+// true for a GIF with more than one frame; only skims the file, without decoding any of them
+bool
+isAnimatedGif( std::span< const unsigned char > bytes );
@@ -0,0 +1,212 @@
+#include "Destroyer.hpp"
+#include "GlRenderer_AnimatedImageRenderer.hpp"
+#include "TextureUploadRing.hpp"
+#include "getShaderProgram.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+
+namespace
+{
+  constexpr const char *vertShaderName = "texture.vert";
+  constexpr const char *fragShaderName = "animation.frag";
+  constexpr const char *toneMappingDefines = "#define TONE_MAPPING\n"; // see animation.frag
+
+  // how often to look for newly decoded frames while there's a free layer for them
+  constexpr std::chrono::milliseconds pollInterval{ 10 };
+
+  constexpr int maxLayers = 4;
+
+  struct GlRenderer : public IGlRenderer
+  {
+    GLuint emptyVertexArray{};
+    Destroyer _emptyVertexArray;
+
+    GLuint texture{};
+    Destroyer _texture;
+
+    struct Program
+    {
+      GLuint name{}; // shared by every renderer, see getShaderProgram.hpp
+      GLint layerUniform{}, uvRectUniform{};
+      GLint exposureUniform{}; // only in the tone mapping variant
+    };
+
+    // the variant with tone mapping is only made (and used) for a changed exposure
+    Program program, toneMappingProgram;
+    View view;
+    Tone tone;
+
+    std::unique_ptr< AnimatedImage > animation;
+    const ImageDimensions dimensions;
+    const int nLayers;
+    TextureUploadRing uploadRing;
+
+    // layers uploaded but not shown yet, in order
+    struct Uploaded
+    {
+      int layer;
+      std::chrono::milliseconds delay;
+    };
+
+    std::deque< Uploaded > uploaded;
+    int nextLayer{};
+    std::optional< int > shownLayer;
+    std::chrono::steady_clock::time_point shownUntil;
+
+    void makeEmptyVertexArray()
+    {
+      // no vertex attributes: the vertices are generated in the vert shader, but core profile still wants a vertex array
+      glGenVertexArrays( 1, &emptyVertexArray );
+      _emptyVertexArray = Destroyer{ [ this ] { glDeleteVertexArrays( 1, &this->emptyVertexArray ); }};
+    }
+
+    static Program makeShaderProgram( const char *defines )
+    noexcept( false )
+    {
+      Program p{ getShaderProgram( vertShaderName, fragShaderName, defines ) };
+
+      p.layerUniform = glGetUniformLocation( p.name, "layer" );
+      p.uvRectUniform = glGetUniformLocation( p.name, "uvRect" );
+      p.exposureUniform = glGetUniformLocation( p.name, "exposure" );
+      return p;
+    }
+
+    const Program &useShaderProgram()
+    noexcept( false )
+    {
+      const bool toneMapping = tone.exposureStops != 0;
+      if( toneMapping && !toneMappingProgram.name )
+        toneMappingProgram = makeShaderProgram( toneMappingDefines );
+
+      const Program &p = toneMapping ? toneMappingProgram : program;
+      glUseProgram( p.name );
+      return p;
+    }
+
+    // one layer per frame in the ring; no mipmaps, which glGenerateMipmap would make for every layer at each frame
+    void makeTexture()
+    {
+      glGenTextures( 1, &texture );
+      _texture = Destroyer{ [ this ] { glDeleteTextures( 1, &this->texture ); }};
+
+      glBindTexture( GL_TEXTURE_2D_ARRAY, texture );
+      glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, dimensions.width, dimensions.height, nLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+      glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0 );
+      glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+      glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+      glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+      glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    }
+
+    // into every layer that's neither shown nor waiting to be
+    void uploadDecodedFrames()
+    {
+      while( (int)uploaded.size() + shownLayer.has_value() < nLayers )
+      {
+        std::optional< AnimatedImage::Frame > frame = animation->takeFrame();
+        if( !frame )
+          return;
+
+        TraceScope trace{ "upload frame" };
+        glBindTexture( GL_TEXTURE_2D_ARRAY, texture );
+        uploadRing.uploadLayer(
+            GL_TEXTURE_2D_ARRAY, 0, nextLayer,
+            0, dimensions.width, dimensions.height,
+            GL_RGBA, GL_UNSIGNED_BYTE,
+            frame->pixels.data(), (std::size_t)dimensions.width * 4 );
+
+        uploaded.push_back( { nextLayer, frame->delay } );
+        nextLayer = ( nextLayer + 1 ) % nLayers;
+        animation->giveBack( std::move( *frame ));
+      }
+    }
+
+    // returns true if another frame is shown
+    bool showNextFrame()
+    {
+      const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if( uploaded.empty() || ( shownLayer && now < shownUntil ))
+        return false;
+
+      // on time, the next frame's time starts when this one's was due; late, from now
+      const std::chrono::steady_clock::time_point shownFrom = shownLayer && now - shownUntil < uploaded.front().delay ? shownUntil : now;
+      shownLayer = uploaded.front().layer;
+      shownUntil = shownFrom + uploaded.front().delay;
+      uploaded.pop_front();
+      return true;
+    }
+
+    GlRenderer( std::unique_ptr< AnimatedImage > animation, std::size_t textureBudgetBytes )
+    noexcept( false )
+      : animation{ std::move( animation ) }
+      , dimensions{ this->animation->getDimensions() }
+      , nLayers{ (int)std::clamp< std::size_t >( textureBudgetBytes / ( (std::size_t)dimensions.width * dimensions.height * 4 ), 2, maxLayers ) }
+    {
+      makeTexture();
+      program = makeShaderProgram( "" );
+      makeEmptyVertexArray();
+    }
+
+    std::optional< std::chrono::steady_clock::time_point >
+    getNextUpdateTime() override
+    {
+      const std::chrono::steady_clock::time_point polled = std::chrono::steady_clock::now() + pollInterval;
+      const bool moreToUpload = !animation->isFinished() && (int)uploaded.size() + shownLayer.has_value() < nLayers;
+
+      if( uploaded.empty())
+        return moreToUpload ? std::optional{ polled } : std::nullopt;
+
+      return moreToUpload ? std::min( shownUntil, polled ) : shownUntil;
+    }
+
+    bool update() override
+    {
+      uploadDecodedFrames();
+      return showNextFrame();
+    }
+
+    void setView( const View &view ) override
+    {
+      this->view = view;
+    }
+
+    void setTone( const Tone &tone ) override
+    {
+      this->tone = tone;
+    }
+
+    void render() override
+    {
+      glClearColor( 0, 0, 0, 0 );
+      glClear( GL_COLOR_BUFFER_BIT );
+
+      // the first frame isn't decoded yet
+      if( !shownLayer )
+        return;
+
+      const Program &p = useShaderProgram();
+      glUniform1f( p.layerUniform, (float)*shownLayer );
+      glUniform4f( p.uvRectUniform, (float)view.left, (float)view.top, (float)view.right, (float)view.bottom );
+      glUniform1f( p.exposureUniform, (float)std::exp2( tone.exposureStops ));
+      glBindTexture( GL_TEXTURE_2D_ARRAY, texture );
+      glBindVertexArray( emptyVertexArray );
+      glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+    }
+  };
+} // namespace
+
+std::unique_ptr< IGlRenderer >
+makeGlRenderer_AnimatedImageRenderer( std::unique_ptr< AnimatedImage > animation, std::size_t textureBudgetBytes )
+{
+  return std::make_unique< GlRenderer >( std::move( animation ), textureBudgetBytes );
+}
+
+void
+prepareGlRenderer_AnimatedImageRenderer()
+{
+  getShaderProgram( vertShaderName, fragShaderName );
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "AnimatedImage.hpp"
+#include "IGlRenderer.hpp"
+
+#include <cstddef>
+#include <memory>
+
+// Plays an animation: its frames are uploaded as soon as they are decoded into the layers of a 2D array texture,
+// a ring of up to 4 of them (as many as fit in textureBudgetBytes, at least 2), so the next frame is already there
+// when it's due. The render thread switches to it when the frame shown has had its time. A frame decoded late is
+// shown as soon as it's there, and the ones after it are timed from then on rather than skipped to catch up.
+// The last loop's last frame stays.
+
+std::unique_ptr< IGlRenderer >
+makeGlRenderer_AnimatedImageRenderer( std::unique_ptr< AnimatedImage >, std::size_t textureBudgetBytes )
+noexcept( false ); // may throw std::exception
+
+// makes what every such renderer shares, in the current GL context, ahead of the first one
+void
+prepareGlRenderer_AnimatedImageRenderer()
+noexcept( false ); // may throw std::exception
@@ -1,13 +1,29 @@
 #include "Destroyer.hpp"
 #include "ErrorString.hpp"
 #include "GlRenderer_ImageRenderer.hpp"
-#include "makeShader.hpp"
-#include "readFile.hpp"
+#include "PreviewCache.hpp"
+#include "TextureUploadRing.hpp"
+#include "getGlTextureFormat.hpp"
+#include "getShaderProgram.hpp"
+#include "trace.hpp"
+#include "verboseLog.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 
 namespace
 {
-  constexpr const char *vertShaderFilename = "../shaders/texture.vert";
-  constexpr const char *fragShaderFilename = "../shaders/texture.frag";
+  constexpr const char *vertShaderName = "texture.vert";
+  constexpr const char *fragShaderName = "texture.frag";
+  constexpr const char *toneMappingDefines = "#define TONE_MAPPING\n"; // see texture.frag
+
+  // how often to look for newly decoded rows while the image is still loading
+  constexpr std::chrono::milliseconds loadingPollInterval{ 10 };
+
+  // plenty for an image shown fit to the window, where minification is (nearly) the same along both axes
+  constexpr GLfloat maxAnisotropy = 8;
 
   struct GlRenderer : public IGlRenderer
   {
@@ -17,14 +33,37 @@ namespace
     GLuint texture{};
     Destroyer _texture;
 
-    GLuint vertShader{};
-    Destroyer _vertShader;
+    struct Program
+    {
+      GLuint name{}; // shared by every renderer, see getShaderProgram.hpp
+      GLint loadedFractionUniform{}, hasPreviewUniform{}, uvRectUniform{};
+      GLint exposureUniform{}, isLinearUniform{}, toneMapUniform{}; // only in the tone mapping variant
+    };
+
+    // the variant with tone mapping is only made (and used) for HDR images and a changed exposure
+    Program program, toneMappingProgram;
+    View view;
+    Tone tone;
+
+    // only until all of the image's rows have been uploaded
+    GLuint previewTexture{};
+    Destroyer _previewTexture;
+    int previewRows{}; // uploaded to it
 
-    GLuint fragShader{};
-    Destroyer _fragShader;
+    // the texture goes back there once it's complete and not shown any more
+    TextureCache &textureCache;
+    const std::optional< TextureCache::Key > textureKey;
 
-    GLuint shaderProgram{};
-    Destroyer _shaderProgram;
+    // only until all of its rows have been uploaded
+    std::shared_ptr< ProgressiveImage > loadingImage;
+    std::optional< TextureUploadRing > uploadRing;
+    ImageDimensions dimensions;
+    GlTextureFormat textureFormat;
+    int uploadedRows{};
+
+    // only when verbose: times glGenerateMipmap on the GPU, until the result has been logged
+    GLuint mipmapQuery{};
+    Destroyer _mipmapQuery;
 
     void makeEmptyVertexArray()
     {
@@ -34,79 +73,337 @@ namespace
       _emptyVertexArray = Destroyer{ [ this ] { glDeleteVertexArrays( 1, &this->emptyVertexArray ); }};
     }
 
-    void makeShaderProgram()
+    static Program makeShaderProgram( const char *defines )
     noexcept( false )
     {
-      vertShader = makeShader( readFile( vertShaderFilename ), GL_VERTEX_SHADER );
-      _vertShader = Destroyer{ [ this ] { glDeleteShader( this->vertShader ); }};
+      Program p{ getShaderProgram( vertShaderName, fragShaderName, defines ) };
 
-      fragShader = makeShader( readFile( fragShaderFilename ), GL_FRAGMENT_SHADER );
-      _fragShader = Destroyer{ [ this ] { glDeleteShader( this->fragShader ); }};
+      p.loadedFractionUniform = glGetUniformLocation( p.name, "loadedFraction" );
+      p.hasPreviewUniform = glGetUniformLocation( p.name, "hasPreview" );
+      p.uvRectUniform = glGetUniformLocation( p.name, "uvRect" );
+      p.exposureUniform = glGetUniformLocation( p.name, "exposure" );
+      p.isLinearUniform = glGetUniformLocation( p.name, "isLinear" );
+      p.toneMapUniform = glGetUniformLocation( p.name, "toneMap" );
 
-      shaderProgram = glCreateProgram();
-      _shaderProgram = Destroyer{ [ this ] { glDeleteProgram( this->shaderProgram ); }};
-      glAttachShader( shaderProgram, vertShader );
-      glAttachShader( shaderProgram, fragShader );
-      glLinkProgram( shaderProgram );
-      if( GLint linkStatus; glGetProgramiv( shaderProgram, GL_LINK_STATUS, &linkStatus ), linkStatus == GL_FALSE )
-        throw ErrorString( __FUNCTION__, " error: glLinkProgram(..) failed!" );
+      glUseProgram( p.name );
+      glUniform1i( glGetUniformLocation( p.name, "theTexture" ), 0 );
+      glUniform1i( glGetUniformLocation( p.name, "previewTexture" ), 1 );
+      return p;
     }
 
-    void makeTextureFromImage( std::unique_ptr< IRawImage > rawImage )
+    const Program &useShaderProgram()
+    noexcept( false )
+    {
+      const bool toneMapping = dimensions.channelType == ChannelType::float16 || tone.exposureStops != 0;
+      if( toneMapping && !toneMappingProgram.name )
+        toneMappingProgram = makeShaderProgram( toneMappingDefines );
+
+      const Program &p = toneMapping ? toneMappingProgram : program;
+      glUseProgram( p.name );
+      return p;
+    }
+
+    // on the first rows: with the full decode deferred, only the preview may ever be shown
+    void makeTexture()
     {
       glGenTextures( 1, &texture );
       glBindTexture( GL_TEXTURE_2D, texture );
       {
-        const ImageDimensions dimensions = rawImage->getDimensions();
-        const GLenum formatByNumChannels[4]{ GL_RED, GL_RG, GL_RGB, GL_RGBA };
-        GLenum format = formatByNumChannels[ dimensions.nChannels - 1 ];
+        // storage only, for all the mip levels: the rows are uploaded as they are decoded, see uploadNewRows(),
+        // and generateMipmaps() fills in the rest
+        allocateTextureStorage( textureFormat, dimensions.width, dimensions.height, getNumMipmapLevels( dimensions.width, dimensions.height ));
 
-        // odd-width RGB source images are misaligned byte-wise without these next four lines
-        // thanks: https://stackoverflow.com/a/7381121
-        glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
-        glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
-        glPixelStorei( GL_UNPACK_SKIP_PIXELS, 0 );
-        glPixelStorei( GL_UNPACK_SKIP_ROWS, 0 );
+        setGreySwizzle( dimensions.nChannels );
 
-        glTexImage2D(
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+      }
+      // by value: the texture may outlive this renderer, in the TextureCache
+      _texture = Destroyer{ [ name = texture ] { glDeleteTextures( 1, &name ); }};
+    }
+
+    // small enough to upload straight away; it's magnified to the image's size
+    void makePreviewTexture( const ImagePreview &preview )
+    {
+      TraceScope trace{ "upload preview" };
+
+      glGenTextures( 1, &previewTexture );
+      _previewTexture = Destroyer{ [ this ] { glDeleteTextures( 1, &this->previewTexture ); }};
+
+      const GlTextureFormat previewFormat = getGlTextureFormat( preview.dimensions );
+      glBindTexture( GL_TEXTURE_2D, previewTexture );
+      glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+      glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+      allocateTextureStorage( previewFormat, preview.dimensions.width, preview.dimensions.height, 1 );
+
+      // a streamed preview's rows still to come are transparent meanwhile, not whatever the new storage held
+      if( preview.getReadyRows() < preview.dimensions.height )
+      {
+        const std::vector< unsigned char > zeros( (std::size_t)preview.dimensions.width * preview.dimensions.height * preview.dimensions.nChannels );
+        glTexSubImage2D(
             GL_TEXTURE_2D, 0,
-            GL_RGBA, dimensions.width, dimensions.height,
-            0,
-            format, GL_UNSIGNED_BYTE, rawImage->getPixels());
+            0, 0, preview.dimensions.width, preview.dimensions.height,
+            previewFormat.format, previewFormat.type, zeros.data());
+      }
 
-        if( dimensions.nChannels == 1 || dimensions.nChannels == 2 )
-        {
-          GLint swizzleMask[2][4]{
-              { GL_RED, GL_RED, GL_RED, GL_ONE },
-              { GL_RED, GL_RED, GL_RED, GL_GREEN }};
+      setGreySwizzle( preview.dimensions.nChannels );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
 
-          glTexParameteriv( GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzleMask[ dimensions.nChannels - 1 ] );
-        }
+      uploadPreviewRows( preview );
+    }
 
-        rawImage.reset();
+    // all of them at once, but for a big PNG's preview which is still being streamed (see ImagePreview::getReadyRows());
+    // returns true if any rows were uploaded
+    bool uploadPreviewRows( const ImagePreview &preview )
+    {
+      const int readyRows = preview.getReadyRows();
+      if( readyRows == previewRows )
+        return false;
 
-        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
-        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+      const GlTextureFormat previewFormat = getGlTextureFormat( preview.dimensions );
+      const std::size_t rowBytes = (std::size_t)preview.dimensions.width * preview.dimensions.nChannels;
+      glBindTexture( GL_TEXTURE_2D, previewTexture );
+      glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+      glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+      glTexSubImage2D(
+          GL_TEXTURE_2D, 0,
+          0, previewRows, preview.dimensions.width, readyRows - previewRows,
+          previewFormat.format, previewFormat.type, preview.pixels + previewRows * rowBytes );
+
+      previewRows = readyRows;
+      return true;
+    }
+
+    bool isPreviewStreaming() const
+    {
+      return previewTexture && previewRows < loadingImage->getPreview()->dimensions.height;
+    }
+
+    // returns true if any rows were uploaded
+    bool uploadNewRows()
+    {
+      bool uploaded = false;
+
+      if( texture )
+        glBindTexture( GL_TEXTURE_2D, texture );
+
+      while( const std::optional< ProgressiveImage::Band > band = loadingImage->takeBand())
+      {
+        if( !texture )
+          makeTexture();
+
+        TraceScope trace{ "upload rows" };
+        // odd-width RGB source images are misaligned byte-wise without GL_UNPACK_ALIGNMENT 1, which the ring sets
+        // thanks: https://stackoverflow.com/a/7381121
+        uploadRing->upload(
+            GL_TEXTURE_2D, 0,
+            band->firstRow, dimensions.width, band->nRows,
+            textureFormat.format, textureFormat.type,
+            loadingImage->getPixels() + band->firstRow * loadingImage->getRowBytes(), loadingImage->getRowBytes());
+
+        uploadedRows = band->firstRow + band->nRows;
+        uploaded = true;
+      }
+
+      if( loadingImage->isComplete())
+      {
+        loadingImage.reset();
+        uploadRing.reset();
+        _previewTexture = Destroyer{};
+        previewTexture = 0;
+        generateMipmaps();
+      }
+
+      return uploaded;
+    }
+
+    // Once every row is there (until then only the base level is sampled): without mipmaps, an image shrunk to fit
+    // the window is sampled at a few texels per pixel and aliases badly. glGenerateMipmap filters on the GPU
+    // in a fraction of the time a CPU filter would take just to upload its extra third of texels.
+    void generateMipmaps()
+    {
+      TraceScope trace{ "glGenerateMipmap" };
+
+      if( isVerbose())
+      {
+        glGenQueries( 1, &mipmapQuery );
+        _mipmapQuery = Destroyer{ [ this ] { glDeleteQueries( 1, &this->mipmapQuery ); }};
+        glBeginQuery( GL_TIME_ELAPSED, mipmapQuery );
+      }
+
+      glBindTexture( GL_TEXTURE_2D, texture );
+      glGenerateMipmap( GL_TEXTURE_2D );
+
+      if( mipmapQuery )
+        glEndQuery( GL_TIME_ELAPSED );
+
+      // trilinear, and anisotropic where available for when the window's aspect ratio doesn't quite match the image's
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+      if( GLEW_EXT_texture_filter_anisotropic )
+      {
+        GLfloat supported = 1;
+        glGetFloatv( GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &supported );
+        glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min( supported, maxAnisotropy ));
       }
-      _texture = Destroyer{ [ this ] { glDeleteTextures( 1, &this->texture ); }};
     }
 
-    explicit
-    GlRenderer( std::unique_ptr< IRawImage > rawImage )
+    // all mip levels
+    std::size_t getTextureBytes() const
+    {
+      std::size_t bytes = 0;
+      for( int w = dimensions.width, h = dimensions.height; ; w = std::max( 1, w / 2 ), h = std::max( 1, h / 2 ))
+      {
+        bytes += (std::size_t)w * h * textureFormat.texelBytes;
+        if( w == 1 && h == 1 )
+          return bytes;
+      }
+    }
+
+    // returns false while the query is still pending
+    bool logMipmapBuildTime()
+    {
+      if( GLint available = GL_FALSE; glGetQueryObjectiv( mipmapQuery, GL_QUERY_RESULT_AVAILABLE, &available ), !available )
+        return false;
+
+      GLuint64 nanoseconds = 0;
+      glGetQueryObjectui64v( mipmapQuery, GL_QUERY_RESULT, &nanoseconds );
+
+      const std::size_t baseBytes = (std::size_t)dimensions.width * dimensions.height * textureFormat.texelBytes;
+      const std::size_t mipBytes = getTextureBytes() - baseBytes;
+
+      verboseLog(
+          "mipmaps: ", dimensions.width, "x", dimensions.height, " ", textureFormat.name, ", ",
+          getNumMipmapLevels( dimensions.width, dimensions.height ), " levels, +",
+          mipBytes >> 20, " MiB over the base level's ", baseBytes >> 20, " MiB, generated in ",
+          nanoseconds / 1e6, " ms on the GPU" );
+
+      _mipmapQuery = Destroyer{};
+      mipmapQuery = 0;
+      return true;
+    }
+
+    // a cached texture is already complete, mipmaps and all: the image isn't needed at all then
+    bool takeCachedTexture()
+    {
+      if( !textureKey )
+        return false;
+
+      std::optional< TextureCache::Texture > cached = textureCache.take( *textureKey );
+      if( !cached )
+        return false;
+
+      texture = cached->name;
+      _texture = std::move( cached->_name );
+      uploadedRows = dimensions.height;
+      loadingImage.reset();
+      return true;
+    }
+
+    GlRenderer( std::shared_ptr< ProgressiveImage > image, TextureCache &textureCache, std::optional< TextureCache::Key > textureKey )
     noexcept( false )
+      : textureCache{ textureCache }
+      , textureKey{ std::move( textureKey ) }
+      , loadingImage{ std::move( image ) }
+      , dimensions{ loadingImage->getDimensions() }
+      , textureFormat{ getGlTextureFormat( dimensions ) }
     {
-      makeTextureFromImage( std::move( rawImage ));
-      makeShaderProgram();
+      if( !takeCachedTexture())
+      {
+        if( const std::shared_ptr< const ImagePreview > &preview = loadingImage->getPreview())
+          makePreviewTexture( *preview );
+
+        loadingImage->rewind();
+        uploadRing.emplace();
+        uploadNewRows();
+      }
+
+      program = makeShaderProgram( "" );
       makeEmptyVertexArray();
     }
 
-    ~GlRenderer() override = default;
+    ~GlRenderer() override
+    {
+      // a texture still missing rows would have to be finished by someone holding the image: not worth caching
+      if( textureKey && texture && !loadingImage )
+        textureCache.put( *textureKey, TextureCache::Texture{ texture, std::move( _texture ), dimensions, getTextureBytes() } );
+    }
+
+    std::optional< std::chrono::steady_clock::time_point >
+    getNextUpdateTime() override
+    {
+      // no rows are coming while the full decode is deferred, nor after it has failed
+      if(( loadingImage && loadingImage->isFullResolutionRequested() && !loadingImage->isFailed()) || isPreviewStreaming()
+          || mipmapQuery )
+        return std::chrono::steady_clock::now() + loadingPollInterval;
+
+      return std::nullopt;
+    }
+
+    bool update() override
+    {
+      if( mipmapQuery )
+        logMipmapBuildTime();
+
+      // before the image's own rows, whose last ones free the preview
+      const bool previewChanged = isPreviewStreaming() && uploadPreviewRows( *loadingImage->getPreview());
+
+      // the last rows also bring the mipmaps, which can change every visible pixel
+      return ( loadingImage && uploadNewRows()) || previewChanged;
+    }
+
+    // the preview is only good until it's magnified
+    void requestFullResolutionIfNeeded()
+    {
+      if( !loadingImage || !previewTexture || loadingImage->isFullResolutionRequested())
+        return;
+
+      GLint viewport[ 4 ]{};
+      glGetIntegerv( GL_VIEWPORT, viewport );
+
+      // the viewport's size in preview pixels, were it showing all of the image
+      const double zoom = 1 / std::min( view.right - view.left, view.bottom - view.top );
+      const double width = viewport[ 2 ] * zoom, height = viewport[ 3 ] * zoom;
+
+      const ImageDimensions &preview = loadingImage->getPreview()->dimensions;
+      if( width > preview.width || height > preview.height )
+      {
+        verboseLog( "viewport ", viewport[ 2 ], "x", viewport[ 3 ], " at ", zoom, "x is bigger than the preview: decoding the full resolution" );
+        loadingImage->requestFullResolution();
+      }
+    }
+
+    void setView( const View &view ) override
+    {
+      this->view = view;
+    }
+
+    void setTone( const Tone &tone ) override
+    {
+      this->tone = tone;
+    }
 
     void render() override
     {
-      glUseProgram( shaderProgram );
+      requestFullResolutionIfNeeded();
+
+      const Program &p = useShaderProgram();
+      glUniform1f( p.loadedFractionUniform, (float)uploadedRows / (float)dimensions.height );
+      glUniform1i( p.hasPreviewUniform, previewTexture != 0 );
+      glUniform4f( p.uvRectUniform, (float)view.left, (float)view.top, (float)view.right, (float)view.bottom );
+      glUniform1f( p.exposureUniform, (float)std::exp2( tone.exposureStops ));
+      glUniform1i( p.isLinearUniform, dimensions.channelType == ChannelType::float16 );
+      glUniform1i( p.toneMapUniform, tone.toneMap );
+      if( previewTexture )
+      {
+        glActiveTexture( GL_TEXTURE1 );
+        glBindTexture( GL_TEXTURE_2D, previewTexture );
+        glActiveTexture( GL_TEXTURE0 );
+      }
       glBindTexture( GL_TEXTURE_2D, texture );
       glBindVertexArray( emptyVertexArray );
       glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
@@ -115,7 +412,16 @@ namespace
 } // namespace
 
 std::unique_ptr< IGlRenderer >
-makeGlRenderer_ImageRenderer( std::unique_ptr< IRawImage > rawImage )
+makeGlRenderer_ImageRenderer(
+    std::shared_ptr< ProgressiveImage > image,
+    TextureCache &textureCache,
+    std::optional< TextureCache::Key > textureKey )
+{
+  return std::make_unique< GlRenderer >( std::move( image ), textureCache, std::move( textureKey ));
+}
+
+void
+prepareGlRenderer_ImageRenderer()
 {
-  return std::make_unique< GlRenderer >( std::move( rawImage ));
+  getShaderProgram( vertShaderName, fragShaderName );
 }
@@ -2,10 +2,24 @@
 
 #include "IGlRenderer.hpp"
 #include "IGlWindowAppearance.hpp"
-#include "IRawImage.hpp"
+#include "ProgressiveImage.hpp"
+#include "TextureCache.hpp"
 
 #include <memory>
+#include <optional>
+
+// Rows of the image are uploaded and shown as they are published; the rest is transparent until then.
+// With a textureKey, the texture is taken from textureCache if it's there (and then the image isn't used),
+// and put back there once it's no longer shown.
 
 std::unique_ptr< IGlRenderer >
-makeGlRenderer_ImageRenderer( std::unique_ptr< IRawImage > )
+makeGlRenderer_ImageRenderer(
+    std::shared_ptr< ProgressiveImage >,
+    TextureCache &textureCache,
+    std::optional< TextureCache::Key > textureKey )
+noexcept( false ); // may throw std::exception
+
+// makes what every such renderer shares, in the current GL context, ahead of the first one
+void
+prepareGlRenderer_ImageRenderer()
 noexcept( false ); // may throw std::exception
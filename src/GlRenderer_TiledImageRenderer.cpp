@@ -0,0 +1,690 @@
+#include "Destroyer.hpp"
+#include "ErrorString.hpp"
+#include "GlRenderer_TiledImageRenderer.hpp"
+#include "PreviewCache.hpp"
+#include "TextureUploadRing.hpp"
+#include "compressBc1.hpp"
+#include "getGlTextureFormat.hpp"
+#include "getShaderProgram.hpp"
+#include "halfFloat.hpp"
+#include "trace.hpp"
+#include "verboseLog.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  constexpr const char *vertShaderName = "tile.vert";
+  constexpr const char *fragShaderName = "tile.frag";
+  constexpr const char *toneMappingDefines = "#define TONE_MAPPING\n"; // see tile.frag
+
+  // how often to look for newly decoded rows and finished tiles while there are any to come
+  constexpr std::chrono::milliseconds pollInterval{ 10 };
+
+  // image texels per tile side; each tile texture also has a one-texel border copied from its neighbours,
+  // so bilinear filtering doesn't show seams at tile edges
+  constexpr int tileSize = 510;
+  constexpr int tileTexels = tileSize + 2;
+
+  // plus a third for the tile's own mipmaps
+  std::size_t
+  tileBytes( int width, int height, const GlTextureFormat &format, bool compressed )
+  {
+    return ( compressed ? getBc1Bytes( width, height ) : (std::size_t)width * height * format.texelBytes ) * 4 / 3;
+  }
+
+  // width or height of the image at a mip level: level 0 is full resolution, each level halves it (rounding up)
+  int
+  levelLength( int length, int level )
+  {
+    return std::max( 1, ( length + ( 1 << level ) - 1 ) >> level );
+  }
+
+  int
+  nTiles( int levelLength )
+  {
+    return ( levelLength + tileSize - 1 ) / tileSize;
+  }
+
+//==============================================================================
+
+  struct TileKey
+  {
+    int level, x, y;
+
+    auto operator<=>( const TileKey & ) const = default;
+
+    TileKey parent() const { return { level + 1, x / 2, y / 2 }; }
+  };
+
+  struct TileTexels
+  {
+    int width, height; // including the border
+    std::vector< unsigned char > texels;
+    std::vector< std::vector< unsigned char >> compressedLevels; // instead of texels, when compressing: BC1 blocks per mip level
+  };
+
+  // the full-resolution rows a tile is built from must all be decoded first
+  int
+  lastSourceRow( const ImageDimensions &dimensions, TileKey key )
+  {
+    const int lastLevelRow = std::min( levelLength( dimensions.height, key.level ), ( key.y + 1 ) * tileSize + 1 );
+    return std::min( dimensions.height, lastLevelRow << key.level );
+  }
+
+  // how buildTile(..) averages each channel type: integers exactly, half floats as the light they stand for
+  template< typename T >
+  struct IntegerChannels
+  {
+    using Channel = T;
+    using Sum = uint64_t;
+
+    static Sum load( Channel c ) { return c; }
+    static Channel average( Sum sum, uint64_t n ) { return (Channel)(( sum + n / 2 ) / n ); }
+  };
+
+  struct HalfFloatChannels
+  {
+    using Channel = uint16_t;
+    using Sum = double;
+
+    static Sum load( Channel c ) { return halfToFloat( c ); }
+    static Channel average( Sum sum, uint64_t n ) { return floatToHalf( (float)( sum / (double)n )); }
+  };
+
+  // box-filters a tile (and its border) straight from the full-resolution pixels;
+  // each texel at level n averages a block of up to 2^n by 2^n pixels
+  template< typename Channels >
+  TileTexels
+  buildTile( const unsigned char *pixelBytes, ImageDimensions dimensions, TileKey key )
+  {
+    using Channel = typename Channels::Channel;
+    TraceScope trace{ "build tile" };
+
+    const int levelWidth = levelLength( dimensions.width, key.level );
+    const int levelHeight = levelLength( dimensions.height, key.level );
+    const int nChannels = dimensions.nChannels;
+    const std::size_t rowChannels = (std::size_t)dimensions.width * nChannels;
+    const Channel *pixels = reinterpret_cast< const Channel * >( pixelBytes );
+
+    TileTexels tile{
+        std::min( tileSize, levelWidth - key.x * tileSize ) + 2,
+        std::min( tileSize, levelHeight - key.y * tileSize ) + 2,
+        {}, {} };
+    tile.texels.resize( (std::size_t)tile.width * tile.height * dimensions.getPixelBytes());
+
+    Channel *out = reinterpret_cast< Channel * >( tile.texels.data());
+    for( int ty = 0; ty < tile.height; ++ty )
+    {
+      const int ly = std::clamp( key.y * tileSize - 1 + ty, 0, levelHeight - 1 );
+      const int sy0 = ly << key.level, sy1 = std::min( dimensions.height, ( ly + 1 ) << key.level );
+
+      for( int tx = 0; tx < tile.width; ++tx )
+      {
+        const int lx = std::clamp( key.x * tileSize - 1 + tx, 0, levelWidth - 1 );
+        const int sx0 = lx << key.level, sx1 = std::min( dimensions.width, ( lx + 1 ) << key.level );
+
+        typename Channels::Sum sums[ 4 ]{};
+        for( int sy = sy0; sy < sy1; ++sy )
+          for( const Channel *p = pixels + sy * rowChannels + (std::size_t)sx0 * nChannels,
+                   *end = p + (std::size_t)( sx1 - sx0 ) * nChannels; p != end; p += nChannels )
+            for( int c = 0; c < nChannels; ++c )
+              sums[ c ] += Channels::load( p[ c ] );
+
+        const uint64_t n = (uint64_t)( sx1 - sx0 ) * ( sy1 - sy0 );
+        for( int c = 0; c < nChannels; ++c )
+          *out++ = Channels::average( sums[ c ], n );
+      }
+    }
+
+    return tile;
+  }
+
+  TileTexels
+  buildTile( const unsigned char *pixels, ImageDimensions dimensions, TileKey key )
+  {
+    switch( dimensions.channelType )
+    {
+      case ChannelType::uint16:
+        return buildTile< IntegerChannels< uint16_t >>( pixels, dimensions, key );
+      case ChannelType::float16:
+        return buildTile< HalfFloatChannels >( pixels, dimensions, key );
+      default:
+        return buildTile< IntegerChannels< uint8_t >>( pixels, dimensions, key );
+    }
+  }
+
+  // Replaces an 8 bit tile's texels with BC1 blocks for each of its mip levels: compressed textures can't be
+  // given mipmaps by glGenerateMipmap, so each level is box-filtered from the one above here, on the same worker thread.
+  void
+  compressTile( TileTexels &tile, int nChannels )
+  {
+    TraceScope trace{ "compress tile" };
+
+    std::vector< unsigned char > level = std::move( tile.texels ), next;
+    for( int w = tile.width, h = tile.height; ; )
+    {
+      tile.compressedLevels.push_back( compressBc1( level.data(), w, h, nChannels, (std::size_t)w * nChannels ));
+      if( w == 1 && h == 1 )
+        break;
+
+      // as glGenerateMipmap would: half size rounding down, the last column or row of an odd size folded in
+      const int nextW = std::max( 1, w / 2 ), nextH = std::max( 1, h / 2 );
+      next.resize( (std::size_t)nextW * nextH * nChannels );
+      unsigned char *out = next.data();
+      for( int y = 0; y < nextH; ++y )
+        for( int x = 0; x < nextW; ++x )
+          for( int c = 0; c < nChannels; ++c )
+          {
+            const int x0 = std::min( 2 * x, w - 1 ), x1 = std::min( 2 * x + 1, w - 1 );
+            const int y0 = std::min( 2 * y, h - 1 ), y1 = std::min( 2 * y + 1, h - 1 );
+            auto at = [ & ]( int sx, int sy ) { return (unsigned)level[ ((std::size_t)sy * w + sx ) * nChannels + c ]; };
+            *out++ = (unsigned char)(( at( x0, y0 ) + at( x1, y0 ) + at( x0, y1 ) + at( x1, y1 ) + 2 ) / 4 );
+          }
+
+      std::swap( level, next );
+      w = nextW;
+      h = nextH;
+    }
+  }
+
+//==============================================================================
+
+  struct GlRenderer : public IGlRenderer
+  {
+    GLuint emptyVertexArray{};
+    Destroyer _emptyVertexArray;
+
+    struct Program
+    {
+      GLuint name{}; // shared by every renderer, see getShaderProgram.hpp
+      GLint positionRectUniform{}, uvRectUniform{};
+      GLint exposureUniform{}, isLinearUniform{}, toneMapUniform{}; // only in the tone mapping variant
+    };
+
+    // the variant with tone mapping is only made (and used) for HDR images and a changed exposure
+    Program program, toneMappingProgram;
+
+    std::shared_ptr< ProgressiveImage > image;
+    const ImageDimensions dimensions;
+    const GlTextureFormat textureFormat;
+    const bool compressed; // tiles are BC1, see compressTile(..)
+    const std::size_t maxTileBytes;
+    const std::size_t textureBudgetBytes;
+    const unsigned maxBuilding = std::max( 1u, std::thread::hardware_concurrency());
+    int topLevel{}; // the whole image fits in one tile
+    int decodedRows{};
+    bool loading = true;
+
+    View view;
+    Tone tone;
+
+    struct Tile
+    {
+      GLuint texture{};
+      Destroyer _texture;
+      int width{}, height{}; // including the border
+      uint64_t lastUsedFrame{};
+    };
+
+    std::map< TileKey, Tile > tiles;
+    std::size_t residentBytes{};
+    uint64_t frame{};
+
+    std::vector< TileKey > wanted; // by priority; neither resident nor building
+    std::map< TileKey, std::future< TileTexels >> building; // after image: must finish before the pixels go away
+    TextureUploadRing uploadRing;
+
+    // The image's preview, if it has one: while the full decode is deferred (see decodeImageFileToFit) it's shown
+    // instead of tiles for as long as it's fine enough for the view, so the full-size pixels needn't exist until then.
+    // After that it stands in under the tiles which aren't built yet.
+    GLuint previewTexture{};
+    Destroyer _previewTexture;
+    int previewLevel{}; // the finest level the preview is as fine as
+    int previewRows{}; // uploaded to it
+
+    void makeEmptyVertexArray()
+    {
+      // no vertex attributes: the vertices are generated in the vert shader, but core profile still wants a vertex array
+      glGenVertexArrays( 1, &emptyVertexArray );
+      _emptyVertexArray = Destroyer{ [ this ] { glDeleteVertexArrays( 1, &this->emptyVertexArray ); }};
+    }
+
+    static Program makeShaderProgram( const char *defines )
+    noexcept( false )
+    {
+      Program p{ getShaderProgram( vertShaderName, fragShaderName, defines ) };
+
+      p.positionRectUniform = glGetUniformLocation( p.name, "positionRect" );
+      p.uvRectUniform = glGetUniformLocation( p.name, "uvRect" );
+      p.exposureUniform = glGetUniformLocation( p.name, "exposure" );
+      p.isLinearUniform = glGetUniformLocation( p.name, "isLinear" );
+      p.toneMapUniform = glGetUniformLocation( p.name, "toneMap" );
+      return p;
+    }
+
+    const Program &useShaderProgram()
+    noexcept( false )
+    {
+      const bool toneMapping = dimensions.channelType == ChannelType::float16 || tone.exposureStops != 0;
+      if( toneMapping && !toneMappingProgram.name )
+        toneMappingProgram = makeShaderProgram( toneMappingDefines );
+
+      const Program &p = toneMapping ? toneMappingProgram : program;
+      glUseProgram( p.name );
+      return p;
+    }
+
+//------------------------------------------------------------------------------
+// choosing tiles
+
+    int tilesInView( int level, int *x0, int *y0, int *x1, int *y1 ) const
+    {
+      const double tilePixels = (double)( tileSize << level );
+      const int nx = nTiles( levelLength( dimensions.width, level ));
+      const int ny = nTiles( levelLength( dimensions.height, level ));
+
+      *x0 = std::clamp( (int)std::floor( view.left * dimensions.width / tilePixels ), 0, nx - 1 );
+      *x1 = std::clamp( (int)std::ceil( view.right * dimensions.width / tilePixels ), *x0 + 1, nx );
+      *y0 = std::clamp( (int)std::floor( view.top * dimensions.height / tilePixels ), 0, ny - 1 );
+      *y1 = std::clamp( (int)std::ceil( view.bottom * dimensions.height / tilePixels ), *y0 + 1, ny );
+
+      return ( *x1 - *x0 ) * ( *y1 - *y0 );
+    }
+
+    // the finest level with at most about two image pixels per screen pixel (the tiles' own mipmaps cover that),
+    // made coarser while its tiles in view wouldn't fit in the budget alongside the top tile
+    int chooseLevel( int viewportWidth, int viewportHeight ) const
+    {
+      const double imagePixelsPerScreenPixel = std::max(
+          ( view.right - view.left ) * dimensions.width / std::max( 1, viewportWidth ),
+          ( view.bottom - view.top ) * dimensions.height / std::max( 1, viewportHeight ));
+
+      int level = std::clamp( (int)std::floor( std::log2( std::max( 1.0, imagePixelsPerScreenPixel ))), 0, topLevel );
+
+      for( int x0, y0, x1, y1;
+           level < topLevel && ( tilesInView( level, &x0, &y0, &x1, &y1 ) + 1 ) * maxTileBytes > textureBudgetBytes; )
+        ++level;
+
+      return level;
+    }
+
+//------------------------------------------------------------------------------
+// building and evicting tiles
+
+    void takeBands()
+    {
+      while( const std::optional< ProgressiveImage::Band > band = image->takeBand())
+        decodedRows = band->firstRow + band->nRows;
+
+      loading = !image->isComplete() && !image->isFailed(); // after a failure, the rows taken are all there is
+    }
+
+    void startBuilds()
+    {
+      std::erase_if( wanted, [ this ]( const TileKey &key )
+      {
+        if( tiles.contains( key ) || building.contains( key ))
+          return true;
+
+        if( building.size() >= maxBuilding || lastSourceRow( dimensions, key ) > decodedRows )
+          return false;
+
+        building.emplace( key, std::async(
+            std::launch::async,
+            [ pixels = image->getPixels(), dimensions = dimensions, key, compressed = compressed ]
+            {
+              TileTexels tile = buildTile( pixels, dimensions, key );
+              if( compressed )
+                compressTile( tile, dimensions.nChannels );
+              return tile;
+            } ));
+        return true;
+      } );
+    }
+
+    // returns true if any tiles were finished
+    bool finishBuilds()
+    {
+      bool finished = false;
+
+      for( auto it = building.begin(); it != building.end(); )
+      {
+        if( it->second.wait_for( std::chrono::seconds{ 0 } ) != std::future_status::ready )
+        {
+          ++it;
+          continue;
+        }
+
+        const TileTexels built = it->second.get();
+
+        Tile tile{ .texture = 0, ._texture = {}, .width = built.width, .height = built.height, .lastUsedFrame = frame };
+        glGenTextures( 1, &tile.texture );
+        tile._texture = Destroyer{ [ texture = tile.texture ] { glDeleteTextures( 1, &texture ); }};
+
+        glBindTexture( GL_TEXTURE_2D, tile.texture );
+        TraceScope trace{ "upload tile" };
+
+        // levels are chosen for at most about 2:1 minification, which still aliases without mipmaps
+        if( compressed )
+          for( int level = 0; level < (int)built.compressedLevels.size(); ++level )
+            glCompressedTexImage2D(
+                GL_TEXTURE_2D, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+                std::max( 1, tile.width >> level ), std::max( 1, tile.height >> level ), 0,
+                (GLsizei)built.compressedLevels[ level ].size(), built.compressedLevels[ level ].data());
+        else
+        {
+          allocateTextureStorage( textureFormat, tile.width, tile.height, getNumMipmapLevels( tile.width, tile.height ));
+          uploadRing.upload(
+              GL_TEXTURE_2D, 0,
+              0, tile.width, tile.height,
+              textureFormat.format, textureFormat.type,
+              built.texels.data(), tile.width * dimensions.getPixelBytes());
+          glGenerateMipmap( GL_TEXTURE_2D );
+        }
+
+        setGreySwizzle( dimensions.nChannels );
+
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+
+        residentBytes += tileBytes( tile.width, tile.height, textureFormat, compressed );
+        tiles.emplace( it->first, std::move( tile ));
+        it = building.erase( it );
+        finished = true;
+      }
+
+      return finished;
+    }
+
+    // least recently used first, but never the top tile nor anything drawn in the last frame
+    void evict()
+    {
+      while( residentBytes > textureBudgetBytes )
+      {
+        auto oldest = tiles.end();
+        for( auto it = tiles.begin(); it != tiles.end(); ++it )
+          if( it->first.level != topLevel && it->second.lastUsedFrame < frame
+              && ( oldest == tiles.end() || it->second.lastUsedFrame < oldest->second.lastUsedFrame ))
+            oldest = it;
+
+        if( oldest == tiles.end())
+          return;
+
+        residentBytes -= tileBytes( oldest->second.width, oldest->second.height, textureFormat, compressed );
+        tiles.erase( oldest );
+      }
+    }
+
+//------------------------------------------------------------------------------
+// the preview
+
+    // small (about the window's size): uploaded straight away, with mipmaps for when the view is smaller still
+    void makePreviewTexture( const ImagePreview &preview )
+    {
+      TraceScope trace{ "upload preview" };
+
+      glGenTextures( 1, &previewTexture );
+      _previewTexture = Destroyer{ [ this ] { glDeleteTextures( 1, &this->previewTexture ); }};
+
+      const GlTextureFormat previewFormat = getGlTextureFormat( preview.dimensions );
+      glBindTexture( GL_TEXTURE_2D, previewTexture );
+      glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+      glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+      allocateTextureStorage(
+          previewFormat, preview.dimensions.width, preview.dimensions.height,
+          getNumMipmapLevels( preview.dimensions.width, preview.dimensions.height ));
+
+      // a streamed preview's rows still to come are transparent meanwhile, not whatever the new storage held
+      if( preview.getReadyRows() < preview.dimensions.height )
+      {
+        const std::vector< unsigned char > zeros( (std::size_t)preview.dimensions.width * preview.dimensions.height * preview.dimensions.nChannels );
+        glTexSubImage2D(
+            GL_TEXTURE_2D, 0,
+            0, 0, preview.dimensions.width, preview.dimensions.height,
+            previewFormat.format, previewFormat.type, zeros.data());
+      }
+
+      setGreySwizzle( preview.dimensions.nChannels );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+
+      while( levelLength( dimensions.width, previewLevel ) > preview.dimensions.width
+             || levelLength( dimensions.height, previewLevel ) > preview.dimensions.height )
+        ++previewLevel;
+
+      uploadPreviewRows( preview );
+    }
+
+    // all of them at once, but for a big PNG's preview which is still being streamed (see ImagePreview::getReadyRows());
+    // returns true if any rows were uploaded
+    bool uploadPreviewRows( const ImagePreview &preview )
+    {
+      const int readyRows = preview.getReadyRows();
+      if( readyRows == previewRows )
+        return false;
+
+      TraceScope trace{ "upload preview rows" };
+      const GlTextureFormat previewFormat = getGlTextureFormat( preview.dimensions );
+      const std::size_t rowBytes = (std::size_t)preview.dimensions.width * preview.dimensions.nChannels;
+      glBindTexture( GL_TEXTURE_2D, previewTexture );
+      glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+      glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+      glTexSubImage2D(
+          GL_TEXTURE_2D, 0,
+          0, previewRows, preview.dimensions.width, readyRows - previewRows,
+          previewFormat.format, previewFormat.type, preview.pixels + previewRows * rowBytes );
+      glGenerateMipmap( GL_TEXTURE_2D );
+
+      previewRows = readyRows;
+      return true;
+    }
+
+    bool isPreviewStreaming() const
+    {
+      return previewTexture && previewRows < image->getPreview()->dimensions.height;
+    }
+
+    // until the view needs a finer level than the preview: then the full decode starts, and tiles are built from it
+    bool isShowingPreview( int level )
+    {
+      if( !previewTexture || image->isFullResolutionRequested())
+        return false;
+
+      if( level >= previewLevel )
+        return true;
+
+      verboseLog( "level ", level, " is finer than the preview's ", previewLevel, ": decoding the full resolution" );
+      image->requestFullResolution();
+      return false;
+    }
+
+//------------------------------------------------------------------------------
+// drawing
+
+    // where a column or row of the full-resolution image is, in clip space
+    float clipX( double sx ) const { return (float)( -1 + 2 * ( sx / dimensions.width - view.left ) / ( view.right - view.left )); }
+    float clipY( double sy ) const { return (float)( 1 - 2 * ( sy / dimensions.height - view.top ) / ( view.bottom - view.top )); }
+
+    void drawPreview( const Program &p ) const
+    {
+      glUniform4f( p.positionRectUniform, clipX( 0 ), clipY( 0 ), clipX( dimensions.width ), clipY( dimensions.height ));
+      glUniform4f( p.uvRectUniform, 0, 0, 1, 1 );
+      glBindTexture( GL_TEXTURE_2D, previewTexture );
+      glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+    }
+
+    void drawTile( const Program &p, TileKey key, const Tile &tile ) const
+    {
+      // the tile's extent in full-resolution pixels; the last column or row at a coarse level may cover a partial block
+      const double scale = (double)( 1 << key.level );
+      const double sx0 = key.x * tileSize * scale, sy0 = key.y * tileSize * scale;
+      const double sx1 = std::min( (double)dimensions.width, ( key.x * tileSize + tile.width - 2 ) * scale );
+      const double sy1 = std::min( (double)dimensions.height, ( key.y * tileSize + tile.height - 2 ) * scale );
+
+      auto u = [ & ]( double sx ) { return (float)(( 1 + sx / scale - key.x * tileSize ) / tile.width ); };
+      auto v = [ & ]( double sy ) { return (float)(( 1 + sy / scale - key.y * tileSize ) / tile.height ); };
+
+      glUniform4f( p.positionRectUniform, clipX( sx0 ), clipY( sy0 ), clipX( sx1 ), clipY( sy1 ));
+      glUniform4f( p.uvRectUniform, u( sx0 ), v( sy0 ), u( sx1 ), v( sy1 ));
+      glBindTexture( GL_TEXTURE_2D, tile.texture );
+      glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+    }
+
+//------------------------------------------------------------------------------
+
+    GlRenderer( std::shared_ptr< ProgressiveImage > image, std::size_t textureBudgetBytes, bool compressTiles )
+    noexcept( false )
+      : image{ std::move( image ) }
+      , dimensions{ this->image->getDimensions() }
+      , textureFormat{ getGlTextureFormat( dimensions ) }
+      , compressed{ compressTiles && GLEW_EXT_texture_compression_s3tc
+                    && dimensions.channelType == ChannelType::uint8 && ( dimensions.nChannels == 1 || dimensions.nChannels == 3 ) }
+      , maxTileBytes{ tileBytes( tileTexels, tileTexels, textureFormat, compressed ) }
+      , textureBudgetBytes{ std::max( textureBudgetBytes, 2 * maxTileBytes ) } // room for the top tile and one more
+    {
+      while( levelLength( dimensions.width, topLevel ) > tileSize || levelLength( dimensions.height, topLevel ) > tileSize )
+        ++topLevel;
+
+      // tiles are built from the full resolution: without a preview to show meanwhile, a deferred full decode starts now
+      if( const std::shared_ptr< const ImagePreview > &preview = this->image->getPreview())
+        makePreviewTexture( *preview );
+      else
+        this->image->requestFullResolution();
+
+      this->image->rewind();
+      takeBands();
+      startBuilds();
+
+      program = makeShaderProgram( "" );
+      makeEmptyVertexArray();
+    }
+
+    std::optional< std::chrono::steady_clock::time_point >
+    getNextUpdateTime() override
+    {
+      // no rows are coming while the full decode is deferred
+      if(( loading && image->isFullResolutionRequested()) || isPreviewStreaming() || !building.empty() || !wanted.empty())
+        return std::chrono::steady_clock::now() + pollInterval;
+
+      return std::nullopt;
+    }
+
+    bool update() override
+    {
+      if( loading )
+        takeBands();
+
+      const bool previewChanged = isPreviewStreaming() && uploadPreviewRows( *image->getPreview());
+
+      const bool finished = finishBuilds();
+      startBuilds();
+      evict();
+
+      return finished || previewChanged;
+    }
+
+    // the tiles for it are chosen on the next render()
+    void setView( const View &view ) override
+    {
+      this->view = view;
+    }
+
+    void setTone( const Tone &tone ) override
+    {
+      this->tone = tone;
+    }
+
+    void render() override
+    {
+      ++frame;
+
+      GLint viewport[ 4 ]{};
+      glGetIntegerv( GL_VIEWPORT, viewport );
+
+      const int level = chooseLevel( viewport[ 2 ], viewport[ 3 ] );
+
+      glClearColor( 0, 0, 0, 0 );
+      glClear( GL_COLOR_BUFFER_BIT );
+
+      const Program &p = useShaderProgram();
+      glUniform1f( p.exposureUniform, (float)std::exp2( tone.exposureStops ));
+      glUniform1i( p.isLinearUniform, dimensions.channelType == ChannelType::float16 );
+      glUniform1i( p.toneMapUniform, tone.toneMap );
+      glBindVertexArray( emptyVertexArray );
+
+      if( isShowingPreview( level ))
+      {
+        drawPreview( p );
+        return;
+      }
+
+      int x0, y0, x1, y1;
+      tilesInView( level, &x0, &y0, &x1, &y1 );
+
+      // tiles in view which aren't ready yet are stood in for by their closest resident ancestor, drawn underneath
+      std::vector< std::pair< TileKey, Tile * >> ready;
+      std::set< TileKey > standIns;
+      wanted.clear();
+      if( !tiles.contains( { topLevel, 0, 0 } ))
+        wanted.push_back( { topLevel, 0, 0 } );
+
+      for( int y = y0; y < y1; ++y )
+        for( int x = x0; x < x1; ++x )
+        {
+          TileKey key{ level, x, y };
+          if( auto it = tiles.find( key ); it != tiles.end())
+          {
+            it->second.lastUsedFrame = frame;
+            ready.emplace_back( key, &it->second );
+            continue;
+          }
+
+          wanted.push_back( key );
+          for( TileKey ancestor = key.parent(); ancestor.level <= topLevel; ancestor = ancestor.parent())
+            if( auto it = tiles.find( ancestor ); it != tiles.end())
+            {
+              it->second.lastUsedFrame = frame;
+              standIns.insert( ancestor );
+              break;
+            }
+        }
+
+      startBuilds();
+
+      if( previewTexture )
+        drawPreview( p );
+
+      // coarsest first
+      for( auto it = standIns.rbegin(); it != standIns.rend(); ++it )
+        drawTile( p, *it, tiles.at( *it ));
+
+      for( const auto &[ key, tile ] : ready )
+        drawTile( p, key, *tile );
+    }
+  };
+} // namespace
+
+std::unique_ptr< IGlRenderer >
+makeGlRenderer_TiledImageRenderer( std::shared_ptr< ProgressiveImage > image, std::size_t textureBudgetBytes, bool compressTiles )
+{
+  return std::make_unique< GlRenderer >( std::move( image ), textureBudgetBytes, compressTiles );
+}
+
+void
+prepareGlRenderer_TiledImageRenderer()
+{
+  getShaderProgram( vertShaderName, fragShaderName );
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "IGlRenderer.hpp"
+#include "ProgressiveImage.hpp"
+
+#include <cstddef>
+#include <memory>
+
+// For images too big for one texture (larger than GL_MAX_TEXTURE_SIZE, or more than the texture memory budget):
+// the image is cut into fixed-size tiles at every level of a mip pyramid, and only the tiles needed for the current
+// view are built (box-filtered from the decoded pixels on worker threads) and kept as textures.
+// Tiles are evicted least recently used first to stay within textureBudgetBytes;
+// the single tile holding the whole image at the coarsest level stays, and stands in for any tile not built yet.
+// An image with a preview (see PreviewCache.hpp) is shown as just that while the view is no finer than it, and only
+// then is the full resolution asked for (which, for one decoded to fit, hasn't been decoded yet).
+// With compressTiles, opaque 8 bit images' tiles are BC1 compressed as they are built (where the GPU has S3TC):
+// an eighth of the memory of RGBA8, so eight times as many tiles fit in the budget, for some banding.
+
+std::unique_ptr< IGlRenderer >
+makeGlRenderer_TiledImageRenderer( std::shared_ptr< ProgressiveImage >, std::size_t textureBudgetBytes, bool compressTiles )
+noexcept( false ); // may throw std::exception
+
+// makes what every such renderer shares, in the current GL context, ahead of the first one
+void
+prepareGlRenderer_TiledImageRenderer()
+noexcept( false ); // may throw std::exception
@@ -1,17 +1,29 @@
 #include "GlfwWindow.hpp"
 
+#include "CommandQueue.hpp"
 #include "Destroyer.hpp"
 #include "ErrorString.hpp"
+#include "FrameScheduler.hpp"
+#include "FrameTimesHud.hpp"
 #include "GlWindowInputHandler.hpp"
+#include "GpuTimer.hpp"
 #include "Mutexed.hpp"
+#include "trace.hpp"
 
 #define GL_SILENCE_DEPRECATION // MacOS has deprecated OpenGL - it still works up to 4.1 for now
 #include <gl/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
 #include <functional>
+#include <iostream>
 #include <optional>
 #include <thread>
+#include <variant>
+#include <vector>
 
 /* TODO
    
@@ -24,9 +36,6 @@ Sizing isn't terribly important yet, but moving the window around is important a
 
 */ 
 
-// DELETE
-#include <iostream>
-
 namespace
 {
   void
@@ -34,6 +43,7 @@ namespace
   {
     glfwMakeContextCurrent( window );
 
+    TraceScope trace{ "glewInit" };
     if( GLEW_OK != glewInit())
       throw ErrorString( "glewInit() failed" );
   }
@@ -45,31 +55,81 @@ namespace
 
 //==============================================================================
 
-  enum class RenderThreadState
+  // From the event thread to the render thread, which applies them in order before its next frame; several of a kind
+  // make one frame, only the latest one counting. Apart from the renderer, the render thread's state is its own,
+  // so the event thread never waits for a frame (or for glfwSwapBuffers).
+  struct FrameSize
+  {
+    int width, height;
+  };
+  struct Refresh {};
+  struct RefreshInterval // of the display the window is on
   {
-    shouldWait,
-    shouldRender,
-    shouldQuit
+    std::chrono::steady_clock::duration interval;
   };
+  struct ToggleHud {}; // see FrameTimesHud.hpp
+  struct Quit {};
+  using RenderCommand = std::variant<Refresh, FrameSize, RefreshInterval, View, Tone, ToggleHud, std::unique_ptr<IGlRendererMaker>, Quit>;
 
-//==============================================================================
+  // far more than the commands of one frame, even in a resize storm: the event thread only backs up beyond this
+  constexpr std::size_t renderCommandCapacity = 256;
 
-  struct RenderThreadShared
-  {
-    RenderThreadState state = RenderThreadState::shouldRender;
+  // how often the event loop retries pushing its backlog, should the render thread ever fall that far behind
+  constexpr double renderCommandRetrySeconds = 0.002;
+
+  template<class ... Fs> struct Overloaded : Fs ... { using Fs::operator() ...; };
 
-    struct FrameSize
+  // how often the render thread looks whether the next image is ready to be shown, see IGlRendererMaker::isReady()
+  constexpr std::chrono::milliseconds pendingRendererPollInterval{ 10 };
+
+  // until the window is placed, and for displays which don't say
+  constexpr std::chrono::steady_clock::duration defaultRefreshInterval = std::chrono::microseconds{ 16667 }; // 60 Hz
+
+  // of the monitor the window's center is on (the primary one, if none is)
+  std::chrono::steady_clock::duration
+  getRefreshInterval( GLFWwindow *window )
+  {
+    int x = 0, y = 0, width = 0, height = 0;
+    glfwGetWindowPos( window, &x, &y );
+    glfwGetWindowSize( window, &width, &height );
+    const int centerX = x + width / 2, centerY = y + height / 2;
+
+    const GLFWvidmode *mode = nullptr;
+    int nMonitors = 0;
+    GLFWmonitor **monitors = glfwGetMonitors( &nMonitors );
+    for( int i = 0; i < nMonitors && !mode; ++i )
     {
-      int width, height;
-    };
-    std::optional<FrameSize> frameSizeUpdate;
+      int monitorX = 0, monitorY = 0;
+      glfwGetMonitorPos( monitors[ i ], &monitorX, &monitorY );
+      if( const GLFWvidmode *m = glfwGetVideoMode( monitors[ i ] );
+          m && centerX >= monitorX && centerX < monitorX + m->width && centerY >= monitorY && centerY < monitorY + m->height )
+        mode = m;
+    }
+
+    if( !mode )
+      if( GLFWmonitor *primary = glfwGetPrimaryMonitor())
+        mode = glfwGetVideoMode( primary );
+
+    if( !mode || mode->refreshRate <= 0 )
+      return defaultRefreshInterval;
+
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::duration<double>( 1.0 / mode->refreshRate ));
+  }
 
-    std::future<std::unique_ptr<IGlRendererMaker>> futureGlRendererMaker;
-    std::unique_ptr<IGlRenderer> renderer;
-  };
-  
 //==============================================================================
 
+  // each scroll step (a notch of a mouse wheel) zooms in or out by this much, around the cursor
+  constexpr double zoomPerScrollStep = 1.25;
+
+  // relative to all of the image in the window, at least
+  constexpr double maxZoom = 64;
+
+  // and for an image too big for that to show its pixels, as far as each of them being this many screen pixels across
+  constexpr double maxScreenPixelsPerImagePixel = 16;
+
+  // each press of + or - brightens or darkens the image by this many stops, see Tone
+  constexpr double exposureStepStops = 0.5;
+
   struct InputHandler : GlWindowInputHandler
   {
     InputHandler(IGlWindow &window) : window{window} {}
@@ -78,6 +138,8 @@ namespace
     {
       if (dragging)
         drag(xPos, yPos);
+      else if (panning)
+        pan(xPos, yPos);
     }
 
     void onKeyDown(int key, int scancode, int mods) override
@@ -87,27 +149,82 @@ namespace
       case 256: // Escape
         window.close();
         break;
+      case 48: // 0: the whole image, as decoded
+        setView(View{});
+        setTone(Tone{});
+        break;
+      case 84: // T
+        setTone({tone.exposureStops, !tone.toneMap});
+        break;
+      case 72: // H: the frame times overlay
+        onHudToggled();
+        break;
+      default:
+        if (!changeExposure(key) && appInputHandler)
+          appInputHandler->onKeyDown(key, scancode, mods);
       }
     }
+
+    void onKeyRepeat(int key, int scancode, int mods) override
+    {
+      if (!changeExposure(key) && appInputHandler)
+        appInputHandler->onKeyRepeat(key, scancode, mods);
+    }
+
+    void onKeyUp(int key, int scancode, int mods) override
+    {
+      if (appInputHandler)
+        appInputHandler->onKeyUp(key, scancode, mods);
+    }
     
+    // zoomed in, dragging pans the image instead of moving the window
     void onMouseDown(int button, int mods) override
     {
       if (button == GLFW_MOUSE_BUTTON_1)
-        if (!dragging) // might be possible with two mice or something weird, not sure how glfw would handle that
-          startDrag();
+        if (!dragging && !panning) // might be possible with two mice or something weird, not sure how glfw would handle that
+          isZoomedIn() ? startPan() : startDrag();
     }
 
     void onMouseUp(int button, int mods) override
     {
       if (button == GLFW_MOUSE_BUTTON_1)
-        if (dragging)
-          dragging = std::nullopt;
+      {
+        dragging = std::nullopt;
+        panning = std::nullopt;
+      }
     }
 
+    void onScroll(double xAmount, double yAmount) override
+    {
+      zoom(std::pow(zoomPerScrollStep, yAmount));
+    }
+
+    // all of the image, e.g. for the next one
+    void resetView()
+    {
+      view = View{};
+    }
+
+    // in pixels, for how far it can be zoomed into
+    void setImageSize(int width, int height)
+    {
+      imageWidth = width;
+      imageHeight = height;
+    }
+
+    GlWindowInputHandler *appInputHandler{}; // whatever the window doesn't handle itself goes here
+    std::function<void(const View &)> onViewChanged; // called with every change, to pass it to the renderer
+    std::function<void(const Tone &)> onToneChanged; // likewise; unlike the view, it stays for the next image
+    std::function<void()> onHudToggled;
+
   private:
     IGlWindow &window;
     struct Dragging { double x, y; };
     std::optional<Dragging> dragging;
+    std::optional<Dragging> panning; // from where the cursor was last, in the window
+    View view;
+    Tone tone;
+    int imageWidth{}, imageHeight{};
     
     void drag(double xrel, double yrel) {
       // TODO: consider snapping to edges of screen work area:
@@ -126,6 +243,96 @@ namespace
       dragging = Dragging{};
       window.getCursorPosContent(&dragging->x, &dragging->y);
     }
+
+    bool isZoomedIn() const {
+      return view.right - view.left < 1 || view.bottom - view.top < 1;
+    }
+
+    void startPan() {
+      panning = Dragging{};
+      window.getCursorPosContent(&panning->x, &panning->y);
+    }
+
+    void pan(double x, double y) {
+      int width = 0, height = 0;
+      window.getContentSize(&width, &height);
+      if (width <= 0 || height <= 0)
+        return;
+
+      // the image moves with the cursor
+      const double dx = (panning->x - x) / width * (view.right - view.left);
+      const double dy = (panning->y - y) / height * (view.bottom - view.top);
+      *panning = {x, y};
+
+      setView({view.left + dx, view.top + dy, view.right + dx, view.bottom + dy});
+    }
+
+    // keeps the part of the image under the cursor there
+    void zoom(double factor) {
+      int width = 0, height = 0;
+      window.getContentSize(&width, &height);
+      if (width <= 0 || height <= 0)
+        return;
+
+      double x = 0, y = 0;
+      window.getCursorPosContent(&x, &y);
+      const double fx = std::clamp(x / width, 0.0, 1.0), fy = std::clamp(y / height, 0.0, 1.0);
+
+      // the same for both sides, so the image keeps its aspect ratio at the limit
+      const double mostZoom = std::max({maxZoom,
+                                        maxScreenPixelsPerImagePixel * imageWidth / width,
+                                        maxScreenPixelsPerImagePixel * imageHeight / height});
+
+      const double oldWidth = view.right - view.left, oldHeight = view.bottom - view.top;
+      const double newWidth = std::clamp(oldWidth / factor, 1 / mostZoom, 1.0);
+      const double newHeight = std::clamp(oldHeight / factor, 1 / mostZoom, 1.0);
+
+      const double left = view.left + fx * (oldWidth - newWidth), top = view.top + fy * (oldHeight - newHeight);
+      setView({left, top, left + newWidth, top + newHeight});
+
+      if (!isZoomedIn())
+        panning = std::nullopt;
+    }
+
+    // + (also = on keyboards where + needs shift) and - on either keyboard or keypad; returns false for other keys
+    bool changeExposure(int key) {
+      double stops = 0;
+      switch (key)
+      {
+      case 61: // =
+      case 334: // keypad +
+        stops = exposureStepStops;
+        break;
+      case 45: // -
+      case 333: // keypad -
+        stops = -exposureStepStops;
+        break;
+      default:
+        return false;
+      }
+
+      setTone({tone.exposureStops + stops, tone.toneMap});
+      return true;
+    }
+
+    void setTone(const Tone &newTone) {
+      tone = newTone;
+      if (onToneChanged)
+        onToneChanged(tone);
+    }
+
+    // within the image
+    void setView(View newView) {
+      const double width = newView.right - newView.left, height = newView.bottom - newView.top;
+      newView.left = std::clamp(newView.left, 0.0, 1 - width);
+      newView.top = std::clamp(newView.top, 0.0, 1 - height);
+      newView.right = newView.left + width;
+      newView.bottom = newView.top + height;
+
+      view = newView;
+      if (onViewChanged)
+        onViewChanged(view);
+    }
   };
 
 //==============================================================================
@@ -133,7 +340,7 @@ namespace
   struct CallbackContext
   {
     GlWindowInputHandler &inputHandler;
-    Mutexed<RenderThreadShared> &renderThreadShared;
+    CommandQueue<RenderCommand> &renderCommands;
     
     static CallbackContext *from(GLFWwindow *window) {
       return static_cast<CallbackContext*>(glfwGetWindowUserPointer(window));
@@ -164,6 +371,12 @@ namespace
       }
     }
 
+    static void
+    scroll(GLFWwindow *window, double xoffset, double yoffset)
+    {
+      CallbackContext::from(window)->inputHandler.onScroll(xoffset, yoffset);
+    }
+
     static void
     key(GLFWwindow *window, int key, int scancode, int action, int mods)
     {
@@ -189,17 +402,20 @@ namespace
     static void
     framebufferSize(GLFWwindow *window, int width, int height)
     {
-      CallbackContext::from(window)->renderThreadShared.withLock(
-          [=](RenderThreadShared &rts)
-          { rts.frameSizeUpdate = {width, height}; });
+      CallbackContext::from(window)->renderCommands.push(FrameSize{width, height});
     }
 
     static void
     windowRefresh(GLFWwindow *window)
     {
-      CallbackContext::from(window)->renderThreadShared.withLockThenNotify(
-          [=](RenderThreadShared &rts)
-          { rts.state = RenderThreadState::shouldRender; });
+      CallbackContext::from(window)->renderCommands.push(Refresh{});
+    }
+
+    // it may have moved to another display
+    static void
+    windowPosition(GLFWwindow *window, int, int)
+    {
+      CallbackContext::from(window)->renderCommands.push(RefreshInterval{getRefreshInterval(window)});
     }
   };
 
@@ -218,7 +434,9 @@ namespace
     std::thread renderThread;
 
     InputHandler inputHandler;
-    Mutexed<RenderThreadShared> renderThreadShared{};
+    CommandQueue<RenderCommand> renderCommands{renderCommandCapacity};
+    std::future<std::unique_ptr<IGlRendererMaker>> futureGlRendererMaker; // taken by the render thread
+    Mutexed<std::vector<std::function<void()>>> eventTasks{}; // from other threads, see postToEventThread(..)
   };
 
 //==============================================================================
@@ -235,6 +453,7 @@ namespace
       glfwWindowHint( GLFW_TRANSPARENT_FRAMEBUFFER, GLFW_TRUE );
       glfwWindowHint( GLFW_DECORATED, GLFW_FALSE );
 
+      TraceScope trace{ "glfwCreateWindow" };
       window = glfwCreateWindow( 640, 480, "", nullptr, nullptr );
       if( !window )
         throw ErrorString( "glfwCreateWindow(..) failed" );
@@ -246,15 +465,18 @@ namespace
       // glfw callbacks involving render thread
       glfwSetFramebufferSizeCallback( window, GlfwRenderCallbacks::framebufferSize );
       glfwSetWindowRefreshCallback( window, GlfwRenderCallbacks::windowRefresh );
+      glfwSetWindowPosCallback( window, GlfwRenderCallbacks::windowPosition );
 
       // glfw input callbacks (not render thread)
       glfwSetCursorPosCallback( window, GlfwInputCallbacks::cursorPosition );
       glfwSetKeyCallback( window, GlfwInputCallbacks::key );
       glfwSetMouseButtonCallback( window, GlfwInputCallbacks::mouseButton );
+      glfwSetScrollCallback( window, GlfwInputCallbacks::scroll );
     }
 
     void startGlfw()
     {
+      TraceScope trace{ "glfwInit" };
       if( !glfwInit())
         throw ErrorString( "glfwInit() failed" );
 
@@ -275,45 +497,223 @@ namespace
             // activate the OpenGL context in this thread (the render thread);
             // however it is now unusable in the original thread
             glfwMakeContextCurrent( this->window );
-            
+            traceThreadName( "render" );
+
+            // Nothing which goes wrong here may take the thread (and so the process) down: a renderer which can't
+            // be made, or fails to render, is logged and leaves the window empty (renderer is nullptr) until the
+            // next one; a failed update() keeps what's already shown.
+            std::unique_ptr<IGlRenderer> renderer;
+            Tone tone; // for every renderer
+            auto makeRenderer = [&]( IGlRendererMaker &maker )
+            {
+              renderer.reset(); // frees its textures before the next one makes its own
+              try
+              {
+                renderer = maker.makeGlRenderer();
+                renderer->setTone( tone );
+              }
+              catch( const std::exception &e )
+              {
+                renderer.reset();
+                std::cerr << "can't show the image: " << e.what() << std::endl;
+              }
+            };
+
             // wait for renderer to exist
-            renderThreadShared.withLock(
-              []( RenderThreadShared &rts ){ rts.renderer = rts.futureGlRendererMaker.get()->makeGlRenderer(); }
-            );
+            try
+            {
+              std::unique_ptr<IGlRendererMaker> maker;
+              {
+                TraceScope trace{ "wait for image header" };
+                maker = futureGlRendererMaker.get();
+              }
+              makeRenderer( *maker );
+            }
+            catch( const std::exception &e )
+            {
+              std::cerr << "can't show the image: " << e.what() << std::endl;
+            }
+            bool swapped = false;
+
+            // Frames are only drawn when something has changed, at most once per display refresh: what changes
+            // in between (the rest of a resize, a drag) is applied straight away but waits for that one frame.
+            // The swap interval stays 0, so glfwSwapBuffers never blocks (indefinitely, on some compositors,
+            // for a hidden window) and the commands keep being taken while a frame waits its turn.
+            FrameScheduler frames{ defaultRefreshInterval };
+            frames.requestFrame();
+
+            // every frame is timed, on the CPU and (for the renderer's draw calls) on the GPU; the overlay is optional
+            FrameTimings timings;
+            GpuTimer gpuTimer;
+            std::unique_ptr<IFrameTimesHud> hud;
+            bool showHud = false;
+
+            // while the renderer's content is changing by itself (e.g. the image is still being decoded)
+            // it is also updated at the time it asks for, without anything else asking for a render
+            std::optional<std::chrono::steady_clock::time_point> nextUpdateTime;
+
+            // the next image's, until it can be made without waiting: the current image stays on screen meanwhile,
+            // with the views which came for the next one kept for it
+            std::unique_ptr<IGlRendererMaker> pendingMaker;
+            std::optional<View> pendingView;
+
+            for( bool quit = false; ; )
+            {
+              std::optional<FrameSize> frameSize;
+              std::optional<View> view;
+              std::optional<Tone> nextTone;
+              std::unique_ptr<IGlRendererMaker> nextGlRendererMaker; // replaces renderer
+
+              auto apply = Overloaded{
+                  [&]( Refresh ) { frames.requestFrame(); },
+                  [&]( FrameSize size ) { frameSize = size; frames.requestFrame(); },
+                  [&]( RefreshInterval r ) { frames.setRefreshInterval( r.interval ); },
+                  [&]( View v ) { view = v; frames.requestFrame(); },
+                  [&]( Tone t ) { nextTone = t; frames.requestFrame(); },
+                  [&]( ToggleHud ) { showHud = !showHud; frames.requestFrame(); },
+                  [&]( std::unique_ptr<IGlRendererMaker> maker )
+                  {
+                    nextGlRendererMaker = std::move( maker );
+                    view = std::nullopt; // was for the previous image
+                    frames.requestFrame();
+                  },
+                  [&]( Quit ) { quit = true; } };
+              renderCommands.drain( [&]( RenderCommand command ) { std::visit( apply, std::move( command )); } );
+
+              if( quit )
+                break;
+
+              if( nextGlRendererMaker )
+              {
+                pendingMaker = std::move( nextGlRendererMaker );
+                pendingView = std::nullopt;
+              }
+
+              if( pendingMaker && view )
+                pendingView = std::exchange( view, std::nullopt );
+
+              if( pendingMaker && pendingMaker->isReady())
+              {
+                makeRenderer( *std::exchange( pendingMaker, nullptr ));
+                view = std::exchange( pendingView, std::nullopt );
+                frames.requestFrame();
+              }
+
+              if( nextTone )
+              {
+                tone = *nextTone;
+                if( renderer )
+                  renderer->setTone( tone );
+              }
+
+              if( view && renderer )
+                renderer->setView( *view );
+
+              if( frameSize )
+                glViewport( 0, 0, frameSize->width, frameSize->height );
+
+              try
+              {
+                if( renderer && renderer->update())
+                  frames.requestFrame();
+              }
+              catch( const std::exception &e )
+              {
+                std::cerr << "rendering: " << e.what() << std::endl;
+              }
+
+              if( showHud && !hud )
+                try
+                {
+                  hud = makeFrameTimesHud();
+                }
+                catch( const std::exception &e )
+                {
+                  showHud = false;
+                  std::cerr << "frame times overlay: " << e.what() << std::endl;
+                }
 
-            auto waitPredicate =
-                []( const RenderThreadShared &rts ) { return rts.state != RenderThreadState::shouldWait; };
+              // the last frames' GPU times, which are usually in by the next one
+              gpuTimer.collect( [&]( uint64_t frame, float ms ) { timings.setGpuTime( frame, ms ); } );
 
-            auto whileLocked =
-                [this]( RenderThreadShared &rts )
-                    -> bool // true to continue, false to quit
+              if( const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now(); frames.isFrameDue( now ))
+              {
+                using Milliseconds = std::chrono::duration<float, std::milli>;
+                FrameTiming timing;
                 {
-                  if( rts.state == RenderThreadState::shouldQuit )
-                    return false;
-
-                  if( rts.frameSizeUpdate )
+                  TraceScope trace{ "frame" };
+                  gpuTimer.begin( timings.getNextFrame());
+                  if( renderer )
+                    try
+                    {
+                      renderer->render();
+                    }
+                    catch( const std::exception &e )
+                    {
+                      renderer.reset();
+                      std::cerr << "rendering: " << e.what() << std::endl;
+                    }
+
+                  if( !renderer )
                   {
-                    auto [width, height] = *std::exchange(rts.frameSizeUpdate, std::nullopt);
-                    glViewport( 0, 0, width, height );
+                    glClearColor( 0, 0, 0, 0 );
+                    glClear( GL_COLOR_BUFFER_BIT );
                   }
+                  gpuTimer.end();
+                  timing.renderMs = Milliseconds( std::chrono::steady_clock::now() - now ).count();
 
-                  rts.renderer->render();
+                  if( showHud )
+                    hud->render( timings, frames.getRefreshInterval());
 
+                  const std::chrono::steady_clock::time_point swapStart = std::chrono::steady_clock::now();
                   glfwSwapBuffers( this->window );
+                  const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+                  timing.swapMs = Milliseconds( end - swapStart ).count();
+                  timing.frameMs = Milliseconds( end - now ).count();
+                }
+                frames.presented( now );
+                timings.add( timing );
+
+                if( !std::exchange( swapped, true ))
+                  traceInstant( "first glfwSwapBuffers" );
+              }
+
+              // whichever is first: the renderer's next update, or the frame waiting for its turn
+              nextUpdateTime = renderer ? renderer->getNextUpdateTime() : std::nullopt;
+              if( pendingMaker )
+              {
+                const std::chrono::steady_clock::time_point pollTime = std::chrono::steady_clock::now() + pendingRendererPollInterval;
+                nextUpdateTime = nextUpdateTime ? std::min( *nextUpdateTime, pollTime ) : pollTime;
+              }
+              if( const std::optional<std::chrono::steady_clock::time_point> frameTime = frames.getNextFrameTime())
+                nextUpdateTime = nextUpdateTime ? std::min( *nextUpdateTime, *frameTime ) : *frameTime;
+
+              renderCommands.waitUntil( nextUpdateTime );
+            }
+
+            // its GL objects have to go while the context is still current in this thread
+            renderer.reset();
+            hud.reset();
+          }};
+    }
 
-                  rts.state = RenderThreadState::shouldWait;
-
-                  return true;
-                };
+    void runEventTasks()
+    {
+      std::vector<std::function<void()>> tasks;
+      eventTasks.withLock( [&]( std::vector<std::function<void()>> &posted ) { tasks.swap( posted ); } );
 
-            while( renderThreadShared.waitThen( waitPredicate, whileLocked ));
-          }};
+      for( std::function<void()> &task : tasks )
+        task();
     }
 
     void stopRenderThread()
     {
-      renderThreadShared.withLockThenNotify(
-          []( RenderThreadShared &rts ) { rts.state = RenderThreadState::shouldQuit; } );
+      renderCommands.push( Quit{} );
+
+      // the one time the event thread waits for the render thread: it's going away
+      while( !renderCommands.flush())
+        std::this_thread::yield();
 
       if( renderThread.joinable())
         renderThread.join();
@@ -326,16 +726,18 @@ namespace
         std::future<std::unique_ptr<IGlRendererMaker >>
         futureGlRendererMaker
     )
-      : State{.inputHandler{*this}}
-      , callbackContext{.inputHandler = inputHandler, .renderThreadShared = renderThreadShared}
+      : State{.inputHandler{*this}, .futureGlRendererMaker = std::move( futureGlRendererMaker )}
+      , callbackContext{.inputHandler = inputHandler, .renderCommands = renderCommands}
     {
       startGlfw();
       createGlfwWindow(&callbackContext);
       startGlew( window );
-      glfwSwapInterval( 0 );
+      glfwSwapInterval( 0 ); // frames are paced by the render thread instead, see startRenderThread()
+      renderCommands.push( RefreshInterval{ getRefreshInterval( window ) } );
 
-      renderThreadShared.withLock(
-          [&]( RenderThreadShared &rts ) { rts.futureGlRendererMaker = std::move( futureGlRendererMaker ); } );
+      inputHandler.onViewChanged = [this]( const View &view ) { renderCommands.push( view ); };
+      inputHandler.onToneChanged = [this]( const Tone &tone ) { renderCommands.push( tone ); };
+      inputHandler.onHudToggled = [this] { renderCommands.push( ToggleHud{} ); };
     }
 
     ~GlfwWindow()
@@ -358,7 +760,22 @@ namespace
     enterEventLoop()
     override
     {
-      for (startRenderThread(); !glfwWindowShouldClose(window); glfwWaitEvents());
+      // any commands the render thread couldn't take yet are retried until it has them all
+      for (startRenderThread(); !glfwWindowShouldClose(window);)
+      {
+        renderCommands.flush() ? glfwWaitEvents() : glfwWaitEventsTimeout(renderCommandRetrySeconds);
+        runEventTasks();
+      }
+    }
+
+    void
+    focus()
+    override
+    {
+      if( glfwGetWindowAttrib( window, GLFW_ICONIFIED ))
+        glfwRestoreWindow( window );
+
+      glfwFocusWindow( window );
     }
     
     void
@@ -375,6 +792,13 @@ namespace
       glfwGetWindowPos( window, x, y );
     }
 
+    void
+    getContentSize(int *width, int *height)
+    override
+    {
+      glfwGetWindowSize( window, width, height );
+    }
+
     void
     hide()
     override
@@ -396,6 +820,33 @@ namespace
       glfwShowWindow( window );
     }
 
+    void
+    setInputHandler(GlWindowInputHandler *appInputHandler)
+    override
+    {
+      inputHandler.appInputHandler = appInputHandler;
+    }
+
+    void
+    setRendererMaker(std::unique_ptr<IGlRendererMaker> rendererMaker)
+    override
+    {
+      // the next image starts out whole
+      inputHandler.resetView();
+
+      renderCommands.push( std::move( rendererMaker ));
+    }
+
+    void
+    postToEventThread(std::function<void()> task)
+    override
+    {
+      eventTasks.withLock( [&]( std::vector<std::function<void()>> &posted ) { posted.push_back( std::move( task )); } );
+
+      // wakes glfwWaitEvents()
+      glfwPostEmptyEvent();
+    }
+
 //------------------------------------------------------------------------------
 // IGlWindowAppearance overrides
 
@@ -412,6 +863,8 @@ namespace
     setCenteredToFit( int contentWidth, int contentHeight ) 
     override
     {
+      inputHandler.setImageSize( contentWidth, contentHeight );
+
       // get monitor work area
       // TODO: figure out which monitor the center of the window is in and use that one instead of necessarily the primary monitor
       GLFWmonitor *monitor = glfwGetPrimaryMonitor();
@@ -488,3 +941,29 @@ makeGlfwWindow(
 {
   return std::make_unique<GlfwWindow>( std::move( futureGlRendererMaker ));
 }
+
+TargetSize
+getPrimaryMonitorWorkArea()
+{
+  // makeGlfwWindow initializing GLFW again is harmless, and its window terminates GLFW when it's done
+  TraceScope trace{ "glfwInit" };
+  if( !glfwInit())
+    throw ErrorString( "glfwInit() failed" );
+
+  TargetSize workArea;
+  if( GLFWmonitor *monitor = glfwGetPrimaryMonitor())
+  {
+    int xpos = 0, ypos = 0;
+    glfwGetMonitorWorkarea( monitor, &xpos, &ypos, &workArea.width, &workArea.height );
+
+#ifdef __APPLE__
+    // in points there, while images are drawn to the framebuffer's pixels
+    float xscale = 1, yscale = 1;
+    glfwGetMonitorContentScale( monitor, &xscale, &yscale );
+    workArea.width = (int)( workArea.width * xscale );
+    workArea.height = (int)( workArea.height * yscale );
+#endif
+  }
+
+  return workArea;
+}
@@ -2,11 +2,19 @@
 
 #include "IGlRendererMaker.hpp"
 #include "IGlWindow.hpp"
+#include "ImageDimensions.hpp"
 
 #include <future>
 #include <memory>
 
+// The window's GL context stays current on the calling thread until enterEventLoop(), which hands it to the
+// render thread; the renderers are only made there, once the future is fulfilled.
 std::unique_ptr< IGlWindow >
 makeGlfwWindow(
     std::future< std::unique_ptr< IGlRendererMaker >>
 ) noexcept( false ); // may throw ErrorString
+
+// the primary monitor's work area in pixels, which the window is fitted into; initializes GLFW if no window has yet
+TargetSize
+getPrimaryMonitorWorkArea()
+noexcept( false ); // may throw ErrorString
@@ -1,8 +1,40 @@
 #pragma once
 
+#include <chrono>
+#include <optional>
+
+// The part of the image filling the window, as fractions of its width and height from its top left corner:
+// all of it, unless zoomed in
+struct View
+{
+  double left = 0, top = 0, right = 1, bottom = 1;
+};
+
+// How bright the image is shown: exposureStops brightens (or darkens) it, each stop doubling the light.
+// For HDR images, light brighter than the display's white is tone mapped (a filmic curve) unless toneMap is off,
+// and then clipped.
+struct Tone
+{
+  double exposureStops = 0;
+  bool toneMap = true;
+};
+
 struct IGlRenderer
 {
   virtual ~IGlRenderer() = default;
 
   virtual void render() = 0;
+
+  // For renderers whose content changes by itself, for example an image which is still being decoded:
+  // when the window should next call update(), even if nothing else asks for a render.
+  virtual std::optional< std::chrono::steady_clock::time_point > getNextUpdateTime() { return std::nullopt; }
+
+  // returns true if there is new content to show, so render() should be called
+  virtual bool update() { return false; }
+
+  // shows just that part of the image from the next render() on; a new renderer shows all of it
+  virtual void setView( const View & ) {}
+
+  // from the next render() on
+  virtual void setTone( const Tone & ) {}
 };
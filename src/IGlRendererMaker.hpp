@@ -9,6 +9,9 @@ struct IGlRendererMaker
 {
   virtual ~IGlRendererMaker() = default;
 
+  // makeGlRenderer() would not have to wait (e.g. for an image still being decoded to fit)
+  virtual bool isReady() const = 0;
+
   virtual
   std::unique_ptr< IGlRenderer >
   makeGlRenderer() = 0;
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "GlWindowInputHandler.hpp"
+#include "IGlRendererMaker.hpp"
 #include "IGlWindowAppearance.hpp"
 
+#include <functional>
 #include <memory>
 
 struct IGlWindow : IGlWindowAppearance
@@ -10,9 +12,20 @@ struct IGlWindow : IGlWindowAppearance
   ~IGlWindow() override = default;
   virtual void close() = 0;
   virtual void enterEventLoop() = 0;
+  virtual void focus() = 0; // restores the window if minimized, raises it, and gives it the input focus
   virtual void getCursorPosContent(double *x, double *y) = 0;
   virtual void getContentPosScreen(int *x, int *y) = 0;
+  virtual void getContentSize(int *width, int *height) = 0;
   virtual void hide() = 0;
   virtual void setContentPosScreen(int x, int y) = 0;
   virtual void show() = 0;
+
+  // gets the input the window doesn't handle itself (may be nullptr); must outlive the window or be replaced first
+  virtual void setInputHandler(GlWindowInputHandler *inputHandler) = 0;
+
+  // replaces the renderer: the new one is made on the render thread once the maker isReady(), the old one shown until then
+  virtual void setRendererMaker(std::unique_ptr<IGlRendererMaker> rendererMaker) = 0;
+
+  // runs task on the thread in enterEventLoop(), in order with the input; may be called from any thread
+  virtual void postToEventThread(std::function<void()> task) = 0;
 };
@@ -6,6 +6,6 @@ struct IRawImage
 {
   virtual ~IRawImage() = default;
 
-  virtual ImageDimensions getDimensions() = 0;
-  virtual const unsigned char * getPixels() = 0;
+  virtual ImageDimensions getDimensions() = 0; // including how the pixels are stored
+  virtual const unsigned char * getPixels() = 0; // rows of width * getPixelBytes() bytes; alpha is premultiplied
 };
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include "ImageBrowser.hpp"
+
+#include "makeGlRendererMaker.hpp"
+#include "verboseLog.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <exception>
+#include <filesystem>
+#include <system_error>
+#include <utility>
+
+namespace
+{
+  // what stb_image can decode
+  constexpr const char *imageExtensions[]{
+      ".jpg", ".jpeg", ".png", ".bmp", ".gif", ".tga", ".psd", ".hdr", ".pic", ".pnm", ".ppm", ".pgm" };
+
+  bool
+  hasImageExtension( const std::filesystem::path &path )
+  {
+    std::string extension = path.extension().string();
+    std::transform( extension.begin(), extension.end(), extension.begin(), []( unsigned char c ) { return (char)std::tolower( c ); } );
+
+    return std::find( std::begin( imageExtensions ), std::end( imageExtensions ), extension ) != std::end( imageExtensions );
+  }
+
+  // GLFW key codes
+  enum Key
+  {
+    space = 32,
+    right = 262,
+    left = 263,
+    backspace = 259,
+    pageUp = 266,
+    pageDown = 267
+  };
+} // namespace
+
+//==============================================================================
+
+ImageBrowser::ImageBrowser( std::string filename, TargetSize fitInto )
+    : filenames{ std::filesystem::path( filename ).lexically_normal().string() } // the same key in the cache as once listed
+    , cache{ cacheBudgetBytes, fitInto } {}
+
+std::shared_ptr< ImageSource >
+ImageBrowser::openFirst()
+{
+  return cache.get( filenames[ index ] );
+}
+
+void
+ImageBrowser::attach( IGlWindow &window )
+{
+  this->window = &window;
+  window.setInputHandler( this );
+
+  listDirectory();
+  prefetchNeighbours();
+}
+
+void
+ImageBrowser::open( const std::string &filename )
+{
+  std::vector< std::string > shownFilenames = std::move( filenames );
+  const std::size_t shownIndex = index;
+  filenames = { std::filesystem::path( filename ).lexically_normal().string() };
+  index = 0;
+
+  listDirectory();
+  if( show())
+    return;
+
+  // the image still shown keeps being browsed
+  filenames = std::move( shownFilenames );
+  index = shownIndex;
+  prefetchNeighbours();
+}
+
+void
+ImageBrowser::listDirectory()
+{
+  const std::filesystem::path first = filenames[ index ];
+
+  std::vector< std::string > listed;
+  std::error_code error;
+  for( const auto &entry : std::filesystem::directory_iterator( first.parent_path(), error ))
+    if( entry.is_regular_file( error ) && hasImageExtension( entry.path()) && entry.path().lexically_normal() != first )
+      listed.push_back( entry.path().lexically_normal().string());
+
+  // the first image stays, even if its extension isn't one of the known ones
+  listed.push_back( first.string());
+  std::sort( listed.begin(), listed.end());
+
+  index = std::find( listed.begin(), listed.end(), first.string()) - listed.begin();
+  filenames = std::move( listed );
+}
+
+void
+ImageBrowser::prefetchNeighbours()
+{
+  // nearest first, alternating ahead and behind, each image once however few there are
+  const int n = (int)filenames.size();
+  std::vector< std::string > neighbours;
+  for( int distance = 1; distance <= prefetchEachWay; ++distance )
+    for( const int direction : { 1, -1 } )
+      if( const std::string &filename = filenames[ ( (int)index + direction * distance % n + n ) % n ];
+          filename != filenames[ index ] && std::find( neighbours.begin(), neighbours.end(), filename ) == neighbours.end())
+        neighbours.push_back( filename );
+
+  cache.prefetch( neighbours );
+}
+
+// the image at index, and its neighbours prefetched; returns false (and logs why) if it turns out not to be a readable image
+bool
+ImageBrowser::show()
+{
+  std::shared_ptr< ImageSource > source = cache.get( filenames[ index ] );
+  prefetchNeighbours();
+
+  try
+  {
+    const ImageDimensions dimensions = source->getFutureDimensions().get();
+
+    // e.g. a neighbour prefetched with a good header and a corrupt body: as unreadable as a bad header
+    if( source->hasFailed())
+    {
+      verboseLog( "skipping ", filenames[ index ], ": its pixels could not be decoded" );
+      return false;
+    }
+
+    window->setRendererMaker( makeGlRendererMaker( source ));
+    window->setTitle( filenames[ index ] );
+    window->setCenteredToFit( dimensions.width, dimensions.height );
+    return true;
+  }
+  catch( const std::exception &e )
+  {
+    verboseLog( "skipping ", filenames[ index ], ": ", e.what());
+    return false;
+  }
+}
+
+void
+ImageBrowser::step( int direction )
+{
+  // skips files which turn out not to be readable images
+  const std::size_t shownIndex = index;
+  for( std::size_t tries = 1; tries < filenames.size(); ++tries )
+  {
+    index = ( index + filenames.size() + direction ) % filenames.size();
+    if( show())
+      return;
+  }
+
+  // none of the others are: the image still shown is where the next step starts from
+  index = shownIndex;
+  prefetchNeighbours();
+}
+
+void
+ImageBrowser::onKeyDown( int key, int /*scancode*/, int /*mods*/ )
+{
+  switch( key )
+  {
+    case Key::right:
+    case Key::pageDown:
+    case Key::space:
+      step( 1 );
+      break;
+
+    case Key::left:
+    case Key::pageUp:
+    case Key::backspace:
+      step( -1 );
+      break;
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "GlWindowInputHandler.hpp"
+#include "IGlWindow.hpp"
+#include "ImageCache.hpp"
+#include "ImageSource.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Steps through the images in the directory of the one opened first, in filename order, wrapping around:
+// Right, Page Down or Space shows the next one; Left, Page Up or Backspace the previous one.
+// A few neighbours in each direction are decoded ahead, so stepping through them doesn't wait for decoding.
+
+struct ImageBrowser : GlWindowInputHandler
+{
+  // fitInto: the most any image will be shown at, see ImageSource
+  ImageBrowser( std::string filename, TargetSize fitInto );
+
+  // starts loading the image given to the constructor
+  std::shared_ptr< ImageSource > openFirst();
+
+  // lists the directory, prefetches the neighbours, and from now on shows other images in window on key presses;
+  // window must outlive this
+  void attach( IGlWindow &window );
+
+  // shows filename in the window and browses its directory from now on, as if it had been opened first;
+  // only once attached. If it isn't a readable image, the one shown stays, and so does browsing its directory
+  void open( const std::string &filename );
+
+  void onKeyDown( int key, int scancode, int mods ) override;
+  void onKeyRepeat( int key, int scancode, int mods ) override { onKeyDown( key, scancode, mods ); }
+
+private:
+  static constexpr int prefetchEachWay = 2;
+  static constexpr std::size_t cacheBudgetBytes = std::size_t{ 1 } << 30;
+
+  std::vector< std::string > filenames;
+  std::size_t index{};
+  ImageCache cache;
+  IGlWindow *window{};
+
+  void listDirectory();
+  void prefetchNeighbours();
+  bool show();
+  void step( int direction );
+};
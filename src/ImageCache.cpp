@@ -0,0 +1,129 @@
+#include "ImageCache.hpp"
+
+#include "PreviewCache.hpp"
+#include "pixelBufferPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <utility>
+
+namespace
+{
+  // 0 until the header has been parsed; only the preview's while the full decode is deferred
+  std::size_t
+  getPixelBytes( const ImageSource &source )
+  {
+    const std::shared_future< ImageDimensions > dimensions = source.getFutureDimensions();
+    if( dimensions.wait_for( std::chrono::seconds{ 0 } ) != std::future_status::ready )
+      return 0;
+
+    try
+    {
+      ImageDimensions d = dimensions.get();
+      if( const auto image = source.getFutureImage(); image.wait_for( std::chrono::seconds{ 0 } ) == std::future_status::ready )
+        if( !image.get()->isFullResolutionRequested() && image.get()->getPreview())
+          d = image.get()->getPreview()->dimensions;
+
+      return (std::size_t)d.width * d.height * d.getPixelBytes();
+    }
+    catch( ... )
+    {
+      return 0; // unreadable, nothing decoded
+    }
+  }
+} // namespace
+
+//==============================================================================
+
+ImageCache::ImageCache( std::size_t budgetBytes, TargetSize fitInto )
+    : budgetBytes{ budgetBytes }
+    , fitInto{ fitInto } {}
+
+std::shared_ptr< ImageSource >
+ImageCache::get( const std::string &filename )
+{
+  auto it = entries.find( filename );
+  if( it == entries.end())
+    it = add( filename );
+
+  it->second.lastUsed = ++nUses;
+  current = filename;
+  evict();
+  logPixelBufferPoolCounters( "at open" );
+
+  return it->second.source;
+}
+
+void
+ImageCache::prefetch( const std::vector< std::string > &filenames )
+{
+  for( const std::string &filename : prefetched )
+    if( filename != current && std::find( filenames.begin(), filenames.end(), filename ) == filenames.end())
+      if( auto it = entries.find( filename ); it != entries.end() && it->second.source->isLoading())
+        retire( it );
+
+  prefetched = filenames;
+
+  for( const std::string &filename : prefetched )
+    if( !entries.contains( filename ))
+      add( filename );
+
+  evict();
+}
+
+std::map< std::string, ImageCache::Entry >::iterator
+ImageCache::add( const std::string &filename )
+{
+  std::erase_if( retired, []( const std::shared_ptr< ImageSource > &source ) { return !source->isLoading(); } );
+
+  auto it = entries.emplace( filename, Entry{ std::make_shared< ImageSource >( filename, fitInto ) } ).first;
+  it->second.source->startLoading();
+  return it;
+}
+
+void
+ImageCache::retire( std::map< std::string, Entry >::iterator it )
+{
+  it->second.source->cancel();
+  if( it->second.source->isLoading())
+    retired.push_back( std::move( it->second.source ));
+
+  entries.erase( it );
+}
+
+void
+ImageCache::evict()
+{
+  // images not wanted any more by last use, then prefetched ones starting with the least wanted
+  auto keepFirst = [ this ]( const auto &a, const auto &b )
+  {
+    auto rank = [ this ]( const std::string &filename ) -> std::size_t
+    {
+      const auto it = std::find( prefetched.begin(), prefetched.end(), filename );
+      return it == prefetched.end() ? std::numeric_limits< std::size_t >::max() : it - prefetched.begin();
+    };
+
+    const std::size_t rankA = rank( a.first->first ), rankB = rank( b.first->first );
+    return rankA != rankB ? rankA < rankB : a.first->second.lastUsed > b.first->second.lastUsed;
+  };
+
+  // each with its size as summed: a header parsed or the full resolution requested meanwhile changes it
+  std::vector< std::pair< std::map< std::string, Entry >::iterator, std::size_t >> candidates;
+  std::size_t totalBytes = 0;
+  for( auto it = entries.begin(); it != entries.end(); ++it )
+  {
+    const std::size_t bytes = getPixelBytes( *it->second.source );
+    totalBytes += bytes;
+    if( it->first != current )
+      candidates.emplace_back( it, bytes );
+  }
+
+  std::sort( candidates.begin(), candidates.end(), keepFirst );
+
+  for( ; totalBytes > budgetBytes && !candidates.empty(); candidates.pop_back())
+  {
+    totalBytes -= candidates.back().second;
+    retire( candidates.back().first );
+  }
+}
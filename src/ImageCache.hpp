@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ImageSource.hpp"
+#include "NoCopy.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Images recently shown, or about to be, so that browsing back and forth doesn't wait for decoding.
+// Their decoded pixels are kept within a byte budget: least recently used images go first,
+// but the current image stays, and prefetched ones go in reverse order of priority.
+// Use from one thread only.
+
+struct ImageCache : NoCopy
+{
+  // fitInto: see ImageSource
+  ImageCache( std::size_t budgetBytes, TargetSize fitInto );
+
+  // the image to show now, which starts loading unless it's cached already
+  std::shared_ptr< ImageSource > get( const std::string &filename );
+
+  // Starts loading these in the background, most wanted first. Anything prefetched earlier but not wanted any more
+  // which is still decoding is cancelled: the user has skipped past it.
+  void prefetch( const std::vector< std::string > &filenames );
+
+private:
+  struct Entry
+  {
+    std::shared_ptr< ImageSource > source;
+    uint64_t lastUsed{};
+  };
+
+  const std::size_t budgetBytes;
+  const TargetSize fitInto;
+  std::map< std::string, Entry > entries;
+  std::string current;
+  std::vector< std::string > prefetched; // most wanted first
+  uint64_t nUses{};
+
+  // cancelled, and kept until their decoding threads notice so that dropping them never blocks
+  std::vector< std::shared_ptr< ImageSource >> retired;
+
+  std::map< std::string, Entry >::iterator add( const std::string &filename );
+  void retire( std::map< std::string, Entry >::iterator );
+  void evict();
+};
@@ -1,6 +1,27 @@
 #pragma once
 
+#include <cstddef>
+
+// how each channel of a pixel is stored: 8 or 16 bit unsigned normalized (as decoded, gamma encoded),
+// or half floats (see halfFloat.hpp) of linear light, for HDR images
+enum class ChannelType : unsigned char
+{
+  uint8,
+  uint16,
+  float16
+};
+
 struct ImageDimensions
 {
   int width{}, height{}, nChannels{};
+  ChannelType channelType = ChannelType::uint8;
+
+  std::size_t getPixelBytes() const { return (std::size_t)nChannels * ( channelType == ChannelType::uint8 ? 1 : 2 ); }
+};
+
+// the most an image will be shown at, e.g. the screen's work area: the image is shrunk to fit within it;
+// 0 by 0 for no limit
+struct TargetSize
+{
+  int width{}, height{};
 };
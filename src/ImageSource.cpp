@@ -0,0 +1,171 @@
+#include "ImageSource.hpp"
+
+#include "GifDecoder.hpp"
+#include "MappedFile.hpp"
+#include "PreviewCache.hpp"
+#include "trace.hpp"
+#include "verboseLog.hpp"
+
+#include <chrono>
+#include <exception>
+#include <iostream>
+
+ImageSource::ImageSource( std::string filename, TargetSize fitInto )
+    : filename{ std::move( filename ) }
+    , fitInto{ fitInto }
+    , futureDimensions{ promisedDimensions.get_future() }
+    , futureImage{ promisedImage.get_future() } {}
+
+ImageSource::~ImageSource()
+{
+  cancel();
+}
+
+void
+ImageSource::startLoading()
+{
+  loading = std::async( std::launch::async, [ this ] { load(); } );
+}
+
+bool
+ImageSource::isLoading() const
+{
+  return loading.valid() && loading.wait_for( std::chrono::seconds{ 0 } ) != std::future_status::ready;
+}
+
+bool
+ImageSource::hasFailed() const
+{
+  if( futureImage.wait_for( std::chrono::seconds{ 0 } ) != std::future_status::ready )
+    return false;
+
+  try
+  {
+    return futureImage.get()->hasFailed();
+  }
+  catch( ... )
+  {
+    return true; // the header
+  }
+}
+
+void
+ImageSource::cancel()
+{
+  // load() checks cancelled after publishing the image, so one of the two always sees the other
+  cancelled = true;
+
+  if( futureImage.wait_for( std::chrono::seconds{ 0 } ) == std::future_status::ready )
+    try
+    {
+      futureImage.get()->cancel();
+    }
+    catch( ... )
+    {
+      // the header could not be read: there is no decoding to cancel
+    }
+}
+
+void
+ImageSource::load()
+{
+  std::shared_ptr< const MappedFile > file;
+  std::shared_ptr< ProgressiveImage > image;
+  std::shared_ptr< const ImagePreview > cachedPreview;
+  bool deferred = false;
+
+  traceThreadName( "load" );
+
+  try
+  {
+    {
+      TraceScope trace{ "open file", filename };
+      file = std::make_shared< const MappedFile >( filename.c_str());
+    }
+    TraceScope trace{ "read header", filename };
+    const ImageDimensions dimensions = readImageHeader( *file, filename.c_str());
+    image = std::make_shared< ProgressiveImage >( dimensions );
+    if( isAnimatedGif( { file->data(), file->size() } ))
+      animationFile = file;
+    promisedDimensions.set_value( dimensions );
+  }
+  catch( ... )
+  {
+    promisedDimensions.set_exception( std::current_exception());
+    promisedImage.set_exception( std::current_exception());
+    return;
+  }
+
+  // handed to the renderers: its preview can't change after that
+  bool published = false;
+  auto publish = [ & ]
+  {
+    promisedImage.set_value( image );
+    if( cancelled )
+      image->cancel();
+    published = true;
+  };
+
+  if( !cancelled )
+  {
+    TraceScope trace{ "load cached preview", filename };
+    cachedPreview = loadCachedPreview( filename );
+  }
+
+  // the window only needs the dimensions to size itself, so it's already being made while this decodes;
+  // a big PNG's preview is published while it's still being streamed, so its rows show as they come
+  if( cachedPreview )
+  {
+    // shown like a decode to fit, without decoding anything: the full decode waits until the view needs it
+    image->setPreview( cachedPreview );
+    deferred = true;
+  }
+  else
+    try
+    {
+      if( !cancelled )
+      {
+        TraceScope trace{ "decode to fit", filename };
+        deferred = decodeImageFileToFit( *file, image->getDimensions(), fitInto, [ & ]( std::shared_ptr< const ImagePreview > scaled )
+        {
+          verboseLog( filename, ": decoding at ", scaled->dimensions.width, "x", scaled->dimensions.height, " to fit, full size deferred" );
+          image->setPreview( std::move( scaled ));
+          publish();
+        }, &cancelled );
+      }
+    }
+    catch( const std::exception &e )
+    {
+      verboseLog( filename, ": not decoded to fit: ", e.what()); // the full decode reports the error, if it's real
+    }
+
+  if( !deferred )
+    image->requestFullResolution();
+
+  if( !published )
+    publish();
+
+  if( !image->waitForFullResolutionRequest())
+    return;
+
+  // the header is already in memory: decoding continues from the same mapping
+  try
+  {
+    TraceScope trace{ "decode", filename };
+    decodeImageFile( *file, filename.c_str(), *image );
+  }
+  catch( const std::exception &e )
+  {
+    // the rows decoded so far are still shown
+    std::cerr << filename << ": " << e.what() << std::endl;
+    image->fail();
+    return;
+  }
+
+  // every row is already published: the next time this file is opened won't have to wait for all of them
+  if( !cachedPreview && image->getPublishedRows() == image->getDimensions().height )
+  {
+    TraceScope trace{ "store preview", filename };
+    storePreview( filename, *image );
+  }
+}
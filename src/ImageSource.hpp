@@ -0,0 +1,67 @@
+#pragma once
+
+#include "ImageDimensions.hpp"
+#include "MappedFile.hpp"
+#include "ProgressiveImage.hpp"
+#include "loadImageFile.hpp"
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+
+// An image file which is opened and has its header parsed exactly once.
+// startLoading() parses the header on another thread and publishes the dimensions and the (still empty) image
+// as soon as it has, then continues decoding from the same open file on that thread, so another thread can size
+// a window without opening and parsing the file a second time, and can show rows as soon as they are decoded.
+// Given fitInto, a JPEG (or a very big PNG) is first decoded at a reduced scale just big enough for that
+// (see decodeImageFileToFit), which becomes the image's preview, and the full decode waits until the image's
+// full resolution is requested. The image is then only published with its preview: a JPEG's once it's decoded,
+// a big PNG's as soon as its first rows are in, the rest of them following.
+// A file with a cached preview (see PreviewCache.hpp) isn't decoded to fit: that preview is shown the same way.
+// An animated GIF is decoded as a still image of its first frame, like any other, and its file is also kept open
+// for its frames to be played from (see AnimatedImage).
+
+struct ImageSource
+{
+  explicit
+  ImageSource( std::string filename, TargetSize fitInto = {} );
+
+  ~ImageSource(); // cancels decoding and waits for it to stop
+
+  const std::string &getFilename() const { return filename; }
+
+  // fulfilled as soon as the header is parsed, or hold the exception (ErrorString) if it could not be
+  std::shared_future< ImageDimensions > getFutureDimensions() const { return futureDimensions; }
+  std::shared_future< std::shared_ptr< ProgressiveImage >> getFutureImage() const { return futureImage; }
+
+  // once getFutureImage() is ready: the file, if it's an animated GIF, otherwise nullptr
+  const std::shared_ptr< const MappedFile > &getAnimationFile() const { return animationFile; }
+
+  // Call once. The pixels are decoded on another thread and published to the image as they are done
+  // (a decoding failure is written to stderr, and the image just stops getting rows).
+  void startLoading();
+
+  // true from startLoading() until decoding has finished, failed, or stopped after cancel()
+  bool isLoading() const;
+
+  // stops decoding early because nobody wants the rest of the image
+  void cancel();
+
+  // the header could not be read, or the pixels could not be decoded; false until that's known
+  bool hasFailed() const;
+
+private:
+  std::string filename;
+  const TargetSize fitInto;
+  std::promise< ImageDimensions > promisedDimensions;
+  std::shared_future< ImageDimensions > futureDimensions;
+  std::promise< std::shared_ptr< ProgressiveImage >> promisedImage;
+  std::shared_future< std::shared_ptr< ProgressiveImage >> futureImage;
+  std::shared_ptr< const MappedFile > animationFile; // set before futureImage is
+
+  std::atomic< bool > cancelled{};
+  std::future< void > loading;
+
+  void load();
+};
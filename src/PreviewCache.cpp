@@ -0,0 +1,301 @@
+#include "PreviewCache.hpp"
+
+#include "ErrorString.hpp"
+#include "convertPixels.hpp"
+#include "getCacheDirectory.hpp"
+#include "verboseLog.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+  // previews fit in this many pixels on their longer side; images less than twice as big don't get one
+  constexpr int previewMaxSide = 1024;
+
+  constexpr std::uintmax_t defaultCacheMegabytes = 256;
+
+  // the previews directory is pruned to this many bytes, least recently used previews first;
+  // set with the environment variable IMAGEVIEWERGL_PREVIEW_CACHE_MB
+  std::uintmax_t
+  getCacheBytes()
+  {
+    std::uintmax_t megabytes = defaultCacheMegabytes;
+
+    if( const char *value = std::getenv( "IMAGEVIEWERGL_PREVIEW_CACHE_MB" ))
+      if( const unsigned long long parsed = std::strtoull( value, nullptr, 10 ); parsed > 0 )
+        megabytes = (std::uintmax_t)parsed;
+
+    return megabytes << 20;
+  }
+
+  // the digit is the version: 2 has alpha premultiplied
+  constexpr char magic[ 8 ]{ 'I', 'V', 'G', 'L', 'P', 'V', '2', '\0' };
+
+  // followed by the source path (pathLength bytes), then the pixel rows
+  struct Header
+  {
+    char magic[ 8 ];
+    uint32_t width, height, nChannels, pathLength;
+    uint64_t sourceSize;
+    int64_t sourceModified; // file_time_type ticks
+  };
+
+  struct SourceVersion
+  {
+    std::string path;
+    uint64_t size;
+    int64_t modified;
+  };
+
+  std::optional< SourceVersion >
+  getSourceVersion( const std::string &filename )
+  {
+    std::error_code error;
+    const std::filesystem::path path = std::filesystem::absolute( filename, error );
+    const uint64_t size = error ? 0 : std::filesystem::file_size( path, error );
+    const auto modified = error ? std::filesystem::file_time_type{} : std::filesystem::last_write_time( path, error );
+    if( error )
+      return std::nullopt;
+
+    return SourceVersion{ path.lexically_normal().string(), size, (int64_t)modified.time_since_epoch().count() };
+  }
+
+  // FNV-1a of the whole version, so a changed file gets a different cache file
+  std::optional< std::filesystem::path >
+  getPreviewPath( const SourceVersion &version )
+  {
+    const std::optional< std::filesystem::path > directory = getCacheDirectory( "previews" );
+    if( !directory )
+      return std::nullopt;
+
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [ & ]( const void *bytes, std::size_t n )
+    {
+      for( std::size_t i = 0; i < n; ++i )
+        hash = ( hash ^ static_cast< const unsigned char * >( bytes )[ i ] ) * 1099511628211ull;
+    };
+    add( version.path.data(), version.path.size());
+    add( &version.size, sizeof( version.size ));
+    add( &version.modified, sizeof( version.modified ));
+
+    char name[ 17 + 8 ];
+    std::snprintf( name, sizeof( name ), "%016llx.preview", (unsigned long long)hash );
+    return *directory / name;
+  }
+
+  // a preview's modification time is when it was last stored or loaded; the one just stored is kept regardless
+  void
+  prunePreviews( const std::filesystem::path &stored )
+  {
+    struct CachedPreview
+    {
+      std::filesystem::path path;
+      std::filesystem::file_time_type used;
+      std::uintmax_t bytes;
+    };
+
+    try
+    {
+      std::vector< CachedPreview > previews;
+      std::uintmax_t totalBytes = 0;
+      for( const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator{ stored.parent_path() } )
+      {
+        std::error_code error;
+        const std::uintmax_t bytes = entry.file_size( error );
+        const std::filesystem::file_time_type used = error ? std::filesystem::file_time_type{} : entry.last_write_time( error );
+        if( error || entry.path().extension() != ".preview" || entry.path() == stored )
+          continue;
+
+        previews.push_back( { entry.path(), used, bytes } );
+        totalBytes += bytes;
+      }
+
+      std::error_code error;
+      const std::uintmax_t storedBytes = std::filesystem::file_size( stored, error );
+      const std::uintmax_t cacheBytes = getCacheBytes();
+      const std::uintmax_t maxBytes = error ? cacheBytes : cacheBytes - std::min( cacheBytes, storedBytes );
+      if( totalBytes <= maxBytes )
+        return;
+
+      std::sort( previews.begin(), previews.end(), []( const CachedPreview &a, const CachedPreview &b ) { return a.used < b.used; } );
+      for( const CachedPreview &preview : previews )
+      {
+        if( totalBytes <= maxBytes )
+          break;
+        if( std::error_code error; std::filesystem::remove( preview.path, error ))
+          totalBytes -= preview.bytes;
+      }
+      verboseLog( "previews: pruned to ", totalBytes, " bytes besides ", stored.string());
+    }
+    catch( const std::exception &e )
+    {
+      verboseLog( "previews not pruned: ", e.what());
+    }
+  }
+} // namespace
+
+//==============================================================================
+
+PreviewScaler::PreviewScaler( const ImageDimensions &source, int factor, unsigned char *out )
+    : source{ source }
+    , factor{ factor }
+    , scaled{ getScaledDimensions( source, factor ) }
+    , pixels( out ? 0 : (std::size_t)scaled.width * scaled.height * scaled.nChannels )
+    , reducedRow( source.channelType == ChannelType::uint16 ? (std::size_t)source.width * source.nChannels : 0 )
+    , out{ out ? out : pixels.data() }
+    , sums( (std::size_t)scaled.width * scaled.nChannels )
+    , counts( scaled.width ) {}
+
+ImageDimensions
+PreviewScaler::getScaledDimensions( const ImageDimensions &source, int factor )
+{
+  return { ( source.width + factor - 1 ) / factor, ( source.height + factor - 1 ) / factor, source.nChannels };
+}
+
+void
+PreviewScaler::addRows( const unsigned char *rows, int nRows )
+{
+  const int nChannels = source.nChannels;
+  const std::size_t sourceRowBytes = (std::size_t)source.width * source.getPixelBytes();
+
+  for( int i = 0; i < nRows && sourceRow < source.height; ++i, ++sourceRow )
+  {
+    const unsigned char *row = rows + i * sourceRowBytes;
+    if( !reducedRow.empty())
+    {
+      getPixelConversions().reduce16To8( reinterpret_cast< const uint16_t * >( row ), reducedRow.data(), reducedRow.size());
+      row = reducedRow.data();
+    }
+
+    for( int sx = 0; sx < source.width; ++sx )
+    {
+      const int x = sx / factor;
+      ++counts[ x ];
+      for( int c = 0; c < nChannels; ++c )
+        sums[ x * nChannels + c ] += row[ sx * nChannels + c ];
+    }
+
+    // the last source row of a preview row
+    if(( sourceRow + 1 ) % factor != 0 && sourceRow + 1 != source.height )
+      continue;
+
+    unsigned char *outRow = out + (std::size_t)( sourceRow / factor ) * scaled.width * nChannels;
+    for( int x = 0; x < scaled.width; ++x )
+      for( int c = 0; c < nChannels; ++c )
+        outRow[ x * nChannels + c ] = (unsigned char)(( sums[ x * nChannels + c ] + counts[ x ] / 2 ) / counts[ x ] );
+
+    std::fill( sums.begin(), sums.end(), 0 );
+    std::fill( counts.begin(), counts.end(), 0 );
+  }
+}
+
+std::shared_ptr< const ImagePreview >
+loadCachedPreview( const std::string &filename )
+{
+  const std::optional< SourceVersion > version = getSourceVersion( filename );
+  const std::optional< std::filesystem::path > path = version ? getPreviewPath( *version ) : std::nullopt;
+  if( std::error_code error; !path || !std::filesystem::exists( *path, error ))
+    return nullptr;
+
+  try
+  {
+    MappedFile file{ path->string().c_str() };
+
+    Header header;
+    if( file.size() < sizeof( header ))
+      return nullptr;
+    std::memcpy( &header, file.data(), sizeof( header ));
+
+    // a hash collision, a stale file, or a truncated one
+    const std::size_t pixelBytes = (std::size_t)header.width * header.height * header.nChannels;
+    if( std::memcmp( header.magic, magic, sizeof( magic )) != 0
+        || header.sourceSize != version->size || header.sourceModified != version->modified
+        || header.pathLength != version->path.size()
+        || file.size() != sizeof( header ) + header.pathLength + pixelBytes
+        || std::memcmp( file.data() + sizeof( header ), version->path.data(), header.pathLength ) != 0 )
+      return nullptr;
+
+    const unsigned char *pixels = file.data() + sizeof( header ) + header.pathLength;
+    verboseLog( "preview of ", filename, ": ", header.width, "x", header.height, " from ", path->string());
+
+    // so it's pruned after the ones not used since
+    std::error_code error;
+    std::filesystem::last_write_time( *path, std::filesystem::file_time_type::clock::now(), error );
+
+    auto preview = std::make_shared< ImagePreview >();
+    preview->dimensions = { (int)header.width, (int)header.height, (int)header.nChannels };
+    preview->pixels = pixels;
+    preview->file = std::move( file );
+    return preview;
+  }
+  catch( const std::exception &e )
+  {
+    verboseLog( "preview of ", filename, " not loaded: ", e.what());
+    return nullptr;
+  }
+}
+
+void
+storePreview( const std::string &filename, ProgressiveImage &image )
+{
+  const ImageDimensions dimensions = image.getDimensions();
+  const int factor = ( std::max( dimensions.width, dimensions.height ) + previewMaxSide - 1 ) / previewMaxSide;
+  if( factor < 2 || dimensions.channelType == ChannelType::float16 ) // previews are 8 bits per channel, for display as is
+    return;
+
+  const std::optional< SourceVersion > version = getSourceVersion( filename );
+  const std::optional< std::filesystem::path > path = version ? getPreviewPath( *version ) : std::nullopt;
+  if( !path )
+    return;
+
+  PreviewScaler scaler{ dimensions, factor };
+  scaler.addRows( image.getPixelsForWriting(), dimensions.height );
+  const ImageDimensions scaled = scaler.getDimensions();
+  const std::vector< unsigned char > pixels = scaler.takePixels();
+
+  Header header{};
+  std::memcpy( header.magic, magic, sizeof( magic ));
+  header.width = scaled.width;
+  header.height = scaled.height;
+  header.nChannels = scaled.nChannels;
+  header.pathLength = (uint32_t)version->path.size();
+  header.sourceSize = version->size;
+  header.sourceModified = version->modified;
+
+  const std::filesystem::path temporary = getTemporaryPath( *path );
+
+  std::error_code error;
+  std::filesystem::create_directories( path->parent_path(), error );
+  {
+    std::ofstream out{ temporary, std::ios::binary | std::ios::trunc };
+    out.write( reinterpret_cast< const char * >( &header ), sizeof( header ));
+    out.write( version->path.data(), (std::streamsize)version->path.size());
+    out.write( reinterpret_cast< const char * >( pixels.data()), (std::streamsize)pixels.size());
+    if( !out )
+      error = std::make_error_code( std::errc::io_error );
+  }
+
+  if( !error )
+    std::filesystem::rename( temporary, *path, error );
+
+  if( error )
+  {
+    std::filesystem::remove( temporary, error );
+    verboseLog( "preview of ", filename, " not stored: ", error.message());
+  }
+  else
+  {
+    verboseLog( "preview of ", filename, ": stored ", scaled.width, "x", scaled.height, " in ", path->string());
+    prunePreviews( *path );
+  }
+}
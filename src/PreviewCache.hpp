@@ -0,0 +1,72 @@
+#pragma once
+
+#include "ImageDimensions.hpp"
+#include "MappedFile.hpp"
+#include "NoCopy.hpp"
+#include "ProgressiveImage.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// A persistent cache of downscaled previews of large images, so that opening one shows something right away
+// while the original is still being decoded.
+//
+// Previews live under $XDG_CACHE_HOME/imageviewergl/previews (~/.cache when unset, %LOCALAPPDATA% on Windows),
+// one file per image, keyed by the image's path, size and modification time. Each file is a small header
+// followed by the raw rows, so a preview is used straight from a read-only mapping of it.
+
+struct ImagePreview : NoCopy
+{
+  ImageDimensions dimensions; // nChannels is the image's
+  const unsigned char *pixels{}; // rows are dimensions.width * nChannels bytes apart
+  std::optional< MappedFile > file; // backs pixels when read from the cache
+  std::vector< unsigned char > decoded; // or this, when decoded from the image at a reduced scale
+
+  // A big PNG's preview is handed out while it's still being streamed (see decodeImageFileToFit): only the top rows
+  // are there yet, the rest still zero. Any other preview is whole from the start.
+  std::atomic< int > pendingRows{};
+  int getReadyRows() const { return dimensions.height - pendingRows.load( std::memory_order_acquire ); }
+};
+
+// Box-filters an image by a whole factor, so every preview pixel averages the same block of source pixels (but at the
+// edges), from its rows as they come, top to bottom: only the preview and a row of sums are held, so the image
+// itself needn't ever be whole. 16 bit rows are reduced to 8 bits first.
+struct PreviewScaler : NoCopy
+{
+  // into out when given, which must have room for getScaledDimensions(..), otherwise into a buffer of its own
+  PreviewScaler( const ImageDimensions &source, int factor, unsigned char *out = nullptr );
+
+  static ImageDimensions getScaledDimensions( const ImageDimensions &source, int factor );
+
+  // the next nRows rows of the source, source.width * source.getPixelBytes() bytes apart
+  void addRows( const unsigned char *rows, int nRows );
+
+  const ImageDimensions &getDimensions() const { return scaled; }
+  int getScaledRows() const { return sourceRow == source.height ? scaled.height : sourceRow / factor; } // finished so far
+
+  // once every row has been added, when not scaling into out
+  std::vector< unsigned char > takePixels() { return std::move( pixels ); }
+
+private:
+  const ImageDimensions source;
+  const int factor;
+  ImageDimensions scaled;
+  std::vector< unsigned char > pixels, reducedRow;
+  unsigned char *out;
+  std::vector< uint32_t > sums, counts;
+  int sourceRow{};
+};
+
+// nullptr when there is no preview of this version of the file (or it can't be read)
+std::shared_ptr< const ImagePreview >
+loadCachedPreview( const std::string &filename );
+
+// Call with a completely decoded image. Only writes a preview for images big enough to need one,
+// and writes it atomically (to a temporary file which is then renamed); failures are only logged.
+// The previews directory is then pruned to IMAGEVIEWERGL_PREVIEW_CACHE_MB (256 by default), least recently used first.
+void
+storePreview( const std::string &filename, ProgressiveImage &image );
@@ -0,0 +1,139 @@
+#include "ProgressiveImage.hpp"
+
+#include "convertPixels.hpp"
+#include "halfFloat.hpp"
+#include "pixelBufferPool.hpp"
+
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace
+{
+  // the rare 16 bit and half float images with alpha: exactly round( c * a / 65535 ), and a product of floats
+  void
+  premultiplyAlpha16( uint16_t *channels, std::size_t nPixels, int nChannels )
+  {
+    for( uint16_t *p = channels, *end = channels + nPixels * nChannels; p != end; p += nChannels )
+      for( int c = 0; c < nChannels - 1; ++c )
+      {
+        const uint64_t t = (uint64_t)p[ c ] * p[ nChannels - 1 ] + 32768;
+        p[ c ] = (uint16_t)(( t + ( t >> 16 )) >> 16 );
+      }
+  }
+
+  void
+  premultiplyAlphaHalf( uint16_t *channels, std::size_t nPixels, int nChannels )
+  {
+    for( uint16_t *p = channels, *end = channels + nPixels * nChannels; p != end; p += nChannels )
+      for( int c = 0; c < nChannels - 1; ++c )
+        p[ c ] = floatToHalf( halfToFloat( p[ c ] ) * halfToFloat( p[ nChannels - 1 ] ));
+  }
+} // namespace
+
+ProgressiveImage::ProgressiveImage( const ImageDimensions &dimensions )
+    : dimensions{ dimensions }
+    , minBandRows{ ( dimensions.height + maxBands - 1 ) / maxBands } {}
+
+unsigned char *
+ProgressiveImage::allocatePixels()
+{
+  // not cleared: the decoder overwrites it all
+  pixels = static_cast< unsigned char * >( allocatePixelBuffer( getRowBytes() * dimensions.height ));
+  if( !pixels )
+    throw std::bad_alloc{};
+
+  _pixels = Destroyer{ [ pixels = pixels ] { freePixelBuffer( pixels ); }};
+  return pixels;
+}
+
+void
+ProgressiveImage::adoptPixels( unsigned char *decodedPixels, Destroyer::fn_t &&freePixels )
+{
+  pixels = decodedPixels;
+  _pixels = Destroyer{ std::move( freePixels ) };
+}
+
+void
+ProgressiveImage::publishRows( int nRows )
+{
+  if( dimensions.nChannels == 2 || dimensions.nChannels == 4 )
+  {
+    unsigned char *rows = pixels + publishedRows * getRowBytes();
+    const std::size_t nPixels = (std::size_t)dimensions.width * nRows;
+
+    switch( dimensions.channelType )
+    {
+      case ChannelType::uint16:
+        premultiplyAlpha16( reinterpret_cast< uint16_t * >( rows ), nPixels, dimensions.nChannels );
+        break;
+      case ChannelType::float16:
+        premultiplyAlphaHalf( reinterpret_cast< uint16_t * >( rows ), nPixels, dimensions.nChannels );
+        break;
+      default:
+        getPixelConversions().premultiplyAlpha( rows, nPixels, dimensions.nChannels );
+    }
+  }
+
+  publishedRows += nRows;
+  pendingRows += nRows;
+
+  // every band but the last has at least minBandRows rows, so there are at most maxBands + 1 of them
+  if( pendingRows >= minBandRows || publishedRows == dimensions.height )
+  {
+    bands.tryPush( Band{ publishedRows - pendingRows, pendingRows } );
+    pendingRows = 0;
+  }
+}
+
+void
+ProgressiveImage::fail()
+{
+  failed.store( true, std::memory_order_release );
+}
+
+std::optional< ProgressiveImage::Band >
+ProgressiveImage::takeBand()
+{
+  if( rewoundRows > 0 )
+    return Band{ 0, std::exchange( rewoundRows, 0 ) };
+
+  // read first: the last band is pushed before failed is set
+  const bool hadFailed = hasFailed();
+
+  if( std::optional< Band > band = bands.tryPop())
+  {
+    takenRows = band->firstRow + band->nRows;
+    return band;
+  }
+
+  failureTaken = hadFailed;
+  return std::nullopt;
+}
+
+bool
+ProgressiveImage::waitForFullResolutionRequest()
+{
+  for( unsigned seen = wakeups.load(); !isFullResolutionRequested() && !isCancelled(); seen = wakeups.load())
+    wakeups.wait( seen );
+
+  return !isCancelled();
+}
+
+void
+ProgressiveImage::cancel()
+{
+  cancelled.store( true, std::memory_order_relaxed );
+  ++wakeups;
+  wakeups.notify_all();
+}
+
+void
+ProgressiveImage::requestFullResolution()
+{
+  if( fullResolutionRequested.exchange( true, std::memory_order_relaxed ))
+    return;
+
+  ++wakeups;
+  wakeups.notify_all();
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Destroyer.hpp"
+#include "IRawImage.hpp"
+#include "NoCopy.hpp"
+#include "SpscQueue.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+struct ImagePreview;
+
+// An image which can be displayed while it is still being decoded.
+// The decoding thread writes rows into the pixel buffer and publishes them, top to bottom, in bands;
+// the rendering thread takes the bands and uploads just those rows.
+// Bands are handed over through a lock-free queue so neither thread ever waits for the other.
+
+struct ProgressiveImage : IRawImage, NoCopy
+{
+  struct Band
+  {
+    int firstRow, nRows;
+  };
+
+  explicit
+  ProgressiveImage( const ImageDimensions &dimensions );
+
+  ImageDimensions getDimensions() override { return dimensions; }
+  const unsigned char *getPixels() override { return pixels; } // only rows in taken bands are valid
+  std::size_t getRowBytes() const { return dimensions.width * dimensions.getPixelBytes(); }
+
+//------------------------------------------------------------------------------
+// decoding thread
+
+  // either allocate the pixel buffer here (from the pool, see pixelBufferPool.hpp), or hand over one the decoder
+  // allocated itself
+  unsigned char *allocatePixels() noexcept( false ); // throws std::bad_alloc
+  void adoptPixels( unsigned char *decodedPixels, Destroyer::fn_t &&freePixels );
+  bool hasPixels() const { return pixels; }
+  unsigned char *getPixelsForWriting() { return pixels; }
+
+  // makes the next nRows rows (below those already published) visible to the rendering thread,
+  // first premultiplying their colours by alpha, if they have any, so textures filter without dark or coloured fringes
+  void publishRows( int nRows );
+  int getPublishedRows() const { return publishedRows; }
+
+  // no more rows are coming; those published so far stay valid (the caller reports why)
+  void fail();
+
+  // before the image is handed to the rendering thread: something smaller to show where rows are still missing
+  void setPreview( std::shared_ptr< const ImagePreview > p ) { preview = std::move( p ); }
+
+  bool isCancelled() const { return cancelled.load( std::memory_order_relaxed ); }
+
+  // for a decoder which has shown a smaller version of the image (the preview) and defers the full decode:
+  // blocks until requestFullResolution() or cancel(), returning false on the latter
+  bool waitForFullResolutionRequest();
+
+//------------------------------------------------------------------------------
+// rendering thread
+
+  std::optional< Band > takeBand();
+  bool isComplete() const { return takenRows == dimensions.height; }
+
+  // once takeBand() has come up empty after a decoding failure: the rows taken so far are all there will be
+  bool isFailed() const { return failureTaken; }
+
+  // may be nullptr
+  const std::shared_ptr< const ImagePreview > &getPreview() const { return preview; }
+
+  // for another consumer (e.g. a new renderer for an image shown before): the rows taken so far come first, as one band
+  void rewind() { rewoundRows = takenRows; }
+
+//------------------------------------------------------------------------------
+// any thread
+
+  // asks the decoding thread to stop early because nobody wants the rest of the image
+  void cancel();
+
+  // Asks for the rows themselves, not just the preview. Until then no rows may be coming at all: see
+  // waitForFullResolutionRequest(). The decoding thread requests them itself when it has nothing smaller to show.
+  void requestFullResolution();
+  bool isFullResolutionRequested() const { return fullResolutionRequested.load( std::memory_order_relaxed ); }
+
+  // decoding has failed, though some rows may still be waiting to be taken
+  bool hasFailed() const { return failed.load( std::memory_order_acquire ); }
+
+private:
+  // small publications are merged so that the queue can never fill up
+  static constexpr int maxBands = 64;
+
+  const ImageDimensions dimensions;
+  const int minBandRows;
+
+  unsigned char *pixels{};
+  Destroyer _pixels;
+
+  SpscQueue< Band > bands{ maxBands + 1 };
+  int publishedRows{}, pendingRows{}; // decoding thread
+  int takenRows{}, rewoundRows{}; // rendering thread
+  bool failureTaken{}; // rendering thread
+
+  std::shared_ptr< const ImagePreview > preview;
+
+  std::atomic< bool > failed{}, cancelled{}, fullResolutionRequested{};
+  std::atomic< unsigned > wakeups{}; // bumped by cancel() and requestFullResolution(), to wait on both
+};
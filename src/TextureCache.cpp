@@ -0,0 +1,61 @@
+#include "TextureCache.hpp"
+
+#include "verboseLog.hpp"
+
+#include <algorithm>
+
+TextureCache::TextureCache( std::size_t budgetBytes )
+    : budgetBytes{ budgetBytes } {}
+
+std::optional< TextureCache::Texture >
+TextureCache::take( const Key &key )
+{
+  const auto it = entries.find( key );
+  if( it == entries.end())
+  {
+    ++counters.misses;
+    logCounters( "miss" );
+    return std::nullopt;
+  }
+
+  Texture texture = std::move( it->second.texture );
+  cachedBytes -= texture.bytes;
+  entries.erase( it );
+
+  ++counters.hits;
+  logCounters( "hit" );
+  return texture;
+}
+
+void
+TextureCache::put( const Key &key, Texture &&texture )
+{
+  if( const auto it = entries.find( key ); it != entries.end())
+  {
+    cachedBytes -= it->second.texture.bytes;
+    entries.erase( it );
+  }
+
+  cachedBytes += texture.bytes;
+  entries.emplace( key, Entry{ std::move( texture ), ++nPuts } );
+
+  // may evict the one just put back, if it alone is over budget
+  while( cachedBytes > budgetBytes )
+  {
+    const auto oldest = std::min_element(
+        entries.begin(), entries.end(),
+        []( const auto &a, const auto &b ) { return a.second.lastPut < b.second.lastPut; } );
+
+    cachedBytes -= oldest->second.texture.bytes;
+    entries.erase( oldest );
+    ++counters.evictions;
+  }
+}
+
+void
+TextureCache::logCounters( const char *event ) const
+{
+  verboseLog(
+      "texture cache ", event, ": ", counters.hits, " hits, ", counters.misses, " misses, ", counters.evictions, " evictions, ",
+      entries.size(), " textures (", cachedBytes >> 20, " MiB) cached" );
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#define GL_SILENCE_DEPRECATION // MacOS has deprecated OpenGL - it still works up to 4.1 for now
+#include <gl/glew.h>
+
+#include "Destroyer.hpp"
+#include "ImageDimensions.hpp"
+#include "NoCopy.hpp"
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+
+// Complete image textures which are no longer shown, so that going back to a recently viewed image
+// just binds its texture again instead of uploading (and generating mipmaps) all over again.
+// A texture is taken out while it is shown and put back when it isn't; the ones in here are kept within a byte budget,
+// least recently put back first out. Render thread only: the textures are deleted with the cache.
+
+struct TextureCache : NoCopy
+{
+  // the modification time tells apart a file which has been rewritten since it was cached
+  struct Key
+  {
+    std::string path;
+    std::filesystem::file_time_type modified;
+
+    auto operator<=>( const Key & ) const = default;
+  };
+
+  struct Texture
+  {
+    GLuint name{};
+    Destroyer _name;
+    ImageDimensions dimensions;
+    std::size_t bytes{}; // including mipmaps
+  };
+
+  struct Counters
+  {
+    uint64_t hits, misses, evictions;
+  };
+
+  explicit
+  TextureCache( std::size_t budgetBytes );
+
+  // nullopt on a miss
+  std::optional< Texture > take( const Key & );
+
+  void put( const Key &, Texture && );
+
+  Counters getCounters() const { return counters; }
+
+private:
+  struct Entry
+  {
+    Texture texture;
+    uint64_t lastPut{};
+  };
+
+  const std::size_t budgetBytes;
+  std::map< Key, Entry > entries;
+  std::size_t cachedBytes{};
+  uint64_t nPuts{};
+  Counters counters{};
+
+  void logCounters( const char *event ) const;
+};
@@ -0,0 +1,342 @@
+#include "decodeJpegInParallel.hpp"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace
+{
+  // below this many pixels the threads cost more than they save
+  constexpr long long minPixels = 1 << 20;
+
+  int
+  readU16( const unsigned char *p )
+  {
+    return ( p[ 0 ] << 8 ) | p[ 1 ];
+  }
+
+//==============================================================================
+
+  struct JpegLayout
+  {
+    int width{}, height{}, nComponents{};
+    int mcuWidth{}, mcuHeight{}, mcusPerRow{}, mcuRows{};
+    int restartInterval{}; // in MCUs
+    bool verticallySubsampled{};
+
+    // marker segments copied into every strip, in file order; the frame header is patched per strip
+    std::vector< std::span< const unsigned char >> segments;
+    std::size_t frameSegment{};
+    std::span< const unsigned char > scanHeader;
+
+    // [start, end) file offsets of each restart interval's entropy-coded data
+    std::vector< std::size_t > intervalStarts, intervalEnds;
+
+    int getOutChannels() const { return nComponents >= 3 ? 3 : 1; } // as stbi_load with req_comp = 0
+  };
+
+  std::optional< JpegLayout >
+  parseJpeg( const MappedFile &file )
+  {
+    const unsigned char *bytes = file.data();
+    const std::size_t size = file.size();
+
+    if( size < 4 || bytes[ 0 ] != 0xff || bytes[ 1 ] != 0xd8 )
+      return std::nullopt;
+
+    JpegLayout jpeg;
+    bool haveFrame = false;
+    std::size_t pos = 2;
+
+    // header: everything up to and including the (only) start of scan
+    for( ;; )
+    {
+      while( pos < size && bytes[ pos ] == 0xff && pos + 1 < size && bytes[ pos + 1 ] == 0xff )
+        ++pos; // fill bytes
+
+      if( pos + 4 > size || bytes[ pos ] != 0xff )
+        return std::nullopt;
+
+      const int marker = bytes[ pos + 1 ];
+      const std::size_t length = readU16( bytes + pos + 2 );
+      if( length < 2 || pos + 2 + length > size )
+        return std::nullopt;
+
+      const std::span< const unsigned char > segment{ bytes + pos, 2 + length };
+      const unsigned char *data = bytes + pos + 4;
+      pos += 2 + length;
+
+      switch( marker )
+      {
+        case 0xc0: // baseline
+        case 0xc1: // extended sequential, huffman
+        {
+          if( haveFrame || length < 8 || data[ 0 ] != 8 )
+            return std::nullopt;
+
+          jpeg.height = readU16( data + 1 );
+          jpeg.width = readU16( data + 3 );
+          jpeg.nComponents = data[ 5 ];
+          if( jpeg.height == 0 || jpeg.width == 0 || ( jpeg.nComponents != 1 && jpeg.nComponents != 3 && jpeg.nComponents != 4 ) ||
+              length != 8u + 3u * jpeg.nComponents )
+            return std::nullopt;
+
+          int hMax = 1, vMax = 1, vMin = 4;
+          for( int c = 0; c < jpeg.nComponents; ++c )
+          {
+            const int h = data[ 7 + c * 3 ] >> 4, v = data[ 7 + c * 3 ] & 15;
+            if( h < 1 || h > 4 || v < 1 || v > 4 )
+              return std::nullopt;
+            hMax = std::max( hMax, h );
+            vMax = std::max( vMax, v );
+            vMin = std::min( vMin, v );
+          }
+
+          // a single component is coded non-interleaved: its MCU is one 8x8 block whatever the sampling factors
+          jpeg.mcuWidth = jpeg.nComponents == 1 ? 8 : 8 * hMax;
+          jpeg.mcuHeight = jpeg.nComponents == 1 ? 8 : 8 * vMax;
+          jpeg.verticallySubsampled = jpeg.nComponents > 1 && vMin < vMax;
+          jpeg.mcusPerRow = ( jpeg.width + jpeg.mcuWidth - 1 ) / jpeg.mcuWidth;
+          jpeg.mcuRows = ( jpeg.height + jpeg.mcuHeight - 1 ) / jpeg.mcuHeight;
+
+          jpeg.frameSegment = jpeg.segments.size();
+          jpeg.segments.push_back( segment );
+          haveFrame = true;
+          break;
+        }
+
+        case 0xdd: // define restart interval
+          if( length != 4 )
+            return std::nullopt;
+          jpeg.restartInterval = readU16( data );
+          jpeg.segments.push_back( segment );
+          break;
+
+        case 0xc4: // huffman tables
+        case 0xdb: // quantization tables
+        case 0xe0: // JFIF: stb uses its presence to decide the colour transform
+        case 0xee: // Adobe: same
+          jpeg.segments.push_back( segment );
+          break;
+
+        case 0xda: // start of scan
+          // all components must be in this one scan, otherwise the image needs several passes over the file
+          if( !haveFrame || length < 3 || data[ 0 ] != jpeg.nComponents )
+            return std::nullopt;
+          jpeg.scanHeader = segment;
+          break;
+
+        default:
+          if(( marker >= 0xe1 && marker <= 0xef ) || marker == 0xfe )
+            break; // other application data and comments aren't needed for decoding
+
+          return std::nullopt; // progressive, arithmetic coding, DNL, ...
+      }
+
+      if( !jpeg.scanHeader.empty())
+        break;
+    }
+
+    if( jpeg.restartInterval == 0 )
+      return std::nullopt;
+
+    // entropy-coded data: find each restart marker, and the marker that ends the scan
+    jpeg.intervalStarts.push_back( pos );
+    for( ;; )
+    {
+      const auto *ff = static_cast< const unsigned char * >( std::memchr( bytes + pos, 0xff, size - pos ));
+      if( !ff || ff + 1 >= bytes + size )
+        return std::nullopt;
+
+      const std::size_t markerPos = ff - bytes;
+      const int next = ff[ 1 ];
+
+      if( next == 0x00 ) // stuffed zero byte
+        pos = markerPos + 2;
+      else if( next == 0xff ) // fill byte before a marker
+        pos = markerPos + 1;
+      else if( next >= 0xd0 && next <= 0xd7 ) // restart
+      {
+        jpeg.intervalEnds.push_back( markerPos );
+        jpeg.intervalStarts.push_back( pos = markerPos + 2 );
+      }
+      else if( next == 0xd9 ) // end of image
+      {
+        jpeg.intervalEnds.push_back( markerPos );
+        break;
+      }
+      else
+        return std::nullopt; // another scan or other marker
+    }
+
+    const long long nMcus = (long long)jpeg.mcusPerRow * jpeg.mcuRows;
+    if( (long long)jpeg.intervalStarts.size() != ( nMcus + jpeg.restartInterval - 1 ) / jpeg.restartInterval )
+      return std::nullopt;
+
+    return jpeg;
+  }
+
+//==============================================================================
+
+  struct Strip
+  {
+    int firstRow, endRow; // MCU rows this strip provides to the final image
+    int decodeFirstRow, decodeEndRow; // MCU rows actually decoded, including overlap with neighbours
+  };
+
+  std::vector< Strip >
+  planStrips( const JpegLayout &jpeg, unsigned nThreads )
+  {
+    // only rows which begin a restart interval can begin a strip
+    std::vector< int > startableRows;
+    for( int row = 0; row < jpeg.mcuRows; ++row )
+      if( (long long)row * jpeg.mcusPerRow % jpeg.restartInterval == 0 )
+        startableRows.push_back( row );
+
+    std::vector< int > starts;
+    for( unsigned i = 0; i < nThreads; ++i )
+    {
+      const int target = (int)((long long)jpeg.mcuRows * i / nThreads );
+      const auto row = std::lower_bound( startableRows.begin(), startableRows.end(), target );
+      if( row != startableRows.end() && ( starts.empty() || *row > starts.back()))
+        starts.push_back( *row );
+    }
+
+    std::vector< Strip > strips;
+    for( std::size_t i = 0; i < starts.size(); ++i )
+    {
+      Strip strip{};
+      strip.firstRow = starts[ i ];
+      strip.endRow = i + 1 < starts.size() ? starts[ i + 1 ] : jpeg.mcuRows;
+      strip.decodeFirstRow = strip.firstRow;
+      strip.decodeEndRow = strip.endRow;
+
+      // chroma upsampling looks at the neighbouring chroma rows, so decode a little more on each side
+      if( jpeg.verticallySubsampled )
+      {
+        if( strip.firstRow > 0 )
+          strip.decodeFirstRow = *std::prev( std::lower_bound( startableRows.begin(), startableRows.end(), strip.firstRow ));
+        strip.decodeEndRow = std::min( strip.endRow + 1, jpeg.mcuRows );
+      }
+
+      strips.push_back( strip );
+    }
+
+    return strips;
+  }
+
+  // a standalone JPEG for just the decoded rows of strip
+  std::vector< unsigned char >
+  makeStripJpeg( const JpegLayout &jpeg, const Strip &strip, const unsigned char *bytes )
+  {
+    const long long firstMcu = (long long)strip.decodeFirstRow * jpeg.mcusPerRow;
+    const long long endMcu = (long long)strip.decodeEndRow * jpeg.mcusPerRow;
+    const std::size_t firstInterval = firstMcu / jpeg.restartInterval;
+    const std::size_t lastInterval = std::min(
+        ( endMcu + jpeg.restartInterval - 1 ) / jpeg.restartInterval, (long long)jpeg.intervalStarts.size()) - 1;
+
+    const std::size_t dataBegin = jpeg.intervalStarts[ firstInterval ];
+    const std::size_t dataEnd = jpeg.intervalEnds[ lastInterval ];
+    const int stripHeight = std::min( strip.decodeEndRow * jpeg.mcuHeight, jpeg.height ) - strip.decodeFirstRow * jpeg.mcuHeight;
+
+    std::vector< unsigned char > out{ 0xff, 0xd8 };
+    for( std::size_t i = 0; i < jpeg.segments.size(); ++i )
+    {
+      const auto segment = jpeg.segments[ i ];
+      const std::size_t at = out.size();
+      out.insert( out.end(), segment.begin(), segment.end());
+
+      if( i == jpeg.frameSegment )
+      {
+        out[ at + 5 ] = (unsigned char)( stripHeight >> 8 );
+        out[ at + 6 ] = (unsigned char)stripHeight;
+      }
+    }
+    out.insert( out.end(), jpeg.scanHeader.begin(), jpeg.scanHeader.end());
+
+    // restart markers count RST0..RST7 over and over; renumber them so the strip's first one is RST0 again
+    const std::size_t dataAt = out.size();
+    out.insert( out.end(), bytes + dataBegin, bytes + dataEnd );
+    for( std::size_t interval = firstInterval; interval < lastInterval; ++interval )
+      out[ dataAt + jpeg.intervalEnds[ interval ] - dataBegin + 1 ] = (unsigned char)( 0xd0 + ( interval - firstInterval ) % 8 );
+
+    out.insert( out.end(), { 0xff, 0xd9 } );
+
+    return out;
+  }
+
+  // decodes strip and copies its own rows into pixels; false if stb fails or disagrees about the layout
+  bool
+  decodeStrip( const JpegLayout &jpeg, const Strip &strip, const unsigned char *bytes, unsigned char *pixels, const ProgressiveImage &image )
+  {
+    if( image.isCancelled())
+      return false;
+
+    const std::vector< unsigned char > stripJpeg = makeStripJpeg( jpeg, strip, bytes );
+
+    int width = 0, height = 0, nChannels = 0;
+    stbi_uc *stripPixels = stbi_load_from_memory( stripJpeg.data(), (int)stripJpeg.size(), &width, &height, &nChannels, 0 );
+    if( !stripPixels )
+      return false;
+
+    const int decodedFirstY = strip.decodeFirstRow * jpeg.mcuHeight;
+    const int firstY = strip.firstRow * jpeg.mcuHeight;
+    const int endY = std::min( strip.endRow * jpeg.mcuHeight, jpeg.height );
+    const std::size_t rowBytes = (std::size_t)jpeg.width * jpeg.getOutChannels();
+
+    const bool matches =
+        width == jpeg.width && nChannels == jpeg.getOutChannels() &&
+        height == std::min( strip.decodeEndRow * jpeg.mcuHeight, jpeg.height ) - decodedFirstY;
+
+    if( matches )
+      std::memcpy(
+          pixels + firstY * rowBytes,
+          stripPixels + ( firstY - decodedFirstY ) * rowBytes,
+          ( endY - firstY ) * rowBytes );
+
+    stbi_image_free( stripPixels );
+    return matches;
+  }
+} // namespace
+
+bool
+decodeJpegInParallel( const MappedFile &file, unsigned nThreads, ProgressiveImage &image )
+{
+  if( nThreads < 2 )
+    return false;
+
+  const std::optional< JpegLayout > jpeg = parseJpeg( file );
+  if( !jpeg || (long long)jpeg->width * jpeg->height < minPixels )
+    return false;
+
+  if( const ImageDimensions d = image.getDimensions();
+      d.width != jpeg->width || d.height != jpeg->height || d.nChannels != jpeg->getOutChannels())
+    return false;
+
+  const std::vector< Strip > strips = planStrips( *jpeg, nThreads );
+  if( strips.size() < 2 )
+    return false;
+
+  unsigned char *pixels = image.allocatePixels();
+
+  std::vector< std::future< bool >> decoded;
+  for( const Strip &strip : strips )
+    decoded.push_back( std::async(
+        std::launch::async, decodeStrip, std::cref( *jpeg ), std::cref( strip ), file.data(), pixels, std::cref( image )));
+
+  // publish from the top down: a strip which finishes early waits for the ones above it
+  for( std::size_t i = 0; i < strips.size(); ++i )
+  {
+    if( !decoded[ i ].get())
+      return false; // the remaining futures wait for their strips as they are destroyed
+
+    image.publishRows( std::min( strips[ i ].endRow * jpeg->mcuHeight, jpeg->height ) - strips[ i ].firstRow * jpeg->mcuHeight );
+  }
+
+  return true;
+}
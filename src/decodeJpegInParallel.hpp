@@ -0,0 +1,19 @@
+#pragma once
+
+#include "MappedFile.hpp"
+#include "ProgressiveImage.hpp"
+
+// Decodes a baseline JPEG on several threads by splitting its entropy-coded data at restart markers
+// which fall at the start of an MCU row. Each strip is rewritten as a small standalone JPEG
+// (the original tables plus a frame header with the strip's height) and decoded with stb in parallel.
+// Strips overlap by an MCU row when chroma is vertically subsampled, so upsampling at strip edges
+// matches a whole-image decode.
+//
+// Strips are published to image in order from the top as soon as they (and the ones above them) are done.
+//
+// Returns false when there is nothing to gain (not a JPEG, small image, fewer than 2 threads,
+// no restart markers at row starts, progressive or multi-scan JPEG) or when a strip fails to decode,
+// in which case the caller should decode the rest of the file with stb instead.
+
+bool
+decodeJpegInParallel( const MappedFile &file, unsigned nThreads, ProgressiveImage &image );
@@ -0,0 +1,587 @@
+#include "decodeJpegScaled.hpp"
+
+#include "ErrorString.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+  constexpr uint8_t zigzagToNatural[ 64 ]{
+      0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+      12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+      35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+      58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+
+  int
+  readU16( const unsigned char *p )
+  {
+    return ( p[ 0 ] << 8 ) | p[ 1 ];
+  }
+
+//==============================================================================
+
+  struct Huffman
+  {
+    static constexpr int fastBits = 9;
+
+    uint8_t fastLength[ 1 << fastBits ]{}; // 0: code longer than fastBits (or invalid)
+    uint8_t fastSymbol[ 1 << fastBits ]{};
+    int maxCode[ 17 ]{}, valuePtr[ 17 ]{}, minCode[ 17 ]{};
+    uint8_t symbols[ 256 ]{};
+
+    bool build( const uint8_t *counts, const uint8_t *values, int nValues )
+    {
+      if( nValues > 256 )
+        return false;
+      std::copy( values, values + nValues, symbols );
+
+      for( int length = 1, code = 0, k = 0; length <= 16; ++length, code <<= 1 )
+      {
+        valuePtr[ length ] = k;
+        minCode[ length ] = code;
+        for( int i = 0; i < counts[ length - 1 ]; ++i, ++code, ++k )
+        {
+          // over-subscribed: checked before the code is used, as it would index past the fast tables
+          if( code >= ( 1 << length ))
+            return false;
+
+          if( length <= fastBits )
+            for( int fill = code << ( fastBits - length ), end = ( code + 1 ) << ( fastBits - length ); fill < end; ++fill )
+            {
+              fastLength[ fill ] = (uint8_t)length;
+              fastSymbol[ fill ] = symbols[ k ];
+            }
+        }
+        maxCode[ length ] = counts[ length - 1 ] ? code - 1 : -1;
+      }
+
+      return true;
+    }
+  };
+
+  // entropy-coded data, MSB first, with stuffed zero bytes removed; reads zeros once it reaches a marker
+  struct BitReader
+  {
+    const unsigned char *p, *end;
+    uint64_t buffer{};
+    int count{};
+    bool atMarker{};
+
+    void fill()
+    {
+      while( count <= 56 )
+      {
+        unsigned byte = 0;
+        if( !atMarker && p < end )
+        {
+          if( byte = *p; byte != 0xff )
+            ++p;
+          else if( p + 1 < end && p[ 1 ] == 0x00 )
+            p += 2;
+          else
+          {
+            atMarker = true;
+            byte = 0;
+          }
+        }
+
+        buffer |= (uint64_t)byte << ( 56 - count );
+        count += 8;
+      }
+    }
+
+    unsigned getBits( int n )
+    {
+      if( n == 0 )
+        return 0;
+      if( count < n )
+        fill();
+
+      const unsigned bits = (unsigned)( buffer >> ( 64 - n ));
+      buffer <<= n;
+      count -= n;
+      return bits;
+    }
+
+    // the n-bit magnitude category's value, as in F.2.2.1 of the JPEG spec
+    int receiveExtend( int n )
+    {
+      const int v = (int)getBits( n );
+      return v < ( 1 << ( n - 1 )) ? v - ( 1 << n ) + 1 : v;
+    }
+
+    int decode( const Huffman &h )
+    {
+      if( count < 16 )
+        fill();
+
+      if( const unsigned peek = (unsigned)( buffer >> ( 64 - Huffman::fastBits )); h.fastLength[ peek ] )
+      {
+        const int length = h.fastLength[ peek ];
+        buffer <<= length;
+        count -= length;
+        return h.fastSymbol[ peek ];
+      }
+
+      for( int length = Huffman::fastBits + 1; length <= 16; ++length )
+        if( const int code = (int)( buffer >> ( 64 - length )); code <= h.maxCode[ length ] )
+        {
+          buffer <<= length;
+          count -= length;
+          return h.symbols[ h.valuePtr[ length ] + code - h.minCode[ length ]];
+        }
+
+      throw ErrorString( "scaled jpeg decode: invalid huffman code" );
+    }
+
+    // drops what's left of the interval and skips the restart marker after it
+    void restart()
+    {
+      buffer = 0;
+      count = 0;
+      atMarker = false;
+
+      for( ; p + 1 < end; ++p )
+        if( p[ 0 ] == 0xff && p[ 1 ] >= 0xd0 && p[ 1 ] <= 0xd7 )
+        {
+          p += 2;
+          return;
+        }
+    }
+  };
+
+//==============================================================================
+
+  struct Component
+  {
+    int id, h, v, quantTable;
+    int dcTable{}, acTable{};
+  };
+
+  struct Jpeg
+  {
+    int width{}, height{};
+    std::vector< Component > components;
+    int restartInterval{};
+    bool jfif{};
+    int adobeTransform = -1;
+
+    std::array< std::array< uint16_t, 64 >, 4 > quantTables{}; // zigzag order
+    std::array< Huffman, 4 > dcTables, acTables;
+
+    const unsigned char *entropyData{}, *end{};
+
+    int getOutChannels() const { return components.size() == 1 ? 1 : 3; }
+
+    // stb's rule: three components are RGB when named so, or when an Adobe marker says they aren't transformed
+    bool isYCbCr() const
+    {
+      const bool namedRgb = components[ 0 ].id == 'R' && components[ 1 ].id == 'G' && components[ 2 ].id == 'B';
+      return !namedRgb && !( adobeTransform == 0 && !jfif );
+    }
+  };
+
+  // nullopt for anything but an 8-bit baseline (or extended sequential) huffman JPEG with a single interleaved scan
+  std::optional< Jpeg >
+  parseJpeg( const MappedFile &file )
+  {
+    const unsigned char *bytes = file.data();
+    const std::size_t size = file.size();
+    if( size < 4 || bytes[ 0 ] != 0xff || bytes[ 1 ] != 0xd8 )
+      return std::nullopt;
+
+    Jpeg jpeg;
+    bool quantDefined[ 4 ]{}, dcDefined[ 4 ]{}, acDefined[ 4 ]{};
+
+    for( std::size_t pos = 2; ; )
+    {
+      while( pos + 1 < size && bytes[ pos ] == 0xff && bytes[ pos + 1 ] == 0xff )
+        ++pos; // fill bytes
+
+      if( pos + 4 > size || bytes[ pos ] != 0xff )
+        return std::nullopt;
+
+      const int marker = bytes[ pos + 1 ];
+      const std::size_t length = readU16( bytes + pos + 2 );
+      if( length < 2 || pos + 2 + length > size )
+        return std::nullopt;
+
+      const unsigned char *data = bytes + pos + 4, *dataEnd = bytes + pos + 2 + length;
+      pos += 2 + length;
+
+      switch( marker )
+      {
+        case 0xc0: // baseline
+        case 0xc1: // extended sequential, huffman
+        {
+          if( !jpeg.components.empty() || length < 8 || data[ 0 ] != 8 )
+            return std::nullopt;
+
+          jpeg.height = readU16( data + 1 );
+          jpeg.width = readU16( data + 3 );
+          const int nComponents = data[ 5 ];
+          if( jpeg.width == 0 || jpeg.height == 0 || ( nComponents != 1 && nComponents != 3 ) || length != 8u + 3u * nComponents )
+            return std::nullopt;
+
+          for( int c = 0; c < nComponents; ++c )
+          {
+            const unsigned char *spec = data + 6 + c * 3;
+            const Component component{ spec[ 0 ], spec[ 1 ] >> 4, spec[ 1 ] & 15, spec[ 2 ] };
+            if( component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quantTable > 3 )
+              return std::nullopt;
+            jpeg.components.push_back( component );
+          }
+
+          // each component's blocks are scaled by hMax / h and vMax / v, and there are only inverse DCTs for powers
+          // of two: stb decodes the rest (e.g. luma sampled 3x1)
+          int hMax = 1, vMax = 1;
+          for( const Component &c : jpeg.components )
+          {
+            hMax = std::max( hMax, c.h );
+            vMax = std::max( vMax, c.v );
+          }
+          auto isScaleSupported = []( int max, int factor ) { return max % factor == 0 && ( max / factor == 1 || max / factor == 2 || max / factor == 4 ); };
+          for( const Component &c : jpeg.components )
+            if( !isScaleSupported( hMax, c.h ) || !isScaleSupported( vMax, c.v ))
+              return std::nullopt;
+          break;
+        }
+
+        case 0xdb: // quantization tables
+          while( data < dataEnd )
+          {
+            const int precision = data[ 0 ] >> 4, id = data[ 0 ] & 15;
+            const std::size_t tableBytes = precision ? 128 : 64;
+            if( id > 3 || precision > 1 || data + 1 + tableBytes > dataEnd )
+              return std::nullopt;
+
+            for( int k = 0; k < 64; ++k )
+              jpeg.quantTables[ id ][ k ] = (uint16_t)( precision ? readU16( data + 1 + 2 * k ) : data[ 1 + k ] );
+            quantDefined[ id ] = true;
+            data += 1 + tableBytes;
+          }
+          break;
+
+        case 0xc4: // huffman tables
+          while( data < dataEnd )
+          {
+            if( data + 17 > dataEnd )
+              return std::nullopt;
+
+            const int tableClass = data[ 0 ] >> 4, id = data[ 0 ] & 15;
+            int nValues = 0;
+            for( int i = 0; i < 16; ++i )
+              nValues += data[ 1 + i ];
+            if( tableClass > 1 || id > 3 || data + 17 + nValues > dataEnd )
+              return std::nullopt;
+
+            Huffman &table = tableClass ? jpeg.acTables[ id ] : jpeg.dcTables[ id ];
+            if( !( table = Huffman{} ).build( data + 1, data + 17, nValues ))
+              return std::nullopt;
+            ( tableClass ? acDefined : dcDefined )[ id ] = true;
+            data += 17 + nValues;
+          }
+          break;
+
+        case 0xdd: // define restart interval
+          if( length != 4 )
+            return std::nullopt;
+          jpeg.restartInterval = readU16( data );
+          break;
+
+        case 0xe0:
+          jpeg.jfif = length >= 7 && std::equal( data, data + 5, "JFIF" );
+          break;
+
+        case 0xee:
+          if( length >= 14 && std::equal( data, data + 5, "Adobe" ))
+            jpeg.adobeTransform = data[ 11 ];
+          break;
+
+        case 0xda: // start of scan: all components interleaved in this one scan, and the whole spectrum
+        {
+          const int nComponents = length >= 3 ? data[ 0 ] : 0;
+          if( jpeg.components.empty() || nComponents != (int)jpeg.components.size() || length != 6u + 2u * nComponents )
+            return std::nullopt;
+
+          for( int i = 0; i < nComponents; ++i )
+          {
+            const unsigned char *spec = data + 1 + i * 2;
+            const auto component = std::find_if(
+                jpeg.components.begin(), jpeg.components.end(), [ & ]( const Component &c ) { return c.id == spec[ 0 ]; } );
+            if( component == jpeg.components.end())
+              return std::nullopt;
+
+            component->dcTable = spec[ 1 ] >> 4;
+            component->acTable = spec[ 1 ] & 15;
+            if( component->dcTable > 3 || component->acTable > 3
+                || !dcDefined[ component->dcTable ] || !acDefined[ component->acTable ] || !quantDefined[ component->quantTable ] )
+              return std::nullopt;
+          }
+
+          const unsigned char *spectral = data + 1 + nComponents * 2;
+          if( spectral[ 0 ] != 0 || spectral[ 1 ] != 63 || spectral[ 2 ] != 0 )
+            return std::nullopt;
+
+          jpeg.entropyData = bytes + pos;
+          jpeg.end = bytes + size;
+          return jpeg;
+        }
+
+        default:
+          if(( marker >= 0xe1 && marker <= 0xef ) || marker == 0xfe )
+            break; // other application data and comments
+
+          return std::nullopt; // progressive, arithmetic coding, 12-bit, hierarchical, ...
+      }
+    }
+  }
+
+//==============================================================================
+
+  // 0.5 * C(u) * cos((2i + 1) u pi / 2N): an N-point inverse DCT of the lowest N of the 8 coefficients,
+  // which is the full 8-point one sampled at the centre of each group of 8 / N pixels
+  struct ReducedIdct
+  {
+    int n;
+    float basis[ 8 ][ 8 ]{}; // [i][u]
+
+    explicit
+    ReducedIdct( int n )
+        : n{ n }
+    {
+      const double pi = 3.14159265358979323846;
+      for( int i = 0; i < n; ++i )
+        for( int u = 0; u < n; ++u )
+          basis[ i ][ u ] = (float)( 0.5 * ( u == 0 ? std::sqrt( 0.5 ) : 1.0 ) * std::cos(( 2 * i + 1 ) * u * pi / ( 2 * n )));
+    }
+  };
+
+  // coefficients are Across wide and Down high, row-major; writes as many samples, stride bytes apart.
+  // The sizes are template arguments so the loops are unrolled and vectorized.
+  template< int Across, int Down >
+  void
+  transform( const ReducedIdct &across, const ReducedIdct &down, const float *coefficients, unsigned char *out, std::size_t stride )
+  {
+    float rows[ Down ][ Across ]; // coefficient row v transformed horizontally: rows[v][x]
+    for( int v = 0; v < Down; ++v )
+      for( int x = 0; x < Across; ++x )
+      {
+        float sum = 0;
+        for( int u = 0; u < Across; ++u )
+          sum += across.basis[ x ][ u ] * coefficients[ v * Across + u ];
+        rows[ v ][ x ] = sum;
+      }
+
+    for( int y = 0; y < Down; ++y )
+      for( int x = 0; x < Across; ++x )
+      {
+        float sum = 128.5f;
+        for( int v = 0; v < Down; ++v )
+          sum += down.basis[ y ][ v ] * rows[ v ][ x ];
+        out[ y * stride + x ] = (unsigned char)std::clamp( sum, 0.f, 255.f );
+      }
+  }
+
+  using Transform = void ( * )( const ReducedIdct &, const ReducedIdct &, const float *, unsigned char *, std::size_t );
+
+  // sizes are 1, 2, 4 or 8
+  Transform
+  getTransform( int across, int down )
+  {
+    constexpr Transform transforms[ 4 ][ 4 ]{ // [log2 down][log2 across]
+        { transform< 1, 1 >, transform< 2, 1 >, transform< 4, 1 >, transform< 8, 1 > },
+        { transform< 1, 2 >, transform< 2, 2 >, transform< 4, 2 >, transform< 8, 2 > },
+        { transform< 1, 4 >, transform< 2, 4 >, transform< 4, 4 >, transform< 8, 4 > },
+        { transform< 1, 8 >, transform< 2, 8 >, transform< 4, 8 >, transform< 8, 8 > }};
+
+    auto log2 = []( int size ) { return size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3; };
+    return transforms[ log2( down ) ][ log2( across ) ];
+  }
+
+  // One component's samples, whole blocks of them. Subsampled chroma keeps more of its coefficients
+  // (up to all 8) than luma does, so that it comes out at (nearly) the same scale and needs no upsampling.
+  struct Plane
+  {
+    int blockWidth{}, blockHeight{}; // samples per block: the sizes of the inverse DCT
+    int width{}, height{};
+    std::vector< unsigned char > samples;
+  };
+} // namespace
+
+//==============================================================================
+
+std::optional< ScaledJpeg >
+chooseJpegScale( const MappedFile &file, int minWidth, int minHeight )
+{
+  const std::optional< Jpeg > jpeg = parseJpeg( file );
+  if( !jpeg )
+    return std::nullopt;
+
+  for( const int scale : { 8, 4, 2 } )
+    if( const int width = ( jpeg->width + scale - 1 ) / scale, height = ( jpeg->height + scale - 1 ) / scale;
+        width >= minWidth && height >= minHeight )
+      return ScaledJpeg{ scale, { width, height, jpeg->getOutChannels() }};
+
+  return std::nullopt;
+}
+
+bool
+decodeJpegScaled( const MappedFile &file, const ScaledJpeg &scaled, unsigned char *pixels, const std::atomic< bool > *cancelled )
+{
+  const std::optional< Jpeg > parsed = parseJpeg( file );
+  if( !parsed )
+    throw ErrorString( "scaled jpeg decode: unsupported file" );
+  const Jpeg &jpeg = *parsed;
+
+  const int n = 8 / scaled.scale; // luma samples per block side
+
+  int hMax = 1, vMax = 1;
+  for( const Component &c : jpeg.components )
+  {
+    hMax = std::max( hMax, c.h );
+    vMax = std::max( vMax, c.v );
+  }
+
+  // a single component is coded non-interleaved: one block per MCU whatever its sampling factors
+  const bool interleaved = jpeg.components.size() > 1;
+  const int mcuWidth = interleaved ? 8 * hMax : 8, mcuHeight = interleaved ? 8 * vMax : 8;
+  const int mcusPerRow = ( jpeg.width + mcuWidth - 1 ) / mcuWidth;
+  const int mcuRows = ( jpeg.height + mcuHeight - 1 ) / mcuHeight;
+
+  std::vector< Plane > planes( jpeg.components.size());
+  for( std::size_t c = 0; c < planes.size(); ++c )
+  {
+    const Component &component = jpeg.components[ c ];
+    const int blocksWide = interleaved ? component.h : 1, blocksHigh = interleaved ? component.v : 1;
+    Plane &plane = planes[ c ];
+    plane.blockWidth = interleaved ? std::min( 8, n * hMax / component.h ) : n;
+    plane.blockHeight = interleaved ? std::min( 8, n * vMax / component.v ) : n;
+    plane.width = mcusPerRow * blocksWide * plane.blockWidth;
+    plane.height = mcuRows * blocksHigh * plane.blockHeight;
+    plane.samples.resize( (std::size_t)plane.width * plane.height );
+  }
+
+  const ReducedIdct idcts[ 9 ]{
+      ReducedIdct{ 0 }, ReducedIdct{ 1 }, ReducedIdct{ 2 }, ReducedIdct{ 0 }, ReducedIdct{ 4 },
+      ReducedIdct{ 0 }, ReducedIdct{ 0 }, ReducedIdct{ 0 }, ReducedIdct{ 8 }}; // by size
+
+  BitReader reader{ jpeg.entropyData, jpeg.end };
+  std::vector< int > dcPredictions( jpeg.components.size());
+  float coefficients[ 64 ];
+
+  for( int mcu = 0, nMcus = mcusPerRow * mcuRows; mcu < nMcus; ++mcu )
+  {
+    if( jpeg.restartInterval && mcu > 0 && mcu % jpeg.restartInterval == 0 )
+    {
+      reader.restart();
+      std::fill( dcPredictions.begin(), dcPredictions.end(), 0 );
+    }
+
+    const int mcuX = mcu % mcusPerRow, mcuY = mcu / mcusPerRow;
+    if( mcuX == 0 && cancelled && cancelled->load( std::memory_order_relaxed ))
+      return false;
+
+    for( std::size_t c = 0; c < jpeg.components.size(); ++c )
+    {
+      const Component &component = jpeg.components[ c ];
+      const auto &quant = jpeg.quantTables[ component.quantTable ];
+      const Huffman &dcTable = jpeg.dcTables[ component.dcTable ], &acTable = jpeg.acTables[ component.acTable ];
+      const int blocksWide = interleaved ? component.h : 1, blocksHigh = interleaved ? component.v : 1;
+      Plane &plane = planes[ c ];
+      const ReducedIdct &across = idcts[ plane.blockWidth ], &down = idcts[ plane.blockHeight ];
+      const Transform transformBlock = getTransform( plane.blockWidth, plane.blockHeight );
+
+      for( int by = 0; by < blocksHigh; ++by )
+        for( int bx = 0; bx < blocksWide; ++bx )
+        {
+          std::fill( coefficients, coefficients + plane.blockWidth * plane.blockHeight, 0.f );
+
+          const int dcCategory = reader.decode( dcTable );
+          if( dcCategory > 11 )
+            throw ErrorString( "scaled jpeg decode: bad DC coefficient" );
+          dcPredictions[ c ] += dcCategory ? reader.receiveExtend( dcCategory ) : 0;
+          coefficients[ 0 ] = (float)( dcPredictions[ c ] * quant[ 0 ] );
+
+          // every AC coefficient has to be decoded to find the next block, but only the low ones are kept
+          for( int k = 1; k < 64; )
+          {
+            const int runSize = reader.decode( acTable );
+            const int run = runSize >> 4, size = runSize & 15;
+            if( size == 0 )
+            {
+              if( run != 15 )
+                break; // end of block
+              k += 16;
+              continue;
+            }
+
+            if( k += run; k > 63 )
+              throw ErrorString( "scaled jpeg decode: bad AC coefficient" );
+
+            const int natural = zigzagToNatural[ k ];
+            if( const int u = natural % 8, v = natural / 8; u < plane.blockWidth && v < plane.blockHeight )
+              coefficients[ v * plane.blockWidth + u ] = (float)( reader.receiveExtend( size ) * quant[ k ] );
+            else
+              reader.getBits( size );
+            ++k;
+          }
+
+          const int x = ( mcuX * blocksWide + bx ) * plane.blockWidth, y = ( mcuY * blocksHigh + by ) * plane.blockHeight;
+          transformBlock( across, down, coefficients, plane.samples.data() + (std::size_t)y * plane.width + x, plane.width );
+        }
+    }
+  }
+
+  // colour conversion, upsampling by replication what chroma is still subsampled
+  const int outWidth = scaled.dimensions.width, outHeight = scaled.dimensions.height;
+  const int nOut = scaled.dimensions.nChannels;
+
+  if( nOut == 1 )
+  {
+    for( int y = 0; y < outHeight; ++y )
+      std::copy_n( planes[ 0 ].samples.data() + (std::size_t)y * planes[ 0 ].width, outWidth, pixels + (std::size_t)y * outWidth );
+    return true;
+  }
+
+  const bool yCbCr = jpeg.isYCbCr();
+  std::vector< int > columns[ 3 ];
+  for( int c = 0; c < 3; ++c )
+  {
+    columns[ c ].resize( outWidth );
+    for( int x = 0; x < outWidth; ++x )
+      columns[ c ][ x ] = x * jpeg.components[ c ].h * planes[ c ].blockWidth / ( hMax * n );
+  }
+
+  for( int y = 0; y < outHeight; ++y )
+  {
+    const unsigned char *rows[ 3 ];
+    for( int c = 0; c < 3; ++c )
+      rows[ c ] = planes[ c ].samples.data()
+          + (std::size_t)( y * jpeg.components[ c ].v * planes[ c ].blockHeight / ( vMax * n )) * planes[ c ].width;
+
+    unsigned char *out = pixels + (std::size_t)y * outWidth * 3;
+    for( int x = 0; x < outWidth; ++x, out += 3 )
+    {
+      const float a = rows[ 0 ][ columns[ 0 ][ x ]], b = rows[ 1 ][ columns[ 1 ][ x ]], c = rows[ 2 ][ columns[ 2 ][ x ]];
+      if( !yCbCr )
+      {
+        out[ 0 ] = (unsigned char)a;
+        out[ 1 ] = (unsigned char)b;
+        out[ 2 ] = (unsigned char)c;
+        continue;
+      }
+
+      const float cb = b - 128, cr = c - 128;
+      out[ 0 ] = (unsigned char)std::clamp( a + 1.402f * cr + 0.5f, 0.f, 255.f );
+      out[ 1 ] = (unsigned char)std::clamp( a - 0.344136f * cb - 0.714136f * cr + 0.5f, 0.f, 255.f );
+      out[ 2 ] = (unsigned char)std::clamp( a + 1.772f * cb + 0.5f, 0.f, 255.f );
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ImageDimensions.hpp"
+#include "MappedFile.hpp"
+
+#include <atomic>
+#include <optional>
+
+// Decodes a baseline JPEG at 1/2, 1/4 or 1/8 of its size in the DCT domain: only the lowest 4x4, 2x2 or 1x1
+// coefficients of each block are kept and transformed by a correspondingly smaller inverse DCT,
+// so most of the IDCT work (and most of the memory) of a full decode is never spent.
+// Subsampled chroma keeps correspondingly more of its coefficients, so it comes out at the same scale as luma
+// (only chroma subsampled by more than the scale itself, like 4:1:1 at 1/2, still needs upsampling, by replication).
+
+struct ScaledJpeg
+{
+  int scale; // 2, 4 or 8
+  ImageDimensions dimensions; // once scaled; nChannels as stbi_load with req_comp = 0
+};
+
+// The smallest scale at which the image is still at least minWidth by minHeight.
+// nullopt when the file isn't a JPEG this decoder handles (progressive, arithmetic coded, CMYK, 12-bit, ...)
+// or when nothing short of full size would do.
+std::optional< ScaledJpeg >
+chooseJpegScale( const MappedFile &file, int minWidth, int minHeight );
+
+// pixels must have room for scaled.dimensions; rows are width * nChannels bytes apart.
+// Returns false, with pixels unfinished, when cancelled is set (checked every row of MCUs).
+bool
+decodeJpegScaled( const MappedFile &file, const ScaledJpeg &scaled, unsigned char *pixels,
+                  const std::atomic< bool > *cancelled = nullptr )
+noexcept( false ); // throws ErrorString if the data is corrupt
@@ -0,0 +1,442 @@
+#include "decodePngPipelined.hpp"
+
+#include "Destroyer.hpp"
+#include "ErrorString.hpp"
+#include "Inflater.hpp"
+#include "Mutexed.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace
+{
+  constexpr unsigned char pngSignature[ 8 ]{ 137, 80, 78, 71, 13, 10, 26, 10 };
+
+  // below this many pixels a second thread costs more than it saves
+  constexpr long long minPixels = 1 << 20;
+
+  constexpr std::size_t batchBytes = 1 << 18;
+  constexpr std::size_t maxQueuedBatches = 4;
+
+  uint32_t
+  readU32( const unsigned char *p )
+  {
+    return ( uint32_t( p[ 0 ] ) << 24 ) | ( uint32_t( p[ 1 ] ) << 16 ) | ( uint32_t( p[ 2 ] ) << 8 ) | p[ 3 ];
+  }
+
+  bool
+  isChunk( const unsigned char *type, const char *name )
+  {
+    return std::memcmp( type, name, 4 ) == 0;
+  }
+
+//==============================================================================
+
+  struct PngInfo
+  {
+    int width{}, height{}, bitDepth{}, colorType{};
+    int nSamples{}; // per pixel, in the file
+    std::vector< std::span< const unsigned char >> idats;
+    std::span< const unsigned char > palette, transparency;
+
+    std::size_t getRowBytes() const { return ((std::size_t)width * nSamples * bitDepth + 7 ) / 8; }
+    int getFilterStride() const { return std::max( 1, nSamples * bitDepth / 8 ); }
+
+    // channels produced, the same as stbi_load would with req_comp = 0
+    int getOutChannels() const
+    {
+      switch( colorType )
+      {
+        case 0: return transparency.empty() ? 1 : 2;
+        case 2: return transparency.empty() ? 3 : 4;
+        case 3: return transparency.empty() ? 3 : 4;
+        default: return nSamples;
+      }
+    }
+  };
+
+  std::optional< PngInfo >
+  parsePng( const MappedFile &file )
+  {
+    const unsigned char *bytes = file.data();
+    const std::size_t size = file.size();
+
+    if( size < 8 || std::memcmp( bytes, pngSignature, 8 ) != 0 )
+      return std::nullopt;
+
+    PngInfo png;
+    bool haveHeader = false, interlaced = false;
+
+    for( std::size_t pos = 8; pos + 12 <= size; )
+    {
+      const std::size_t length = readU32( bytes + pos );
+      const unsigned char *type = bytes + pos + 4;
+      const unsigned char *data = bytes + pos + 8;
+      if( length > size - pos - 12 )
+        return std::nullopt; // truncated: let stb report it
+
+      pos += 12 + length;
+
+      if( isChunk( type, "IHDR" ))
+      {
+        if( length != 13 )
+          return std::nullopt;
+
+        png.width = (int)readU32( data );
+        png.height = (int)readU32( data + 4 );
+        png.bitDepth = data[ 8 ];
+        png.colorType = data[ 9 ];
+        interlaced = data[ 12 ] != 0;
+        haveHeader = data[ 10 ] == 0 && data[ 11 ] == 0;
+      }
+      else if( isChunk( type, "PLTE" ))
+        png.palette = { data, length };
+      else if( isChunk( type, "tRNS" ))
+        png.transparency = { data, length };
+      else if( isChunk( type, "IDAT" ))
+        png.idats.emplace_back( data, length );
+      else if( isChunk( type, "IEND" ))
+        break;
+      else if( !( type[ 0 ] & 0x20 ))
+        return std::nullopt; // unknown critical chunk (or Apple's CgBI)
+    }
+
+    if( !haveHeader || interlaced || png.idats.empty())
+      return std::nullopt;
+
+    if( png.width <= 0 || png.height <= 0 || png.width > ( 1 << 24 ) || png.height > ( 1 << 24 ))
+      return std::nullopt;
+
+    switch( png.colorType )
+    {
+      case 0: png.nSamples = 1; break;
+      case 2: png.nSamples = 3; break;
+      case 3: png.nSamples = 1; break;
+      case 4: png.nSamples = 2; break;
+      case 6: png.nSamples = 4; break;
+      default: return std::nullopt;
+    }
+
+    const int d = png.bitDepth;
+    const bool validDepth =
+        png.colorType == 0 ? ( d == 1 || d == 2 || d == 4 || d == 8 || d == 16 ) :
+        png.colorType == 3 ? ( d == 1 || d == 2 || d == 4 || d == 8 ) :
+        ( d == 8 || d == 16 );
+    if( !validDepth )
+      return std::nullopt;
+
+    if( png.colorType == 3 && ( png.palette.empty() || png.palette.size() % 3 || png.palette.size() > 768 ))
+      return std::nullopt;
+
+    if( !png.transparency.empty())
+    {
+      const std::size_t expected = png.colorType == 0 ? 2 : png.colorType == 2 ? 6 : 0;
+      if( png.colorType == 3 ? png.transparency.size() > 256 : png.transparency.size() != expected )
+        return std::nullopt;
+    }
+
+    return png;
+  }
+
+//==============================================================================
+
+  // undoes the per-scanline filter in place; prev is the previous unfiltered row (all zeros for the first)
+  void
+  unfilterRow( int filter, unsigned char *row, const unsigned char *prev, std::size_t rowBytes, int stride )
+  {
+    switch( filter )
+    {
+      case 0:
+        break;
+
+      case 1: // sub
+        for( std::size_t i = stride; i < rowBytes; ++i )
+          row[ i ] += row[ i - stride ];
+        break;
+
+      case 2: // up
+        for( std::size_t i = 0; i < rowBytes; ++i )
+          row[ i ] += prev[ i ];
+        break;
+
+      case 3: // average
+        for( int i = 0; i < stride; ++i )
+          row[ i ] += prev[ i ] >> 1;
+        for( std::size_t i = stride; i < rowBytes; ++i )
+          row[ i ] += ( row[ i - stride ] + prev[ i ] ) >> 1;
+        break;
+
+      case 4: // paeth
+        for( std::size_t i = 0; i < rowBytes; ++i )
+        {
+          const int a = i >= (std::size_t)stride ? row[ i - stride ] : 0;
+          const int b = prev[ i ];
+          const int c = i >= (std::size_t)stride ? prev[ i - stride ] : 0;
+          const int p = a + b - c;
+          const int pa = std::abs( p - a ), pb = std::abs( p - b ), pc = std::abs( p - c );
+          row[ i ] += ( pa <= pb && pa <= pc ) ? a : ( pb <= pc ) ? b : c;
+        }
+        break;
+
+      default:
+        throw ErrorString( "png: invalid filter type ", filter );
+    }
+  }
+
+//==============================================================================
+
+  // converts one unfiltered row to the 8-bit output layout
+  struct RowConverter
+  {
+    const PngInfo &png;
+    const int outChannels = png.getOutChannels();
+    unsigned char paletteRgba[ 256 ][ 4 ]{};
+    uint16_t transparentSample[ 3 ]{};
+
+    explicit
+    RowConverter( const PngInfo &png )
+        : png{ png }
+    {
+      for( auto &entry : paletteRgba )
+        entry[ 3 ] = 255;
+
+      for( std::size_t i = 0; i < png.palette.size() / 3; ++i )
+        std::memcpy( paletteRgba[ i ], png.palette.data() + i * 3, 3 );
+
+      if( png.colorType == 3 )
+        for( std::size_t i = 0; i < png.transparency.size(); ++i )
+          paletteRgba[ i ][ 3 ] = png.transparency[ i ];
+      else
+        for( std::size_t i = 0; i < png.transparency.size() / 2; ++i )
+          transparentSample[ i ] = (uint16_t)(( png.transparency[ i * 2 ] << 8 ) | png.transparency[ i * 2 + 1 ] );
+    }
+
+    // raw sample value as stored in the file (not scaled to 8 bits)
+    uint32_t sample( const unsigned char *row, std::size_t index ) const
+    {
+      switch( png.bitDepth )
+      {
+        case 16: return ( row[ index * 2 ] << 8 ) | row[ index * 2 + 1 ];
+        case 8: return row[ index ];
+        default:
+        {
+          const std::size_t bit = index * png.bitDepth;
+          const int shift = 8 - png.bitDepth - (int)( bit % 8 );
+          return ( row[ bit / 8 ] >> shift ) & (( 1 << png.bitDepth ) - 1 );
+        }
+      }
+    }
+
+    unsigned char to8Bits( uint32_t value ) const
+    {
+      switch( png.bitDepth )
+      {
+        case 16: return (unsigned char)( value >> 8 );
+        case 4: return (unsigned char)( value * 0x11 );
+        case 2: return (unsigned char)( value * 0x55 );
+        case 1: return (unsigned char)( value * 0xff );
+        default: return (unsigned char)value;
+      }
+    }
+
+    void operator()( const unsigned char *row, unsigned char *out ) const
+    {
+      const std::size_t width = png.width;
+
+      if( png.bitDepth == 8 && png.colorType != 3 && png.transparency.empty())
+      {
+        std::memcpy( out, row, width * png.nSamples );
+        return;
+      }
+
+      if( png.colorType == 3 )
+      {
+        for( std::size_t x = 0; x < width; ++x, out += outChannels )
+          std::memcpy( out, paletteRgba[ sample( row, x ) ], outChannels );
+        return;
+      }
+
+      const bool hasTransparency = !png.transparency.empty();
+      for( std::size_t x = 0; x < width; ++x )
+      {
+        bool transparent = hasTransparency;
+        for( int s = 0; s < png.nSamples; ++s )
+        {
+          const uint32_t v = sample( row, x * png.nSamples + s );
+          transparent = transparent && v == transparentSample[ s ];
+          *out++ = to8Bits( v );
+        }
+
+        if( hasTransparency )
+          *out++ = transparent ? 0 : 255;
+      }
+    }
+  };
+
+//==============================================================================
+
+  struct FilteredBatches
+  {
+    std::deque< std::vector< unsigned char >> batches;
+    bool finished{}; // set by the inflating thread when it stops for any reason
+    bool cancelled{}; // set by the unfiltering thread when it stops early
+  };
+} // namespace
+
+bool
+decodePngPipelined( const MappedFile &file, unsigned nThreads, ProgressiveImage &image )
+{
+  const std::optional< PngInfo > parsed = parsePng( file );
+  if( !parsed || nThreads < 2 || (long long)parsed->width * parsed->height < minPixels )
+    return false;
+
+  const PngInfo &png = *parsed;
+  if( const ImageDimensions d = image.getDimensions();
+      d.width != png.width || d.height != png.height || d.nChannels != png.getOutChannels())
+    return false;
+
+  const std::size_t rowBytes = png.getRowBytes();
+  const std::size_t filteredRowBytes = rowBytes + 1; // each row starts with its filter type
+  const int batchRows = (int)std::max< std::size_t >( 1, batchBytes / filteredRowBytes );
+
+  Mutexed< FilteredBatches > queue;
+
+  auto inflated = std::async(
+      std::launch::async,
+      [ & ]
+      {
+        Destroyer markFinished{
+            [ & ] { queue.withLockThenNotify( []( FilteredBatches &q ) { q.finished = true; } ); }};
+
+        std::size_t nextIdat = 0;
+        Inflater inflater{
+            [ & ]() -> std::span< const unsigned char >
+            { return nextIdat < png.idats.size() ? png.idats[ nextIdat++ ] : std::span< const unsigned char >{}; }};
+
+        for( int y = 0; y < png.height; y += batchRows )
+        {
+          std::vector< unsigned char > batch( std::min( batchRows, png.height - y ) * filteredRowBytes );
+          inflater.read( batch.data(), batch.size());
+
+          const bool cancelled = queue.waitThenNotify(
+              []( const FilteredBatches &q ) { return q.batches.size() < maxQueuedBatches || q.cancelled; },
+              [ & ]( FilteredBatches &q )
+              {
+                if( !q.cancelled )
+                  q.batches.push_back( std::move( batch ));
+                return q.cancelled;
+              } );
+
+          if( cancelled )
+            return;
+        }
+      } );
+
+  // declared after inflated so that it runs first: lets the inflating thread stop before inflated's destructor waits for it
+  Destroyer cancelInflating{
+      [ & ] { queue.withLockThenNotify( []( FilteredBatches &q ) { q.cancelled = true; } ); }};
+
+  const RowConverter convert{ png };
+  const int stride = png.getFilterStride();
+  std::vector< unsigned char > lastRowOfBatch( rowBytes, 0 );
+  const std::size_t outRowBytes = image.getRowBytes();
+  unsigned char *out = image.allocatePixels();
+  int y = 0;
+
+  for( ;; )
+  {
+    std::vector< unsigned char > batch = queue.waitThenNotify(
+        []( const FilteredBatches &q ) { return !q.batches.empty() || q.finished; },
+        []( FilteredBatches &q )
+        {
+          std::vector< unsigned char > front;
+          if( !q.batches.empty())
+          {
+            front = std::move( q.batches.front());
+            q.batches.pop_front();
+          }
+          return front;
+        } );
+
+    if( batch.empty() || image.isCancelled())
+      break;
+
+    // rows are unfiltered in place; each one refers to the row above it
+    const unsigned char *previousRow = lastRowOfBatch.data();
+    for( std::size_t offset = 0; offset < batch.size(); offset += filteredRowBytes, ++y )
+    {
+      unsigned char *row = batch.data() + offset + 1;
+      unfilterRow( batch[ offset ], row, previousRow, rowBytes, stride );
+      convert( row, out );
+      out += outRowBytes;
+      previousRow = row;
+    }
+    std::memcpy( lastRowOfBatch.data(), previousRow, rowBytes );
+
+    image.publishRows( (int)( batch.size() / filteredRowBytes ));
+  }
+
+  if( image.isCancelled())
+    return false;
+
+  inflated.get(); // rethrows anything from the inflating thread
+
+  if( y != png.height )
+    throw ErrorString( "png: image data ended early" );
+
+  return true;
+}
+
+bool
+decodePngInStrips( const MappedFile &file, int stripRows, const PngStripConsumer &onStrip )
+{
+  const std::optional< PngInfo > parsed = parsePng( file );
+  if( !parsed )
+    return false;
+
+  const PngInfo &png = *parsed;
+  const ImageDimensions dimensions{ png.width, png.height, png.getOutChannels() };
+
+  std::size_t nextIdat = 0;
+  Inflater inflater{
+      [ & ]() -> std::span< const unsigned char >
+      { return nextIdat < png.idats.size() ? png.idats[ nextIdat++ ] : std::span< const unsigned char >{}; }};
+
+  const RowConverter convert{ png };
+  const int stride = png.getFilterStride();
+  const std::size_t rowBytes = png.getRowBytes();
+  const std::size_t filteredRowBytes = rowBytes + 1; // each row starts with its filter type
+  const std::size_t outRowBytes = (std::size_t)dimensions.width * dimensions.nChannels;
+
+  std::vector< unsigned char > filtered( filteredRowBytes * stripRows ), strip( outRowBytes * stripRows );
+  std::vector< unsigned char > previousRow( rowBytes, 0 );
+
+  for( int y = 0; y < png.height; y += stripRows )
+  {
+    const int nRows = std::min( stripRows, png.height - y );
+    inflater.read( filtered.data(), nRows * filteredRowBytes );
+
+    // rows are unfiltered in place; each one refers to the row above it
+    const unsigned char *above = previousRow.data();
+    for( int i = 0; i < nRows; ++i )
+    {
+      unsigned char *row = filtered.data() + i * filteredRowBytes + 1;
+      unfilterRow( row[ -1 ], row, above, rowBytes, stride );
+      convert( row, strip.data() + i * outRowBytes );
+      above = row;
+    }
+    std::memcpy( previousRow.data(), above, rowBytes );
+
+    if( !onStrip( dimensions, y, nRows, strip.data()))
+      return false;
+  }
+
+  return true;
+}
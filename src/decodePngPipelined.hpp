@@ -0,0 +1,34 @@
+#pragma once
+
+#include "ImageDimensions.hpp"
+#include "MappedFile.hpp"
+#include "ProgressiveImage.hpp"
+
+#include <functional>
+
+// Decodes a PNG with inflating and unfiltering overlapped on two threads:
+// one thread inflates the IDAT stream into batches of filtered scanlines
+// while the calling thread unfilters them row by row and converts them to 8-bit pixels
+// (same channel layout as stbi_load with req_comp = 0), publishing them to image batch by batch.
+//
+// Returns false when there is nothing to gain (not a PNG, small image, fewer than 2 threads)
+// or when the file uses something this decoder leaves to stb (interlacing, Apple CgBI, unusual chunks).
+
+bool
+decodePngPipelined( const MappedFile &file, unsigned nThreads, ProgressiveImage &image )
+noexcept( false ); // throws ErrorString if the image data is corrupt
+
+// Decodes a PNG to the same 8-bit pixels, but on the calling thread, strip by strip: each strip of up to stripRows rows
+// is handed to onStrip as soon as it's done, and then overwritten by the next one, so only a strip, the row above it
+// and the inflater's 32 KiB window are ever held however big the image (a 30000x30000 RGBA one needs 3.6 GB whole).
+// onStrip may change the rows in place, and returns false to stop decoding early.
+//
+// Returns false, without calling onStrip, for the files decodePngPipelined leaves to stb,
+// and when onStrip stopped it.
+
+using PngStripConsumer =
+    std::function< bool( const ImageDimensions &, int firstRow, int nRows, unsigned char *rows ) >; // rows are packed
+
+bool
+decodePngInStrips( const MappedFile &file, int stripRows, const PngStripConsumer &onStrip )
+noexcept( false ); // throws ErrorString if the image data is corrupt
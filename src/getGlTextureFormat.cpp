@@ -0,0 +1,66 @@
+#include "getGlTextureFormat.hpp"
+
+#include <algorithm>
+#include <bit>
+
+GlTextureFormat
+getGlTextureFormat( const ImageDimensions &dimensions )
+{
+  const int channelIndex = dimensions.nChannels - 1;
+  const GLenum formatByNumChannels[ 4 ]{ GL_RED, GL_RG, GL_RGB, GL_RGBA };
+  const GLenum format = formatByNumChannels[ channelIndex ];
+  const std::size_t paddedChannels = dimensions.nChannels == 3 ? 4 : dimensions.nChannels;
+
+  switch( dimensions.channelType )
+  {
+    case ChannelType::uint16:
+    {
+      const GLenum internalFormats[ 4 ]{ GL_R16, GL_RG16, GL_RGB16, GL_RGBA16 };
+      const char *names[ 4 ]{ "R16", "RG16", "RGB16", "RGBA16" };
+      return { internalFormats[ channelIndex ], format, GL_UNSIGNED_SHORT, paddedChannels * 2, names[ channelIndex ] };
+    }
+    case ChannelType::float16:
+    {
+      const GLenum internalFormats[ 4 ]{ GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F };
+      const char *names[ 4 ]{ "R16F", "RG16F", "RGB16F", "RGBA16F" };
+      return { internalFormats[ channelIndex ], format, GL_HALF_FLOAT, paddedChannels * 2, names[ channelIndex ] };
+    }
+    default:
+    {
+      const GLenum internalFormats[ 4 ]{ GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+      const char *names[ 4 ]{ "R8", "RG8", "RGB8", "RGBA8" };
+      return { internalFormats[ channelIndex ], format, GL_UNSIGNED_BYTE, paddedChannels, names[ channelIndex ] };
+    }
+  }
+}
+
+int
+getNumMipmapLevels( int width, int height )
+{
+  return std::bit_width((unsigned)std::max( width, height ));
+}
+
+void
+allocateTextureStorage( const GlTextureFormat &textureFormat, int width, int height, int levels )
+{
+  if( GLEW_ARB_texture_storage || GLEW_VERSION_4_2 )
+    glTexStorage2D( GL_TEXTURE_2D, levels, textureFormat.internalFormat, width, height );
+  else
+  {
+    glTexImage2D( GL_TEXTURE_2D, 0, textureFormat.internalFormat, width, height, 0, textureFormat.format, textureFormat.type, nullptr );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1 );
+  }
+}
+
+void
+setGreySwizzle( int nChannels )
+{
+  if( nChannels == 1 || nChannels == 2 )
+  {
+    GLint swizzleMask[2][4]{
+        { GL_RED, GL_RED, GL_RED, GL_ONE },
+        { GL_RED, GL_RED, GL_RED, GL_GREEN }};
+
+    glTexParameteriv( GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzleMask[ nChannels - 1 ] );
+  }
+}
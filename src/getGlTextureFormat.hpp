@@ -0,0 +1,36 @@
+#pragma once
+
+#include "ImageDimensions.hpp"
+
+#define GL_SILENCE_DEPRECATION // MacOS has deprecated OpenGL - it still works up to 4.1 for now
+#include <gl/glew.h>
+
+#include <cstddef>
+
+// How an image's pixels go into a texture: with only the image's channels (GL_R8 for grey, GL_RG8 for grey and
+// alpha, GL_RGB8 or GL_RGBA8), of the image's channel type; 1 and 2 channel images are swizzled to grey (and alpha),
+// see setGreySwizzle(..)
+
+struct GlTextureFormat
+{
+  GLenum internalFormat; // sized, e.g. GL_RG8, GL_RGBA16 or GL_RGB16F
+  GLenum format, type; // of the pixels uploaded
+  std::size_t texelBytes; // in the texture, counting RGB as padded to RGBA, as most GPUs store it
+  const char *name; // of the internal format, for logs
+};
+
+GlTextureFormat
+getGlTextureFormat( const ImageDimensions & );
+
+// all the levels of a mipmap down to 1 by 1
+int
+getNumMipmapLevels( int width, int height );
+
+// Storage for the texture bound to GL_TEXTURE_2D: immutable (glTexStorage2D) where there is ARB_texture_storage,
+// otherwise just level 0, with glGenerateMipmap(..) making the rest
+void
+allocateTextureStorage( const GlTextureFormat &, int width, int height, int levels );
+
+// for the texture bound to GL_TEXTURE_2D
+void
+setGreySwizzle( int nChannels );
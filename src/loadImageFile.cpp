@@ -1,36 +1,257 @@
+#include "Destroyer.hpp"
 #include "ErrorString.hpp"
+#include "MappedFile.hpp"
+#include "PreviewCache.hpp"
+#include "convertPixels.hpp"
+#include "decodeJpegInParallel.hpp"
+#include "decodeJpegScaled.hpp"
+#include "decodePngPipelined.hpp"
+#include "halfFloat.hpp"
 #include "loadImageFile.hpp"
 
 #include <stb_image.h>
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <thread>
+
 namespace
 {
-  struct RawImage : IRawImage, ImageDimensions
+  // PNGs bigger than this decoded are streamed into a preview to fit, deferring their full decode like a JPEG's:
+  // below it, decoding the whole file twice when it's zoomed into costs more than holding it
+  constexpr std::size_t minStreamedPngBytes = 256 << 20;
+
+  // rows decoded at a time when streaming
+  constexpr int stripRows = 64;
+
+  void
+  checkSize( const MappedFile &file, const char *filename )
   {
-    stbi_uc *pixels{};
+    if( file.size() > INT_MAX )
+      throw ErrorString( "failed to load image from file ", filename, "\n",
+                         "because: file is too large (", file.size(), " bytes)" );
+  }
 
-    explicit
-    RawImage( const char *filename )
-    : pixels{ stbi_load( filename, &width, &height, &nChannels, 0 )}
+  // stb's decoder for the image's channel type: half floats are decoded as floats, see decodeWithStb(..);
+  // nullptr on failure, otherwise to be freed with stbi_image_free
+  void *
+  loadWithStb( const MappedFile &file, ChannelType channelType, ImageDimensions &decoded )
+  {
+    switch( channelType )
     {
-      if( !pixels )
-        throw ErrorString( "failed to load image from file ", filename, "\n",
-                           "because: ", stbi_failure_reason());
+      case ChannelType::uint16:
+        return stbi_load_16_from_memory( file.data(), (int)file.size(), &decoded.width, &decoded.height, &decoded.nChannels, 0 );
+      case ChannelType::float16:
+        return stbi_loadf_from_memory( file.data(), (int)file.size(), &decoded.width, &decoded.height, &decoded.nChannels, 0 );
+      default:
+        return stbi_load_from_memory( file.data(), (int)file.size(), &decoded.width, &decoded.height, &decoded.nChannels, 0 );
     }
+  }
+
+  void
+  decodeWithStb( const MappedFile &file, const char *filename, ProgressiveImage &image )
+  {
+    checkSize( file, filename );
+
+    // the file bytes are decoded in place: when the file is mapped there is no intermediate copy
+    const ImageDimensions expected = image.getDimensions();
+    ImageDimensions decoded;
+    void *pixels = loadWithStb( file, expected.channelType, decoded );
+
+    if( !pixels )
+      throw ErrorString( "failed to load image from file ", filename, "\n",
+                         "because: ", stbi_failure_reason());
+
+    if( decoded.width != expected.width || decoded.height != expected.height || decoded.nChannels != expected.nChannels )
+    {
+      stbi_image_free( pixels );
+      throw ErrorString( "failed to load image from file ", filename, "\n",
+                         "because: decoded image doesn't match its header" );
+    }
+
+    const std::size_t rowBytes = image.getRowBytes();
+    const std::size_t done = image.getPublishedRows() * rowBytes;
+
+    if( expected.channelType == ChannelType::float16 )
+    {
+      // kept as half floats, at half the size: converted into the image's own buffer
+      if( !image.hasPixels())
+        image.allocatePixels();
 
-    ~RawImage() override
+      convertFloatsToHalves(
+          static_cast< const float * >( pixels ) + done / 2,
+          reinterpret_cast< uint16_t * >( image.getPixelsForWriting() + done ),
+          ( rowBytes * expected.height - done ) / 2 );
+      stbi_image_free( pixels );
+    }
+    else if( !image.hasPixels())
+      image.adoptPixels( static_cast< unsigned char * >( pixels ), [ = ] { stbi_image_free( pixels ); } );
+    else
     {
-      if( pixels ) // 2021.09.27: CLion warns that the condition is always false: this is a CLion or Clang bug; debugging with a breakpoint shows the condition is not false
-        stbi_image_free( pixels );
+      // another decoder gave up part way: keep the rows it already published and fill in the rest
+      std::memcpy( image.getPixelsForWriting() + done, static_cast< const unsigned char * >( pixels ) + done, rowBytes * expected.height - done );
+      stbi_image_free( pixels );
     }
 
-    ImageDimensions getDimensions() override { return *this; /* NOLINT(cppcoreguidelines-slicing) */ }
-    const unsigned char *getPixels() override { return pixels; }
-  };
+    image.publishRows( expected.height - image.getPublishedRows());
+  }
+
+  // the reduced scale a JPEG can be decoded at and still cover the image shrunk to fit (never enlarged)
+  std::optional< ScaledJpeg >
+  chooseScaleToFit( const MappedFile &file, const ImageDimensions &dimensions, TargetSize fitInto )
+  {
+    if( fitInto.width <= 0 || fitInto.height <= 0 )
+      return std::nullopt;
+
+    const double fit = std::min( {
+        1.0, (double)fitInto.width / dimensions.width, (double)fitInto.height / dimensions.height } );
+    return chooseJpegScale( file, (int)std::ceil( dimensions.width * fit ), (int)std::ceil( dimensions.height * fit ));
+  }
+
+  // A big PNG's preview: shrunk by the biggest whole factor which still covers the image shrunk to fit, 8 bits per
+  // channel. Handed to onPreview with the first strip, then filled in row by row as the next ones come.
+  // false when the PNG isn't that big, or when cancelled (the preview then stays as far as it got).
+  bool
+  streamPngToFit(
+      const MappedFile &file, const ImageDimensions &dimensions, TargetSize fitInto,
+      const std::function< void( std::shared_ptr< const ImagePreview > ) > &onPreview, const std::atomic< bool > *cancelled )
+  {
+    if( fitInto.width <= 0 || fitInto.height <= 0
+        || (std::size_t)dimensions.width * dimensions.height * dimensions.getPixelBytes() < minStreamedPngBytes )
+      return false;
+
+    const double fit = std::min( {
+        1.0, (double)fitInto.width / dimensions.width, (double)fitInto.height / dimensions.height } );
+    const int factor = std::min(
+        dimensions.width / (int)std::ceil( dimensions.width * fit ), dimensions.height / (int)std::ceil( dimensions.height * fit ));
+    if( factor < 2 )
+      return false;
+
+    std::shared_ptr< ImagePreview > preview;
+    std::optional< PreviewScaler > scaler;
+
+    // however the streaming ends, what's missing stays zero (transparent) rather than keeping the renderers waiting
+    const Destroyer finishPreview{ [ & ] { if( preview ) preview->pendingRows.store( 0, std::memory_order_release ); }};
+
+    return decodePngInStrips( file, stripRows, [ & ]( const ImageDimensions &strip, int, int nRows, unsigned char *rows )
+    {
+      if( !preview )
+      {
+        preview = std::make_shared< ImagePreview >();
+        preview->dimensions = PreviewScaler::getScaledDimensions( strip, factor );
+        preview->decoded.resize( (std::size_t)preview->dimensions.width * preview->dimensions.height * preview->dimensions.nChannels );
+        preview->pixels = preview->decoded.data();
+        preview->pendingRows.store( preview->dimensions.height, std::memory_order_relaxed );
+        scaler.emplace( strip, factor, preview->decoded.data());
+        onPreview( preview );
+      }
+
+      // as ProgressiveImage::publishRows(..) does for the full image
+      if( strip.nChannels == 2 || strip.nChannels == 4 )
+        getPixelConversions().premultiplyAlpha( rows, (std::size_t)strip.width * nRows, strip.nChannels );
+
+      scaler->addRows( rows, nRows );
+      preview->pendingRows.store( preview->dimensions.height - scaler->getScaledRows(), std::memory_order_release );
+      return !( cancelled && cancelled->load( std::memory_order_relaxed ));
+    } );
+  }
 } // namespace
 
 std::unique_ptr< IRawImage >
-loadImageFile( const char *filename )
+loadImageFile( const char *filename, MappedFile::Access access )
 {
-  return std::make_unique< RawImage >( filename );
+  // the mapping (or read buffer) is only needed during decoding
+  const MappedFile file{ filename, access };
+  auto image = std::make_unique< ProgressiveImage >( readImageHeader( file, filename ));
+  decodeImageFile( file, filename, *image );
+  return image;
+}
+
+std::unique_ptr< IRawImage >
+loadImageFile( const char *filename, TargetSize fitInto, MappedFile::Access access )
+{
+  const MappedFile file{ filename, access };
+  const ImageDimensions dimensions = readImageHeader( file, filename );
+
+  const std::optional< ScaledJpeg > scaled = chooseScaleToFit( file, dimensions, fitInto );
+  if( !scaled )
+  {
+    auto image = std::make_unique< ProgressiveImage >( dimensions );
+    decodeImageFile( file, filename, *image );
+    return image;
+  }
+
+  auto image = std::make_unique< ProgressiveImage >( scaled->dimensions );
+  decodeJpegScaled( file, *scaled, image->allocatePixels());
+  image->publishRows( scaled->dimensions.height );
+  return image;
+}
+
+ImageDimensions
+readImageHeader( const MappedFile &file, const char *filename )
+{
+  checkSize( file, filename );
+
+  ImageDimensions dimensions;
+  if( !stbi_info_from_memory( file.data(), (int)file.size(), &dimensions.width, &dimensions.height, &dimensions.nChannels ))
+    throw ErrorString( "failed to read image header from file ", filename, "\n",
+                       "because: ", stbi_failure_reason());
+
+  // decoded as they are stored, rather than truncated to 8 bits
+  if( stbi_is_hdr_from_memory( file.data(), (int)file.size()))
+    dimensions.channelType = ChannelType::float16;
+  else if( stbi_is_16_bit_from_memory( file.data(), (int)file.size()))
+    dimensions.channelType = ChannelType::uint16;
+
+  return dimensions;
+}
+
+void
+decodeImageFile( const MappedFile &file, const char *filename, ProgressiveImage &image )
+{
+  // Formats with a multithreaded decoder try it first (they only decode to 8 bits per channel). Each one returns false
+  // when the file has no parallelism to exploit (or uses features it doesn't handle), and then stb decodes the rest
+  // on this thread.
+  // If one of them fails on corrupt data, stb gets a go too so the error message is stb's as before,
+  // unless some rows are already published: those can't be taken back.
+  const unsigned nThreads = std::thread::hardware_concurrency();
+
+  try
+  {
+    if( image.getDimensions().channelType == ChannelType::uint8
+        && ( decodeJpegInParallel( file, nThreads, image ) || decodePngPipelined( file, nThreads, image )))
+      return;
+  }
+  catch( const ErrorString & )
+  {
+    if( image.getPublishedRows() > 0 )
+      throw;
+  }
+
+  if( !image.isCancelled())
+    decodeWithStb( file, filename, image );
+}
+
+bool
+decodeImageFileToFit(
+    const MappedFile &file, const ImageDimensions &dimensions, TargetSize fitInto,
+    const std::function< void( std::shared_ptr< const ImagePreview > ) > &onPreview, const std::atomic< bool > *cancelled )
+{
+  const std::optional< ScaledJpeg > scaled = chooseScaleToFit( file, dimensions, fitInto );
+  if( !scaled )
+    return streamPngToFit( file, dimensions, fitInto, onPreview, cancelled );
+
+  auto preview = std::make_shared< ImagePreview >();
+  preview->dimensions = scaled->dimensions;
+  preview->decoded.resize( (std::size_t)scaled->dimensions.width * scaled->dimensions.height * scaled->dimensions.nChannels );
+  if( !decodeJpegScaled( file, *scaled, preview->decoded.data(), cancelled ))
+    return false;
+  preview->pixels = preview->decoded.data();
+  onPreview( std::move( preview ));
+  return true;
 }
@@ -1,11 +1,56 @@
 #pragma once
 
 #include "IRawImage.hpp"
+#include "ImageDimensions.hpp"
+#include "MappedFile.hpp"
+#include "ProgressiveImage.hpp"
 
+#include <atomic>
+#include <functional>
 #include <memory>
 
+struct ImagePreview;
+
+// access selects how the file's bytes reach the decoder:
+// memory-mapped by default (falls back to reading when mapping fails), or always read into a buffer
+
 std::unique_ptr< IRawImage >
-loadImageFile( const char *filename )
+loadImageFile( const char *filename, MappedFile::Access access = MappedFile::Access::mapOrRead )
 noexcept( false ); // throws ErrorString
 
+// The same, but a JPEG is decoded at 1/2, 1/4 or 1/8 of its size when that still covers fitInto once shrunk to fit,
+// so the image may be smaller than the file's header says. Other files are decoded at full size.
 
+std::unique_ptr< IRawImage >
+loadImageFile( const char *filename, TargetSize fitInto, MappedFile::Access access = MappedFile::Access::mapOrRead )
+noexcept( false ); // throws ErrorString
+
+// parses only the header of an already opened file; filename is only used in error messages
+
+ImageDimensions
+readImageHeader( const MappedFile &file, const char *filename )
+noexcept( false ); // throws ErrorString
+
+// decodes an already opened file into image, whose dimensions must come from readImageHeader,
+// publishing rows as soon as they are decoded
+
+void
+decodeImageFile( const MappedFile &file, const char *filename, ProgressiveImage &image )
+noexcept( false ); // throws ErrorString
+
+// For showing an image at fitInto before (or instead of) decoding it in full: a JPEG decoded at a reduced scale
+// as above, as a preview for image. A PNG too big to be worth holding whole (see decodePngInStrips) is decoded
+// strip by strip and box-filtered down to about that scale instead, never holding more than a strip of it.
+// onPreview is given the preview as soon as it exists, on this thread: a JPEG's once it's done, a PNG's with its
+// first strip, its rows then coming in while this carries on (see ImagePreview::getReadyRows()).
+// Returns false when the file can't be decoded that way, or only the full size would do, or once cancelled is set.
+// Only this preview is streamed: the full resolution (zoomed in past the preview, or any PNG under the streaming
+// threshold, 256 MiB decoded) still comes from decodeImageFile(..), which holds the whole image in memory as before.
+// In particular the tiled renderer builds its tiles from that whole image, not from strips.
+
+bool
+decodeImageFileToFit(
+    const MappedFile &file, const ImageDimensions &dimensions, TargetSize fitInto,
+    const std::function< void( std::shared_ptr< const ImagePreview > ) > &onPreview,
+    const std::atomic< bool > *cancelled = nullptr )
+noexcept( false ); // throws ErrorString
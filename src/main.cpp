@@ -10,8 +10,11 @@
 
 #include "Destroyer.hpp"
 #include "GlfwWindow.hpp"
+#include "ImageBrowser.hpp"
+#include "ImageSource.hpp"
 #include "makeGlRendererMaker.hpp"
-#include "readImageDimensions.hpp"
+#include "singleInstance.hpp"
+#include "trace.hpp"
 
 #include <codecvt>
 #include <cstdint>
@@ -43,7 +46,6 @@ Make error reporting create a dialog (is this possible with glfw?) when there is
 Currently errors are only visible if you launch the program from a command line terminal,
 otherwise the program appears to quit without saying anything.
 Currently cases where the program might fail are:
-  * missing shader files (I'd like to bake them into the executable but I don't know a simple cross-platform way to do that, yet
   * corrupt or unsupported image file / format
   * out of memory (I guess this is possible but very unlikely)
 */
@@ -54,9 +56,13 @@ int Main( int argc, char *argv[] )
 {
   // TODO: add "dear imgui", for eventual messages or image information or application settings
 
+  // IMAGEVIEWERGL_TRACE=startup.json records where the time to the first pixel goes, see trace.hpp
+  traceThreadName( "main" );
+
   if( argc != 2 )
   {
-    std::cout << "usage: " << argv[0] << " path/to/someImage.jpg" << std::endl;
+    std::cout << "usage: " << argv[0] << " path/to/someImage.jpg" << std::endl
+              << "  then Right / Left (or Page Down / Page Up) show the other images in the same directory" << std::endl;
     return 1;
   }
 
@@ -64,6 +70,13 @@ int Main( int argc, char *argv[] )
 
   // remember initial working directory (might be not exe directory)
   const std::filesystem::path initialWorkingDirectory = std::filesystem::current_path();
+
+  std::string imageFilename = (initialWorkingDirectory / argv[1]).string();
+
+  // an instance already running shows it instead, see singleInstance.hpp
+  if( sendToRunningInstance( imageFilename ))
+    return 0;
+
   Destroyer revertWorkingDirectory{ [=] { std::filesystem::current_path( initialWorkingDirectory ); }};
 
   {
@@ -75,28 +88,53 @@ int Main( int argc, char *argv[] )
 
   //------------------------------------------------------------------------------
 
-  std::string imageFilename = (initialWorkingDirectory / argv[1]).string();
-
-  //------------------------------------------------------------------------------
-
   // In a separate thread calls makeGlRendererMaker through std::async;
   // at the same time, passes a std::future to makeGlfwWindow(..),
-  // which will be fulfilled when the image has been loaded in makeGlRendererMaker.
+  // which is fulfilled straight away: the render thread's first makeGlRenderer() is what waits for the image
+  // (its header, and its preview when it's decoded to fit);
+  // the pixels then keep arriving from another thread and are shown as they are decoded.
   // This allows makeGlfwWindow to create the window and initialize GLFW and OpenGL
   // simultaneously with the image being loaded from the filesystem, to hopefully
   // reduce the total time it takes before the user sees the image on screen.
+  // The image file is opened only once: the loading thread publishes the image dimensions
+  // through imageSource as soon as it has parsed the header, and the window is sized from those.
+
+  // The window never gets bigger than the work area, so a big JPEG is first decoded at a reduced scale (1/2, 1/4 or 1/8)
+  // which still covers it: a fraction of the work and memory of a full decode.
+  // The full resolution is only decoded when something asks for it, like a window bigger than that.
+  ImageBrowser imageBrowser{ imageFilename, getPrimaryMonitorWorkArea() };
+  std::shared_ptr< ImageSource > imageSource = imageBrowser.openFirst();
 
   std::shared_ptr<IGlWindow> window = makeGlfwWindow(
-      std::async( std::launch::async, makeGlRendererMaker, imageFilename ));
+      std::async( std::launch::async, makeGlRendererMaker, imageSource ));
+
+  // the window's GL context is current here until its event loop starts: compiling (or loading) the shader programs
+  // now overlaps with reading and decoding the image, instead of coming after the header on the render thread
+  prepareGlRenderers();
 
   //------------------------------------------------------------------------------
 
   window->setTitle( imageFilename );
 
-  const ImageDimensions imageDimensions = readImageDimensions( imageFilename.c_str());
+  const ImageDimensions imageDimensions = imageSource->getFutureDimensions().get();
   
   window->setCenteredToFit( imageDimensions.width, imageDimensions.height );
+
+  // only now, so that listing the directory and prefetching the neighbours don't delay the first image
+  imageBrowser.attach( *window );
+
+  // then this window shows the images later invocations are given, until it closes
+  const Destroyer stopListening = listenForOtherInstances( [&window, &imageBrowser]( std::string filename )
+  {
+    window->postToEventThread( [&window, &imageBrowser, filename = std::move( filename )]
+    {
+      imageBrowser.open( filename );
+      window->focus();
+    } );
+  } );
+
   window->show();
+  traceInstant( "window shown" );
   window->enterEventLoop();
 
   return 0;
@@ -1,28 +1,117 @@
 #include "makeGlRendererMaker.hpp"
 
+#include "GlRenderer_AnimatedImageRenderer.hpp"
 #include "GlRenderer_ImageRenderer.hpp"
-#include "loadImageFile.hpp"
+#include "GlRenderer_TiledImageRenderer.hpp"
+#include "getGlTextureFormat.hpp"
+#include "trace.hpp"
 
-std::unique_ptr< IGlRendererMaker >
-makeGlRendererMaker( const std::string &imageFilename )
+#define GL_SILENCE_DEPRECATION // MacOS has deprecated OpenGL - it still works up to 4.1 for now
+#include <gl/glew.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <future>
+#include <optional>
+#include <string>
+#include <system_error>
+
+namespace
+{
+  constexpr std::size_t defaultTextureBudgetMegabytes = 512;
+
+  // images whose texture would be bigger than this are shown tiled, keeping at most this much in textures;
+  // set with the environment variable IMAGEVIEWERGL_TEXTURE_BUDGET_MB
+  std::size_t
+  getTextureBudgetBytes()
+  {
+    std::size_t megabytes = defaultTextureBudgetMegabytes;
+
+    if( const char *value = std::getenv( "IMAGEVIEWERGL_TEXTURE_BUDGET_MB" ))
+      if( const unsigned long long parsed = std::strtoull( value, nullptr, 10 ); parsed > 0 )
+        megabytes = (std::size_t)parsed;
+
+    return megabytes << 20;
+  }
+
+  // tiled images' tiles are block compressed when the environment variable IMAGEVIEWERGL_COMPRESS_TILES is 1
+  bool
+  isCompressingTiles()
+  {
+    const char *value = std::getenv( "IMAGEVIEWERGL_COMPRESS_TILES" );
+    return value && std::string{ value } == "1";
+  }
+
+  std::optional< TextureCache::Key >
+  getTextureKey( const std::string &filename )
+  {
+    std::error_code error;
+    const std::filesystem::file_time_type modified = std::filesystem::last_write_time( filename, error );
+    if( error )
+      return std::nullopt;
+
+    return TextureCache::Key{ filename, modified };
+  }
+} // namespace
+
+void
+prepareGlRenderers()
 {
-  std::unique_ptr< IRawImage > rawImage = loadImageFile( imageFilename.c_str());
+  TraceScope trace{ "prepareGlRenderers" };
+  prepareGlRenderer_ImageRenderer();
+  prepareGlRenderer_TiledImageRenderer();
+  prepareGlRenderer_AnimatedImageRenderer();
+}
 
+std::unique_ptr< IGlRendererMaker >
+makeGlRendererMaker( std::shared_ptr< ImageSource > imageSource )
+{
+  // doesn't wait for anything: the image (and its preview) may still be coming, see isReady()
   struct GlRendererMaker : public IGlRendererMaker
   {
-    std::unique_ptr< IRawImage > rawImage;
+    std::shared_ptr< ImageSource > imageSource;
+    std::optional< TextureCache::Key > textureKey;
 
-    explicit
-    GlRendererMaker( std::unique_ptr< IRawImage > rawImage )
-        : rawImage{ std::move( rawImage ) } {}
+    GlRendererMaker( std::shared_ptr< ImageSource > imageSource, std::optional< TextureCache::Key > textureKey )
+        : imageSource{ std::move( imageSource ) }
+        , textureKey{ std::move( textureKey ) } {}
+
+    bool isReady() const override
+    {
+      return imageSource->getFutureImage().wait_for( std::chrono::seconds{ 0 } ) == std::future_status::ready;
+    }
 
     std::unique_ptr< IGlRenderer >
     makeGlRenderer() override
     {
-      return makeGlRenderer_ImageRenderer( std::move( rawImage ));
+      TraceScope trace{ "makeGlRenderer" };
+      std::shared_ptr< ProgressiveImage > image = imageSource->getFutureImage().get();
+      const std::shared_ptr< const MappedFile > animationFile = imageSource->getAnimationFile();
+      const ImageDimensions dimensions = image->getDimensions();
+      const std::size_t textureBudgetBytes = getTextureBudgetBytes();
+
+      // makeGlRenderer is only ever called on the render thread, which outlives every renderer it makes
+      // and still has its GL context when this goes away
+      static thread_local TextureCache textureCache{ textureBudgetBytes };
+
+      GLint maxTextureSize = 0;
+      glGetIntegerv( GL_MAX_TEXTURE_SIZE, &maxTextureSize );
+
+      // an animation needs at least two frames in textures at once; one too big for that is shown still
+      if( animationFile && dimensions.width <= maxTextureSize && dimensions.height <= maxTextureSize
+          && (std::size_t)dimensions.width * dimensions.height * 4 * 2 <= textureBudgetBytes )
+        return makeGlRenderer_AnimatedImageRenderer( std::make_unique< AnimatedImage >( animationFile ), textureBudgetBytes );
+
+      if( dimensions.width > maxTextureSize || dimensions.height > maxTextureSize
+          || (std::size_t)dimensions.width * dimensions.height * getGlTextureFormat( dimensions ).texelBytes * 4 / 3
+             > textureBudgetBytes ) // with its mipmaps
+        return makeGlRenderer_TiledImageRenderer( std::move( image ), textureBudgetBytes, isCompressingTiles());
+
+      return makeGlRenderer_ImageRenderer( std::move( image ), textureCache, std::move( textureKey ));
     }
   };
 
-  return std::make_unique< GlRendererMaker >( std::move( rawImage ));
+  std::optional< TextureCache::Key > textureKey = getTextureKey( imageSource->getFilename());
+  return std::make_unique< GlRendererMaker >( std::move( imageSource ), std::move( textureKey ));
 }
-
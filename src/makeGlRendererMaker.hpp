@@ -1,9 +1,16 @@
 #pragma once
 
 #include "IGlRendererMaker.hpp"
+#include "ImageSource.hpp"
 
 #include <memory>
-#include <string>
 
+// Doesn't wait for the image: its makeGlRenderer() does, unless it's called once isReady()
 std::unique_ptr< IGlRendererMaker >
-makeGlRendererMaker( const std::string &imageFilename );
+makeGlRendererMaker( std::shared_ptr< ImageSource > imageSource );
+
+// Makes what the renderers share (their shader programs) in the current GL context, which the first makeGlRenderer
+// would otherwise do after the image header has been read: call it where that can overlap with loading the image.
+void
+prepareGlRenderers()
+noexcept( false ); // may throw std::exception
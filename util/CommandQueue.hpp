@@ -0,0 +1,86 @@
+#pragma once
+
+#include "NoCopy.hpp"
+#include "SpscQueue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <optional>
+#include <semaphore>
+#include <utility>
+
+// Commands from one thread to another which sleeps while there are none, e.g. from the event thread to the render thread.
+// Pushing never blocks: commands go through a lock-free SpscQueue, or, while that's full, into a backlog which the
+// producer pushes with its next command or with flush(). The consumer is only woken when it may be asleep
+// (on an atomic, through std::counting_semaphore), so any number of commands pushed while it's busy cost one wakeup.
+
+template< class T >
+class CommandQueue : NoCopy
+{
+  SpscQueue< T > queue;
+  std::deque< T > backlog; // producer only: what didn't fit in the queue, oldest first
+
+  std::atomic< bool > signalled{}; // since the consumer last started draining
+  std::counting_semaphore<> wakeup{ 0 };
+
+  void signal()
+  {
+    // the consumer's exchange in drain(..) sees whatever was pushed before this
+    if( !signalled.exchange( true, std::memory_order_acq_rel ))
+      wakeup.release();
+  }
+
+  bool pushBacklog()
+  {
+    bool pushed = false;
+    for( ; !backlog.empty() && queue.tryPush( std::move( backlog.front())); pushed = true )
+      backlog.pop_front();
+
+    return pushed;
+  }
+
+public:
+  explicit
+  CommandQueue( std::size_t capacity )
+      : queue{ capacity } {}
+
+  // producer thread only
+  void push( T command )
+  {
+    pushBacklog();
+    if( !backlog.empty() || !queue.tryPush( std::move( command )))
+      backlog.push_back( std::move( command ));
+
+    signal();
+  }
+
+  // producer thread only: pushes what it can of the backlog, returning true once there is none
+  bool flush()
+  {
+    if( pushBacklog())
+      signal();
+
+    return backlog.empty();
+  }
+
+  // consumer thread only: calls f with each command pushed so far, oldest first
+  template< typename F >
+  void drain( F &&f )
+  {
+    signalled.exchange( false, std::memory_order_acq_rel );
+    while( std::optional< T > command = queue.tryPop())
+      f( std::move( *command ));
+  }
+
+  // consumer thread only: sleeps until something is pushed after the last drain(..), or until deadline;
+  // may also return early, with nothing new
+  void waitUntil( const std::optional< std::chrono::steady_clock::time_point > &deadline )
+  {
+    if( deadline )
+      (void)wakeup.try_acquire_until( *deadline );
+    else
+      wakeup.acquire();
+  }
+};
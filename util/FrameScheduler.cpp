@@ -0,0 +1,78 @@
+#include "FrameScheduler.hpp"
+
+#include "verboseLog.hpp"
+
+#include <algorithm>
+
+FrameScheduler::FrameScheduler( Clock::duration refreshInterval )
+    : refreshInterval{ refreshInterval } {}
+
+FrameScheduler::~FrameScheduler()
+{
+  if( counters.presented || counters.skipped )
+    logCounters();
+}
+
+void
+FrameScheduler::setRefreshInterval( Clock::duration interval )
+{
+  refreshInterval = interval;
+}
+
+void
+FrameScheduler::requestFrame()
+{
+  if( requestedAt )
+    ++counters.skipped;
+  else
+    requestedAt = Clock::now();
+}
+
+bool
+FrameScheduler::isFrameDue( Clock::time_point now ) const
+{
+  const std::optional< Clock::time_point > due = getNextFrameTime();
+  return due && *due <= now;
+}
+
+std::optional< FrameScheduler::Clock::time_point >
+FrameScheduler::getNextFrameTime() const
+{
+  if( !requestedAt )
+    return std::nullopt;
+
+  // the first frame, or the first after a while, goes straight away
+  return lastFrameAt ? std::max( *requestedAt, *lastFrameAt + refreshInterval ) : *requestedAt;
+}
+
+void
+FrameScheduler::presented( Clock::time_point started )
+{
+  const Clock::time_point now = Clock::now();
+  const Clock::duration latency = requestedAt ? now - *requestedAt : Clock::duration{};
+
+  ++counters.presented;
+  counters.totalLatency += latency;
+  counters.maxLatency = std::max( counters.maxLatency, latency );
+
+  requestedAt = std::nullopt;
+  lastFrameAt = started;
+
+  if( now - loggedAt >= logInterval )
+    logCounters();
+}
+
+void
+FrameScheduler::logCounters()
+{
+  using Milliseconds = std::chrono::duration< double, std::milli >;
+
+  const double seconds = std::chrono::duration< double >( Clock::now() - loggedAt ).count();
+  verboseLog(
+      "frames in ", seconds, " s: ", counters.presented, " presented, ", counters.skipped, " requests skipped, present latency ",
+      counters.presented ? Milliseconds( counters.totalLatency ).count() / counters.presented : 0.0, " ms mean, ",
+      Milliseconds( counters.maxLatency ).count(), " ms max, at most every ", Milliseconds( refreshInterval ).count(), " ms" );
+
+  counters = {};
+  loggedAt = Clock::now();
+}
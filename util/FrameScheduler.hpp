@@ -0,0 +1,56 @@
+#pragma once
+
+#include "NoCopy.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+// Decides when the render thread presents: only when something has changed since the last frame, and no more than
+// once per display refresh. Every request made while a frame is already waiting to be presented joins that frame,
+// so a resize storm or a fast drag draws at the refresh rate however many events come in.
+// Counts frames presented, requests which joined a frame another request had asked for first (skipped),
+// and the latency from a frame's first request to its present; logged every few seconds when verbose.
+// Render thread only.
+
+struct FrameScheduler : NoCopy
+{
+  using Clock = std::chrono::steady_clock;
+
+  explicit
+  FrameScheduler( Clock::duration refreshInterval );
+
+  ~FrameScheduler(); // logs the counters since the last log, if any
+
+  // e.g. the window moved to a display with another refresh rate; 0 doesn't pace at all
+  void setRefreshInterval( Clock::duration );
+  Clock::duration getRefreshInterval() const { return refreshInterval; }
+
+  // something on screen has changed
+  void requestFrame();
+
+  // a frame has been requested, and it's been a refresh interval since the last one started
+  bool isFrameDue( Clock::time_point now = Clock::now()) const;
+
+  // when a requested frame will be due; nullopt if none is
+  std::optional< Clock::time_point > getNextFrameTime() const;
+
+  // right after the swap, with when the frame started: frames start a refresh apart, however long they take to draw
+  void presented( Clock::time_point started );
+
+private:
+  // how often the counters are logged, while frames are being presented
+  static constexpr std::chrono::seconds logInterval{ 5 };
+
+  Clock::duration refreshInterval;
+  std::optional< Clock::time_point > requestedAt, lastFrameAt; // lastFrameAt: when the last presented frame started
+
+  struct Counters
+  {
+    uint64_t presented{}, skipped{};
+    Clock::duration totalLatency{}, maxLatency{};
+  } counters;
+  Clock::time_point loggedAt = Clock::now();
+
+  void logCounters();
+};
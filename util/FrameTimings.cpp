@@ -0,0 +1,73 @@
+#include "FrameTimings.hpp"
+
+#include "verboseLog.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // "p50 / p95 / p99 ms" of the values, nearest rank
+  std::string
+  formatPercentiles( std::vector< float > &values )
+  {
+    if( values.empty())
+      return "-";
+
+    std::sort( values.begin(), values.end());
+    auto percentile = [ & ]( int p ) { return values[ std::min( values.size() - 1, values.size() * p / 100 ) ]; };
+    return toString( percentile( 50 ), " / ", percentile( 95 ), " / ", percentile( 99 ), " ms" );
+  }
+} // namespace
+
+FrameTimings::~FrameTimings()
+{
+  if( nFrames > loggedFrames )
+    log();
+}
+
+void
+FrameTimings::add( const FrameTiming &timing )
+{
+  frames[ nFrames++ % maxFrames ] = timing;
+
+  // a few frames late, for the last GPU times to be in
+  if( std::chrono::steady_clock::now() - loggedAt >= logInterval )
+    log();
+}
+
+void
+FrameTimings::setGpuTime( uint64_t frame, float ms )
+{
+  if( frame < nFrames && nFrames - frame <= maxFrames )
+    frames[ frame % maxFrames ].gpuMs = ms;
+}
+
+void
+FrameTimings::log()
+{
+  if( isVerbose())
+  {
+    // the ring may have wrapped since: only what's still in it
+    const int n = (int)std::min< uint64_t >( nFrames - loggedFrames, getCount());
+
+    std::vector< float > render, swap, frame, gpu;
+    for( int i = getCount() - n; i < getCount(); ++i )
+    {
+      const FrameTiming &t = get( i );
+      render.push_back( t.renderMs );
+      swap.push_back( t.swapMs );
+      frame.push_back( t.frameMs );
+      if( t.gpuMs >= 0 )
+        gpu.push_back( t.gpuMs );
+    }
+
+    verboseLog(
+        "frame times (p50 / p95 / p99) of the last ", n, " frames: frame ", formatPercentiles( frame ), ", render ",
+        formatPercentiles( render ), ", swap ", formatPercentiles( swap ), ", GPU ", formatPercentiles( gpu ));
+  }
+
+  loggedFrames = nFrames;
+  loggedAt = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "NoCopy.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// How long the render thread's recent frames took: CPU time for the renderer's render(), for glfwSwapBuffers,
+// and for the whole frame, and the GPU time of the renderer's draw calls (from GL_TIME_ELAPSED queries, see
+// GpuTimer.hpp), which comes in a few frames later. Kept in a fixed ring of the last maxFrames frames, written
+// and read by the render thread only, so recording a frame never locks or allocates.
+// When verbose, the 50th, 95th and 99th percentiles since the last log are logged every few seconds.
+
+struct FrameTiming
+{
+  float renderMs{}, swapMs{}, frameMs{};
+  float gpuMs = -1; // until the query's result is in, or when there was no query
+};
+
+struct FrameTimings : NoCopy
+{
+  static constexpr int maxFrames = 256;
+
+  ~FrameTimings(); // logs what's not logged yet, if anything
+
+  // the number the next frame will have, e.g. for its GPU query
+  uint64_t getNextFrame() const { return nFrames; }
+
+  void add( const FrameTiming & );
+
+  // ignored once the frame has left the ring
+  void setGpuTime( uint64_t frame, float ms );
+
+  // i = 0 is the oldest of the last getCount() frames
+  int getCount() const { return nFrames < maxFrames ? (int)nFrames : maxFrames; }
+  const FrameTiming &get( int i ) const { return frames[ ( nFrames - getCount() + i ) % maxFrames ]; }
+
+private:
+  static constexpr std::chrono::seconds logInterval{ 5 };
+
+  std::array< FrameTiming, maxFrames > frames{};
+  uint64_t nFrames{}, loggedFrames{};
+  std::chrono::steady_clock::time_point loggedAt = std::chrono::steady_clock::now();
+
+  void log();
+};
@@ -0,0 +1,59 @@
+#include "GpuTimer.hpp"
+
+#include <utility>
+
+GpuTimer::GpuTimer()
+{
+  glGenQueries( nQueries, queries );
+  _queries = Destroyer{ [ this ] { glDeleteQueries( nQueries, this->queries ); }};
+}
+
+void
+GpuTimer::begin( uint64_t frame )
+{
+  if( slots[ next ].pending )
+    return; // every query is still in flight: this frame goes untimed
+
+  slots[ next ].frame = frame;
+  glBeginQuery( GL_TIME_ELAPSED, queries[ next ] );
+  timing = true;
+}
+
+void
+GpuTimer::end()
+{
+  if( !timing )
+    return;
+
+  glEndQuery( GL_TIME_ELAPSED );
+  slots[ next ].pending = true;
+  next = ( next + 1 ) % nQueries;
+  timing = false;
+}
+
+void
+GpuTimer::collect( const std::function< void( uint64_t frame, float ms ) > &onResult )
+{
+  // from the oldest: queries complete in order
+  for( int i = 0; i < nQueries; ++i )
+  {
+    const int slot = ( next + i ) % nQueries;
+    if( !slots[ slot ].pending )
+      continue;
+
+    GLint available = 0;
+    glGetQueryObjectiv( queries[ slot ], GL_QUERY_RESULT_AVAILABLE, &available );
+    if( !available )
+      return;
+
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v( queries[ slot ], GL_QUERY_RESULT, &nanoseconds );
+    slots[ slot ].pending = false;
+
+    // Mesa's llvmpipe times the first query from when the context was made
+    if( !std::exchange( sawFirstResult, true ))
+      continue;
+
+    onResult( slots[ slot ].frame, (float)( nanoseconds / 1e6 ));
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#define GL_SILENCE_DEPRECATION // MacOS has deprecated OpenGL - it still works up to 4.1 for now
+#include <gl/glew.h>
+
+#include "Destroyer.hpp"
+#include "NoCopy.hpp"
+
+#include <cstdint>
+#include <functional>
+
+// How long the GPU takes over the GL commands between begin(..) and end(), from GL_TIME_ELAPSED queries.
+// A query's result is only there once the GPU has got that far, a frame or more later: the queries go round a ring,
+// their results are collected when available (never waiting for them), and while every query is still pending
+// the frame just isn't timed. One timing at a time; current GL context only.
+
+struct GpuTimer : NoCopy
+{
+  GpuTimer();
+
+  // frame is what the result is handed back with
+  void begin( uint64_t frame );
+  void end();
+
+  // calls onResult( frame, ms ) for every query whose result has come in since, oldest first
+  void collect( const std::function< void( uint64_t frame, float ms ) > &onResult );
+
+private:
+  static constexpr int nQueries = 4;
+
+  GLuint queries[ nQueries ]{};
+  Destroyer _queries;
+
+  struct Slot
+  {
+    uint64_t frame{};
+    bool pending{};
+  };
+
+  Slot slots[ nQueries ]{};
+  int next{}; // the oldest pending slot is the next to reuse
+  bool timing{};
+  bool sawFirstResult{}; // which is dropped, see collect(..)
+};
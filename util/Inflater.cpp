@@ -0,0 +1,385 @@
+#include "Inflater.hpp"
+
+#include "ErrorString.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+  constexpr std::size_t historySize = 32768;
+  constexpr std::size_t maxMatchLength = 258;
+  constexpr std::size_t maxReadChunk = 1 << 18;
+
+  constexpr uint16_t lengthBase[ 29 ]{
+      3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+  constexpr uint8_t lengthExtra[ 29 ]{
+      0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+      3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+  constexpr uint16_t distanceBase[ 30 ]{
+      1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+      257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+  constexpr uint8_t distanceExtra[ 30 ]{
+      0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+      7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+  constexpr uint8_t codeLengthOrder[ 19 ]{
+      16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+  uint32_t
+  reverseBits( uint32_t v, int n )
+  {
+    uint32_t r = 0;
+    for( int i = 0; i < n; ++i, v >>= 1 )
+      r = ( r << 1 ) | ( v & 1 );
+    return r;
+  }
+} // namespace
+
+//==============================================================================
+
+void
+Inflater::Huffman::build( const uint8_t *lengths, int n )
+{
+  std::fill( std::begin( fast ), std::end( fast ), 0 );
+  std::fill( std::begin( counts ), std::end( counts ), 0 );
+
+  for( int s = 0; s < n; ++s )
+    ++counts[ lengths[ s ]];
+  counts[ 0 ] = 0;
+
+  // over-subscribed codes can't be decoded; incomplete codes are allowed (e.g. a single distance code)
+  for( int len = 1, left = 1; len < 16; ++len )
+    if( left = ( left << 1 ) - counts[ len ]; left < 0 )
+      throw ErrorString( "inflate: over-subscribed huffman code" );
+
+  uint16_t offsets[ 16 ]{};
+  for( int len = 1; len < 15; ++len )
+    offsets[ len + 1 ] = offsets[ len ] + counts[ len ];
+
+  for( int s = 0; s < n; ++s )
+    if( lengths[ s ] )
+      symbols[ offsets[ lengths[ s ]]++ ] = (uint16_t)s;
+
+  // canonical codes, bit-reversed because deflate packs huffman codes starting at their most significant bit
+  uint32_t nextCode[ 16 ]{};
+  for( int len = 1, code = 0; len < 16; ++len )
+    nextCode[ len ] = code = ( code + counts[ len - 1 ] ) << 1;
+
+  for( int s = 0; s < n; ++s )
+    if( const int len = lengths[ s ]; len )
+      if( const uint32_t code = nextCode[ len ]++; len <= fastBits )
+        for( uint32_t i = reverseBits( code, len ); i < ( 1u << fastBits ); i += 1u << len )
+          fast[ i ] = (uint16_t)(( len << fastBits ) | s );
+}
+
+//==============================================================================
+
+Inflater::Inflater( Source source )
+    : source{ std::move( source ) } {}
+
+void
+Inflater::refill()
+{
+  while( bitCount <= 56 )
+  {
+    if( input.empty())
+    {
+      if( inputEnded )
+        return;
+
+      if( input = source(); input.empty())
+      {
+        inputEnded = true;
+        return;
+      }
+    }
+
+    bitBuffer |= (uint64_t)input[ 0 ] << bitCount;
+    bitCount += 8;
+    input = input.subspan( 1 );
+  }
+}
+
+uint32_t
+Inflater::peekBits( int n )
+{
+  // past the end of input the missing bits read as zeros; consumeBits catches actually using them
+  if( bitCount < n )
+    refill();
+
+  return (uint32_t)( bitBuffer & (( 1ull << n ) - 1 ));
+}
+
+void
+Inflater::consumeBits( int n )
+{
+  if( n > bitCount )
+    throw ErrorString( "inflate: compressed data ended unexpectedly" );
+
+  bitBuffer >>= n;
+  bitCount -= n;
+}
+
+int
+Inflater::decodeSymbol( const Huffman &h )
+{
+  if( const uint16_t entry = h.fast[ peekBits( Huffman::fastBits ) ]; entry )
+  {
+    consumeBits( entry >> Huffman::fastBits );
+    return entry & (( 1 << Huffman::fastBits ) - 1 );
+  }
+
+  // slow path for long codes: walk the canonical code one bit at a time
+  const uint32_t bits = peekBits( 15 );
+  int code = 0, first = 0, index = 0;
+  for( int len = 1; len < 16; ++len )
+  {
+    code |= ( bits >> ( len - 1 )) & 1;
+    const int count = h.counts[ len ];
+    if( code - first < count )
+    {
+      consumeBits( len );
+      return h.symbols[ index + ( code - first ) ];
+    }
+    index += count;
+    first = ( first + count ) << 1;
+    code <<= 1;
+  }
+
+  throw ErrorString( "inflate: invalid huffman code" );
+}
+
+void
+Inflater::readDynamicTables()
+{
+  const int nLengths = (int)getBits( 5 ) + 257;
+  const int nDistances = (int)getBits( 5 ) + 1;
+  const int nCodeLengths = (int)getBits( 4 ) + 4;
+  if( nLengths > 286 || nDistances > 30 )
+    throw ErrorString( "inflate: bad dynamic block header" );
+
+  uint8_t codeLengthLengths[ 19 ]{};
+  for( int i = 0; i < nCodeLengths; ++i )
+    codeLengthLengths[ codeLengthOrder[ i ]] = (uint8_t)getBits( 3 );
+
+  Huffman codeLengths;
+  codeLengths.build( codeLengthLengths, 19 );
+
+  uint8_t lengths[ 286 + 30 ]{};
+  for( int index = 0; index < nLengths + nDistances; )
+  {
+    if( const int symbol = decodeSymbol( codeLengths ); symbol < 16 )
+      lengths[ index++ ] = (uint8_t)symbol;
+    else
+    {
+      uint8_t repeated = 0;
+      int repeat;
+      if( symbol == 16 )
+      {
+        if( index == 0 )
+          throw ErrorString( "inflate: repeated code length with no previous length" );
+        repeated = lengths[ index - 1 ];
+        repeat = 3 + (int)getBits( 2 );
+      }
+      else if( symbol == 17 )
+        repeat = 3 + (int)getBits( 3 );
+      else
+        repeat = 11 + (int)getBits( 7 );
+
+      if( index + repeat > nLengths + nDistances )
+        throw ErrorString( "inflate: too many code lengths" );
+
+      std::fill_n( lengths + index, repeat, repeated );
+      index += repeat;
+    }
+  }
+
+  if( lengths[ 256 ] == 0 )
+    throw ErrorString( "inflate: missing end-of-block code" );
+
+  literals.build( lengths, nLengths );
+  distances.build( lengths + nLengths, nDistances );
+}
+
+void
+Inflater::readBlockHeader()
+{
+  lastBlock = getBits( 1 );
+
+  switch( getBits( 2 ))
+  {
+    case 0: // stored
+    {
+      consumeBits( bitCount % 8 );
+      const uint32_t length = getBits( 16 );
+      if( const uint32_t notLength = getBits( 16 ); ( length ^ 0xffff ) != notLength )
+        throw ErrorString( "inflate: corrupt stored block length" );
+      storedRemaining = length;
+      state = BlockState::stored;
+      break;
+    }
+
+    case 1: // fixed huffman codes
+    {
+      uint8_t lengths[ 288 ];
+      std::fill( lengths, lengths + 144, 8 );
+      std::fill( lengths + 144, lengths + 256, 9 );
+      std::fill( lengths + 256, lengths + 280, 7 );
+      std::fill( lengths + 280, lengths + 288, 8 );
+      literals.build( lengths, 288 );
+
+      std::fill( lengths, lengths + 30, 5 );
+      distances.build( lengths, 30 );
+
+      state = BlockState::compressed;
+      break;
+    }
+
+    case 2: // dynamic huffman codes
+      readDynamicTables();
+      state = BlockState::compressed;
+      break;
+
+    default:
+      throw ErrorString( "inflate: invalid block type" );
+  }
+}
+
+void
+Inflater::reserveOutput( std::size_t n )
+{
+  // drop what has been read, except for the history that back-references may still reach
+  const std::size_t keepFrom = std::min( readPos, windowEnd - std::min( windowEnd, historySize ));
+  if( keepFrom > window.size() / 2 )
+  {
+    std::memmove( window.data(), window.data() + keepFrom, windowEnd - keepFrom );
+    windowEnd -= keepFrom;
+    readPos -= keepFrom;
+  }
+
+  if( window.size() < windowEnd + n )
+    window.resize( std::max( windowEnd + n, window.size() * 2 ));
+}
+
+void
+Inflater::inflateSome( std::size_t wanted )
+{
+  while( windowEnd - readPos < wanted )
+  {
+    switch( state )
+    {
+      case BlockState::needZlibHeader:
+      {
+        const uint32_t cmf = getBits( 8 ), flg = getBits( 8 );
+        if(( cmf * 256 + flg ) % 31 != 0 || ( cmf & 15 ) != 8 || ( flg & 32 ))
+          throw ErrorString( "inflate: bad zlib header" );
+        state = BlockState::needBlockHeader;
+        break;
+      }
+
+      case BlockState::needBlockHeader:
+        if( lastBlock )
+          state = BlockState::done;
+        else
+          readBlockHeader();
+        break;
+
+      case BlockState::stored:
+      {
+        if( storedRemaining == 0 )
+        {
+          state = BlockState::needBlockHeader;
+          break;
+        }
+
+        std::size_t n = std::min( storedRemaining, wanted - ( windowEnd - readPos ));
+        reserveOutput( n );
+        storedRemaining -= n;
+
+        // whole bytes still in the bit buffer come first, then straight from the input
+        for( ; n && bitCount >= 8; --n )
+          window[ windowEnd++ ] = (unsigned char)getBits( 8 );
+
+        while( n )
+        {
+          if( input.empty())
+          {
+            if( inputEnded || ( input = source()).empty())
+            {
+              inputEnded = true;
+              throw ErrorString( "inflate: compressed data ended unexpectedly" );
+            }
+            continue;
+          }
+
+          const std::size_t copied = std::min( n, input.size());
+          std::memcpy( window.data() + windowEnd, input.data(), copied );
+          windowEnd += copied;
+          input = input.subspan( copied );
+          n -= copied;
+        }
+        break;
+      }
+
+      case BlockState::compressed:
+      {
+        const std::size_t needed = wanted - ( windowEnd - readPos );
+        reserveOutput( needed + maxMatchLength );
+
+        for( const std::size_t limit = windowEnd + needed; windowEnd < limit; )
+        {
+          int symbol = decodeSymbol( literals );
+
+          if( symbol < 256 )
+          {
+            window[ windowEnd++ ] = (unsigned char)symbol;
+            continue;
+          }
+
+          if( symbol == 256 )
+          {
+            state = BlockState::needBlockHeader;
+            break;
+          }
+
+          if( symbol -= 257; symbol >= 29 )
+            throw ErrorString( "inflate: invalid length code" );
+          const std::size_t length = lengthBase[ symbol ] + getBits( lengthExtra[ symbol ] );
+
+          const int distanceSymbol = decodeSymbol( distances );
+          if( distanceSymbol >= 30 )
+            throw ErrorString( "inflate: invalid distance code" );
+          const std::size_t distance = distanceBase[ distanceSymbol ] + getBits( distanceExtra[ distanceSymbol ] );
+          if( distance > windowEnd )
+            throw ErrorString( "inflate: distance too far back" );
+
+          // may overlap itself (distance < length), so copy forwards one byte at a time
+          unsigned char *to = window.data() + windowEnd;
+          const unsigned char *from = to - distance;
+          for( std::size_t i = 0; i < length; ++i )
+            to[ i ] = from[ i ];
+          windowEnd += length;
+        }
+        break;
+      }
+
+      case BlockState::done:
+        throw ErrorString( "inflate: compressed data ended before enough bytes were produced" );
+    }
+  }
+}
+
+void
+Inflater::read( unsigned char *dst, std::size_t n )
+{
+  while( n )
+  {
+    const std::size_t chunk = std::min( n, maxReadChunk );
+    inflateSome( chunk );
+    std::memcpy( dst, window.data() + readPos, chunk );
+    readPos += chunk;
+    dst += chunk;
+    n -= chunk;
+  }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "NoCopy.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+// Streaming zlib (RFC 1950 / RFC 1951) decompressor.
+// Compressed bytes are pulled from source whenever more are needed (the source may hand them over
+// in any number of pieces, e.g. one per PNG IDAT chunk), and decompressed bytes are read out
+// in whatever amounts the caller wants, so only a 32 KiB history window plus the requested amount
+// is ever buffered.
+
+class Inflater : NoCopy
+{
+public:
+  // returns the next piece of compressed bytes, or an empty span when there are no more
+  using Source = std::function< std::span< const unsigned char >() >;
+
+  explicit
+  Inflater( Source source );
+
+  // fills all of dst with decompressed bytes
+  void
+  read( unsigned char *dst, std::size_t n )
+  noexcept( false ); // throws ErrorString if the stream is corrupt or ends before n bytes
+
+private:
+  struct Huffman
+  {
+    static constexpr int fastBits = 9;
+
+    uint16_t fast[ 1 << fastBits ]{}; // (length << 9) | symbol, for codes up to fastBits long; 0 if longer
+    uint16_t counts[ 16 ]{}; // number of codes of each length
+    uint16_t symbols[ 288 ]{}; // symbols ordered by code
+
+    void build( const uint8_t *lengths, int n );
+  };
+
+  enum class BlockState
+  {
+    needZlibHeader,
+    needBlockHeader,
+    stored,
+    compressed,
+    done
+  };
+
+  Source source;
+  std::span< const unsigned char > input;
+  bool inputEnded{};
+
+  uint64_t bitBuffer{};
+  int bitCount{};
+
+  BlockState state = BlockState::needZlibHeader;
+  bool lastBlock{};
+  std::size_t storedRemaining{};
+  Huffman literals, distances;
+
+  std::vector< unsigned char > window; // history followed by decompressed bytes not read yet
+  std::size_t windowEnd{};
+  std::size_t readPos{};
+
+  void refill();
+  uint32_t peekBits( int n );
+  void consumeBits( int n );
+  uint32_t getBits( int n ) { uint32_t v = peekBits( n ); consumeBits( n ); return v; }
+  int decodeSymbol( const Huffman &h );
+
+  void readBlockHeader();
+  void readDynamicTables();
+  void reserveOutput( std::size_t n );
+  void inflateSome( std::size_t wanted );
+};
@@ -0,0 +1,116 @@
+#include "MappedFile.hpp"
+
+#include "ErrorString.hpp"
+#include "readFile.hpp"
+
+#include <exception>
+
+#ifdef _WIN32
+#   define NOMINMAX
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#   include <string>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+MappedFile::MappedFile( const char *filePath, Access access )
+{
+  if( access == Access::mapOrRead && tryMap( filePath ))
+    return;
+
+  try
+  {
+    buffer = readFile( filePath );
+  }
+  catch( const std::exception &e )
+  {
+    throw ErrorString( e.what());
+  }
+
+  bytes = reinterpret_cast< const unsigned char * >( buffer.data());
+  nBytes = buffer.size();
+}
+
+#ifdef _WIN32
+
+bool
+MappedFile::tryMap( const char *filePath )
+{
+  // filePath is utf8 (see main.cpp) but CreateFileA would interpret it in the current code page
+  const int wideLength = MultiByteToWideChar( CP_UTF8, 0, filePath, -1, nullptr, 0 );
+  if( wideLength <= 0 )
+    return false;
+
+  std::wstring widePath( wideLength, L'\0' );
+  MultiByteToWideChar( CP_UTF8, 0, filePath, -1, widePath.data(), wideLength );
+
+  HANDLE file = CreateFileW(
+      widePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+  if( file == INVALID_HANDLE_VALUE )
+    return false;
+
+  Destroyer closeFile{ [ = ] { CloseHandle( file ); }};
+
+  LARGE_INTEGER fileSize{};
+  if( !GetFileSizeEx( file, &fileSize ) || fileSize.QuadPart <= 0 )
+    return false;
+
+  HANDLE mapping = CreateFileMappingW( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+  if( !mapping )
+    return false;
+
+  Destroyer closeMapping{ [ = ] { CloseHandle( mapping ); }};
+
+  void *view = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+  if( !view )
+    return false;
+
+  // the view keeps the mapping and the file alive after their handles are closed
+  bytes = static_cast< const unsigned char * >( view );
+  nBytes = static_cast< std::size_t >( fileSize.QuadPart );
+  mapped = true;
+  _mapping = Destroyer{ [ = ] { UnmapViewOfFile( view ); }};
+
+  return true;
+}
+
+#else
+
+bool
+MappedFile::tryMap( const char *filePath )
+{
+  const int fd = open( filePath, O_RDONLY | O_CLOEXEC );
+  if( fd < 0 )
+    return false;
+
+  // the mapping stays valid after the descriptor is closed
+  Destroyer closeFile{ [ = ] { close( fd ); }};
+
+  struct stat fileStat{};
+  if( fstat( fd, &fileStat ) != 0 || !S_ISREG( fileStat.st_mode ) || fileStat.st_size <= 0 )
+    return false;
+
+  const auto length = static_cast< std::size_t >( fileStat.st_size );
+
+  void *view = mmap( nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+  if( view == MAP_FAILED )
+    return false;
+
+  // decoders read front to back: ask for aggressive readahead and early reclaim behind the reader
+  madvise( view, length, MADV_SEQUENTIAL );
+  madvise( view, length, MADV_WILLNEED );
+
+  bytes = static_cast< const unsigned char * >( view );
+  nBytes = length;
+  mapped = true;
+  _mapping = Destroyer{ [ = ] { munmap( view, length ); }};
+
+  return true;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Destroyer.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// Read-only view of all the bytes of a file.
+// By default the file is memory-mapped so decoders can read it in place without an extra copy;
+// if mapping fails (or Access::read is requested) the file is read into an owned buffer instead.
+
+struct MappedFile
+{
+  enum class Access
+  {
+    mapOrRead,
+    read
+  };
+
+  explicit
+  MappedFile( const char *filePath, Access access = Access::mapOrRead )
+  noexcept( false ); // throws ErrorString
+
+  MappedFile( MappedFile && ) = default;
+  MappedFile &operator=( MappedFile && ) = default;
+
+  const unsigned char *data() const { return bytes; }
+  std::size_t size() const { return nBytes; }
+  bool isMapped() const { return mapped; }
+
+private:
+  const unsigned char *bytes{};
+  std::size_t nBytes{};
+  bool mapped{};
+  std::vector< char > buffer; // only used when not mapped
+  Destroyer _mapping;
+
+  bool tryMap( const char *filePath );
+};
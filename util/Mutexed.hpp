@@ -2,6 +2,7 @@
 
 #include "NoCopy.hpp"
 
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <mutex>
@@ -50,4 +51,29 @@ public:
     cv.wait( lk, std::bind( std::forward< Predicate >( predicate ), std::cref( v )));
     return std::forward< Then >( then )( v, std::forward< ThenArgs >( thenArgs )... );
   }
+
+  // like waitThen, but also stops waiting at deadline even if predicate is still false
+  template< typename Clock, typename Duration, typename Predicate, typename Then, typename ... ThenArgs >
+  auto waitUntilThen(
+      const std::chrono::time_point< Clock, Duration > &deadline,
+      Predicate &&predicate, // (const T &) -> bool
+      Then &&then, // (T &, ThenArgs...) -> auto
+      ThenArgs &&... thenArgs )
+  {
+    std::unique_lock lk( m );
+    cv.wait_until( lk, deadline, std::bind( std::forward< Predicate >( predicate ), std::cref( v )));
+    return std::forward< Then >( then )( v, std::forward< ThenArgs >( thenArgs )... );
+  }
+
+  template< typename Predicate, typename Then, typename ... ThenArgs >
+  auto waitThenNotify(
+      Predicate &&predicate, // (const T &) -> bool
+      Then &&then, // (T &, ThenArgs...) -> auto
+      ThenArgs &&... thenArgs )
+  {
+    std::unique_lock lk( m );
+    cv.wait( lk, std::bind( std::forward< Predicate >( predicate ), std::cref( v )));
+    struct NotifyOnExit { std::condition_variable &cv; ~NotifyOnExit() { cv.notify_one(); } } notifyOnExit{ cv };
+    return std::forward< Then >( then )( v, std::forward< ThenArgs >( thenArgs )... );
+  }
 };
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "NoCopy.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+// Bounded lock-free queue for exactly one producing thread and one consuming thread.
+
+template< class T >
+class SpscQueue : NoCopy
+{
+  const std::size_t nSlots; // one more than the capacity: a full queue still has one empty slot
+  std::unique_ptr< T[] > slots;
+  alignas( 64 ) std::atomic< std::size_t > head{}; // next slot to pop, only written by the consumer
+  alignas( 64 ) std::atomic< std::size_t > tail{}; // next slot to push, only written by the producer
+
+  std::size_t next( std::size_t i ) const { return i + 1 == nSlots ? 0 : i + 1; }
+
+public:
+  explicit
+  SpscQueue( std::size_t capacity )
+      : nSlots{ capacity + 1 }
+      , slots{ new T[ capacity + 1 ]} {}
+
+  // producer thread only; false if the queue is full, and then v is left as it was
+  bool tryPush( T &&v )
+  {
+    const std::size_t t = tail.load( std::memory_order_relaxed );
+    if( next( t ) == head.load( std::memory_order_acquire ))
+      return false;
+
+    slots[ t ] = std::move( v );
+    tail.store( next( t ), std::memory_order_release );
+    return true;
+  }
+
+  // consumer thread only
+  std::optional< T > tryPop()
+  {
+    const std::size_t h = head.load( std::memory_order_relaxed );
+    if( h == tail.load( std::memory_order_acquire ))
+      return std::nullopt;
+
+    std::optional< T > v{ std::move( slots[ h ] ) };
+    head.store( next( h ), std::memory_order_release );
+    return v;
+  }
+};
@@ -0,0 +1,114 @@
+#include "TextureUploadRing.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+  void
+  texSubImage(
+      GLenum target, GLint level, int layer,
+      int firstRow, int width, int nRows,
+      GLenum format, GLenum type,
+      const void *pixels )
+  {
+    if( layer < 0 )
+      glTexSubImage2D( target, level, 0, firstRow, width, nRows, format, type, pixels );
+    else
+      glTexSubImage3D( target, level, 0, firstRow, layer, width, nRows, 1, format, type, pixels );
+  }
+} // namespace
+
+TextureUploadRing::TextureUploadRing()
+{
+  glGenBuffers( nBuffers, buffers );
+  _buffers = Destroyer{ [ this ]
+  {
+    for( Slot &slot : this->slots )
+      if( slot.fence )
+        glDeleteSync( slot.fence );
+    glDeleteBuffers( nBuffers, this->buffers );
+  }};
+}
+
+void
+TextureUploadRing::upload(
+    GLenum target, GLint level,
+    int firstRow, int width, int nRows,
+    GLenum format, GLenum type,
+    const unsigned char *rows, std::size_t rowBytes )
+{
+  uploadLayer( target, level, -1, firstRow, width, nRows, format, type, rows, rowBytes );
+}
+
+void
+TextureUploadRing::uploadLayer(
+    GLenum target, GLint level, int layer,
+    int firstRow, int width, int nRows,
+    GLenum format, GLenum type,
+    const unsigned char *rows, std::size_t rowBytes )
+{
+  glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+  glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+  glPixelStorei( GL_UNPACK_SKIP_PIXELS, 0 );
+  glPixelStorei( GL_UNPACK_SKIP_ROWS, 0 );
+
+  // rows wider than a whole buffer still go one at a time
+  const int rowsPerChunk = std::max( 1, (int)( bufferBytes / rowBytes ));
+
+  for( int row = 0; row < nRows; row += rowsPerChunk )
+  {
+    const int chunkRows = std::min( rowsPerChunk, nRows - row );
+    uploadChunk(
+        target, level, layer, firstRow + row, width, chunkRows, format, type,
+        rows + row * rowBytes, chunkRows * rowBytes );
+  }
+}
+
+void
+TextureUploadRing::uploadChunk(
+    GLenum target, GLint level, int layer,
+    int firstRow, int width, int nRows,
+    GLenum format, GLenum type,
+    const unsigned char *rows, std::size_t nBytes )
+{
+  Slot &slot = slots[ next ];
+  glBindBuffer( GL_PIXEL_UNPACK_BUFFER, buffers[ next ] );
+  next = ( next + 1 ) % nBuffers;
+
+  // the previous upload from this buffer is done with it: write over it without any synchronization;
+  // otherwise orphan it (or make it bigger)
+  const bool reusable =
+      slot.fence && slot.size >= nBytes && glClientWaitSync( slot.fence, 0, 0 ) != GL_TIMEOUT_EXPIRED;
+
+  if( slot.fence )
+    glDeleteSync( std::exchange( slot.fence, nullptr ));
+
+  GLbitfield access = GL_MAP_WRITE_BIT;
+  if( reusable )
+    access |= GL_MAP_UNSYNCHRONIZED_BIT;
+  else
+  {
+    slot.size = std::max( nBytes, bufferBytes );
+    glBufferData( GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)slot.size, nullptr, GL_STREAM_DRAW );
+  }
+
+  if( void *mapped = glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)nBytes, access ))
+  {
+    std::memcpy( mapped, rows, nBytes );
+
+    // the buffer's contents can be lost while it's mapped (e.g. a mode switch on some platforms): then just retry from memory
+    if( glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER ) == GL_TRUE )
+    {
+      texSubImage( target, level, layer, firstRow, width, nRows, format, type, nullptr ); // offset 0 into the buffer
+      slot.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+      glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+      return;
+    }
+  }
+
+  // couldn't map it: upload straight from client memory
+  glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+  texSubImage( target, level, layer, firstRow, width, nRows, format, type, rows );
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#define GL_SILENCE_DEPRECATION // MacOS has deprecated OpenGL - it still works up to 4.1 for now
+#include <gl/glew.h>
+
+#include "Destroyer.hpp"
+#include "NoCopy.hpp"
+
+#include <cstddef>
+
+// Uploads rows of pixels to a texture through a small ring of pixel unpack buffers,
+// so glTexSubImage2D returns as soon as the rows are in a buffer and the driver copies them to the texture
+// while the render thread (and the decoder) carry on, instead of blocking on a copy out of client memory.
+//
+// Each buffer gets a fence after its upload; a buffer whose fence has signalled is rewritten in place,
+// one still in flight is orphaned so the driver hands back fresh storage rather than waiting for it.
+
+struct TextureUploadRing : NoCopy
+{
+  TextureUploadRing();
+
+  // same as glTexSubImage2D( target, level, 0, firstRow, width, nRows, format, type, rows )
+  // for rows rowBytes apart with GL_UNPACK_ALIGNMENT 1; expects the texture bound to target
+  void upload(
+      GLenum target, GLint level,
+      int firstRow, int width, int nRows,
+      GLenum format, GLenum type,
+      const unsigned char *rows, std::size_t rowBytes );
+
+  // the same into one layer of a 2D array texture: glTexSubImage3D( target, level, 0, firstRow, layer, width, nRows, 1, .. )
+  void uploadLayer(
+      GLenum target, GLint level, int layer,
+      int firstRow, int width, int nRows,
+      GLenum format, GLenum type,
+      const unsigned char *rows, std::size_t rowBytes );
+
+private:
+  static constexpr int nBuffers = 3;
+  static constexpr std::size_t bufferBytes = 8 << 20;
+
+  struct Slot
+  {
+    GLsync fence{}; // set once the upload from this buffer has been issued
+    std::size_t size{};
+  };
+
+  GLuint buffers[ nBuffers ]{};
+  Destroyer _buffers;
+  Slot slots[ nBuffers ];
+  int next{};
+
+  // layer -1 for a 2D texture
+  void uploadChunk(
+      GLenum target, GLint level, int layer,
+      int firstRow, int width, int nRows,
+      GLenum format, GLenum type,
+      const unsigned char *rows, std::size_t nBytes );
+};
@@ -0,0 +1,120 @@
+#include "compressBc1.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace
+{
+  struct Rgb
+  {
+    int r, g, b;
+  };
+
+  uint16_t
+  to565( const Rgb &c )
+  {
+    return (uint16_t)((( c.r * 31 + 127 ) / 255 ) << 11 | (( c.g * 63 + 127 ) / 255 ) << 5 | ( c.b * 31 + 127 ) / 255 );
+  }
+
+  // what the GPU decodes a 5:6:5 colour to
+  Rgb
+  from565( uint16_t c )
+  {
+    const int r = c >> 11, g = ( c >> 5 ) & 63, b = c & 31;
+    return { r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2 };
+  }
+
+  // Endpoints at the corners of the block's bounding box (inset a little, as the extremes are rarely worth
+  // matching exactly), on whichever of its diagonals follows the colours, then each pixel's nearest of the four.
+  void
+  compressBlock( const Rgb ( &block )[ 16 ], unsigned char *out )
+  {
+    Rgb lo{ 255, 255, 255 }, hi{ 0, 0, 0 }, sum{};
+    for( const Rgb &c : block )
+    {
+      lo = { std::min( lo.r, c.r ), std::min( lo.g, c.g ), std::min( lo.b, c.b ) };
+      hi = { std::max( hi.r, c.r ), std::max( hi.g, c.g ), std::max( hi.b, c.b ) };
+      sum = { sum.r + c.r, sum.g + c.g, sum.b + c.b };
+    }
+
+    // green and blue against red (or blue against green, where red doesn't vary): a negative covariance
+    // puts the colours on the diagonal from low red to high green or blue
+    int rg = 0, rb = 0, gb = 0;
+    for( const Rgb &c : block )
+    {
+      const int dr = c.r * 16 - sum.r, dg = c.g * 16 - sum.g, db = c.b * 16 - sum.b;
+      rg += dr * dg / 256;
+      rb += dr * db / 256;
+      gb += dg * db / 256;
+    }
+    if( hi.r > lo.r && rg < 0 )
+      std::swap( lo.g, hi.g );
+    if( hi.r > lo.r ? rb < 0 : gb < 0 )
+      std::swap( lo.b, hi.b );
+
+    auto inset = []( int &l, int &h ) { const int d = ( h - l ) / 16; l += d; h -= d; };
+    inset( lo.r, hi.r );
+    inset( lo.g, hi.g );
+    inset( lo.b, hi.b );
+
+    uint16_t c0 = to565( hi ), c1 = to565( lo );
+    uint32_t indices = 0;
+
+    if( c0 != c1 ) // otherwise a flat block: every index 0
+    {
+      if( c0 < c1 ) // the four colour mode needs c0 > c1
+        std::swap( c0, c1 );
+
+      const Rgb e0 = from565( c0 ), e1 = from565( c1 );
+      const Rgb palette[ 4 ]{
+          e0, e1,
+          { ( 2 * e0.r + e1.r ) / 3, ( 2 * e0.g + e1.g ) / 3, ( 2 * e0.b + e1.b ) / 3 },
+          { ( e0.r + 2 * e1.r ) / 3, ( e0.g + 2 * e1.g ) / 3, ( e0.b + 2 * e1.b ) / 3 }};
+
+      for( int i = 0; i < 16; ++i )
+      {
+        int best = 0, bestDistance = INT32_MAX;
+        for( int p = 0; p < 4; ++p )
+        {
+          const int dr = block[ i ].r - palette[ p ].r, dg = block[ i ].g - palette[ p ].g, db = block[ i ].b - palette[ p ].b;
+          if( const int distance = dr * dr + dg * dg + db * db; distance < bestDistance )
+          {
+            best = p;
+            bestDistance = distance;
+          }
+        }
+        indices |= (uint32_t)best << ( 2 * i );
+      }
+    }
+
+    // little endian, whatever the CPU
+    const unsigned char bytes[ 8 ]{
+        (unsigned char)c0, (unsigned char)( c0 >> 8 ), (unsigned char)c1, (unsigned char)( c1 >> 8 ),
+        (unsigned char)indices, (unsigned char)( indices >> 8 ), (unsigned char)( indices >> 16 ), (unsigned char)( indices >> 24 ) };
+    std::copy( std::begin( bytes ), std::end( bytes ), out );
+  }
+} // namespace
+
+std::vector< unsigned char >
+compressBc1( const unsigned char *pixels, int width, int height, int nChannels, std::size_t rowBytes )
+{
+  std::vector< unsigned char > blocks( getBc1Bytes( width, height ));
+  unsigned char *out = blocks.data();
+
+  for( int by = 0; by < height; by += 4 )
+    for( int bx = 0; bx < width; bx += 4, out += 8 )
+    {
+      Rgb block[ 16 ];
+      for( int y = 0; y < 4; ++y )
+        for( int x = 0; x < 4; ++x )
+        {
+          const unsigned char *p =
+              pixels + std::min( by + y, height - 1 ) * rowBytes + (std::size_t)std::min( bx + x, width - 1 ) * nChannels;
+          block[ y * 4 + x ] = nChannels >= 3 ? Rgb{ p[ 0 ], p[ 1 ], p[ 2 ] } : Rgb{ p[ 0 ], p[ 0 ], p[ 0 ] };
+        }
+
+      compressBlock( block, out );
+    }
+
+  return blocks;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// BC1 (DXT1, GL_COMPRESSED_RGB_S3TC_DXT1_EXT) block compression of opaque 8 bit pixels: each 4 by 4 block of pixels
+// becomes 8 bytes, two 5:6:5 colours and a 2 bit index per pixel into them and the two colours between them.
+// That's an eighth of RGBA8, at the cost of some colour banding within blocks; fast rather than optimal,
+// for compressing textures as they are made.
+//
+// nChannels is 1 (grey) or 3 (RGB); blocks past the edges repeat the last row and column.
+// Returns the blocks, left to right then top to bottom.
+
+std::vector< unsigned char >
+compressBc1( const unsigned char *pixels, int width, int height, int nChannels, std::size_t rowBytes );
+
+constexpr std::size_t
+getBc1Bytes( int width, int height )
+{
+  return (std::size_t)(( width + 3 ) / 4 ) * (( height + 3 ) / 4 ) * 8;
+}
@@ -0,0 +1,320 @@
+#include "convertPixels.hpp"
+
+#if ( defined( __x86_64__ ) || defined( __i386__ )) && defined( __GNUC__ )
+#define CONVERT_PIXELS_X86 // compiled for any x86, used where __builtin_cpu_supports(..) says
+#include <immintrin.h>
+#define TARGET( isa ) __attribute__(( target( isa )))
+#elif defined( __aarch64__ )
+#define CONVERT_PIXELS_NEON // every aarch64 CPU has it
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+  // exactly round( c * a / 255 )
+  inline unsigned char
+  multiplyByAlpha( unsigned c, unsigned a )
+  {
+    const unsigned t = c * a + 128;
+    return (unsigned char)(( t + ( t >> 8 )) >> 8 );
+  }
+
+//==============================================================================
+// scalar: the reference the others are checked against, and the tails they leave
+
+  void
+  premultiplyAlphaScalar( unsigned char *pixels, std::size_t nPixels, int nChannels )
+  {
+    for( unsigned char *p = pixels, *end = pixels + nPixels * nChannels; p != end; p += nChannels )
+      for( int c = 0; c < nChannels - 1; ++c )
+        p[ c ] = multiplyByAlpha( p[ c ], p[ nChannels - 1 ] );
+  }
+
+  void
+  expandRgbToRgbaScalar( const unsigned char *rgb, unsigned char *rgba, std::size_t nPixels )
+  {
+    for( std::size_t i = 0; i < nPixels; ++i, rgb += 3, rgba += 4 )
+    {
+      rgba[ 0 ] = rgb[ 0 ];
+      rgba[ 1 ] = rgb[ 1 ];
+      rgba[ 2 ] = rgb[ 2 ];
+      rgba[ 3 ] = 255;
+    }
+  }
+
+  void
+  reduce16To8Scalar( const uint16_t *channels, unsigned char *out, std::size_t nChannels )
+  {
+    for( std::size_t i = 0; i < nChannels; ++i )
+      out[ i ] = (unsigned char)(( channels[ i ] * 255u + 32895 ) >> 16 );
+  }
+
+  constexpr PixelConversions scalar{ "scalar", premultiplyAlphaScalar, expandRgbToRgbaScalar, reduce16To8Scalar };
+
+//==============================================================================
+// x86
+
+#ifdef CONVERT_PIXELS_X86
+
+  // for 16 bit channels in a 128 bit lane: which bytes hold each channel's alpha, and which channels are alphas
+  struct AlphaMasks128
+  {
+    __m128i broadcast, isAlpha;
+  };
+
+  TARGET( "sse4.1" ) AlphaMasks128
+  getAlphaMasks128( int nChannels )
+  {
+    if( nChannels == 2 )
+      return {
+          _mm_setr_epi8( 2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15 ),
+          _mm_setr_epi8( 0, 0, -1, -1, 0, 0, -1, -1, 0, 0, -1, -1, 0, 0, -1, -1 ) };
+
+    return {
+        _mm_setr_epi8( 6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15 ),
+        _mm_setr_epi8( 0, 0, 0, 0, 0, 0, -1, -1, 0, 0, 0, 0, 0, 0, -1, -1 ) };
+  }
+
+  // multiplyByAlpha(..) on 16 bit channels, leaving the alphas as they are
+  TARGET( "sse4.1" ) __m128i
+  premultiply128( __m128i channels, const AlphaMasks128 &masks )
+  {
+    const __m128i t = _mm_add_epi16( _mm_mullo_epi16( channels, _mm_shuffle_epi8( channels, masks.broadcast )), _mm_set1_epi16( 128 ));
+    const __m128i premultiplied = _mm_srli_epi16( _mm_add_epi16( t, _mm_srli_epi16( t, 8 )), 8 );
+    return _mm_blendv_epi8( premultiplied, channels, masks.isAlpha );
+  }
+
+  // 4 RGBA or 8 grey and alpha pixels at a time
+  TARGET( "sse4.1" ) void
+  premultiplyAlphaSse41( unsigned char *pixels, std::size_t nPixels, int nChannels )
+  {
+    const AlphaMasks128 masks = getAlphaMasks128( nChannels );
+    const std::size_t nBytes = nPixels * nChannels;
+
+    std::size_t i = 0;
+    for( ; i + 16 <= nBytes; i += 16 )
+    {
+      const __m128i bytes = _mm_loadu_si128( reinterpret_cast< const __m128i * >( pixels + i ));
+      const __m128i low = premultiply128( _mm_cvtepu8_epi16( bytes ), masks );
+      const __m128i high = premultiply128( _mm_cvtepu8_epi16( _mm_srli_si128( bytes, 8 )), masks );
+      _mm_storeu_si128( reinterpret_cast< __m128i * >( pixels + i ), _mm_packus_epi16( low, high ));
+    }
+
+    premultiplyAlphaScalar( pixels + i, ( nBytes - i ) / nChannels, nChannels );
+  }
+
+  TARGET( "avx2" ) __m256i
+  premultiply256( __m256i channels, __m256i broadcast, __m256i isAlpha )
+  {
+    const __m256i t = _mm256_add_epi16( _mm256_mullo_epi16( channels, _mm256_shuffle_epi8( channels, broadcast )), _mm256_set1_epi16( 128 ));
+    const __m256i premultiplied = _mm256_srli_epi16( _mm256_add_epi16( t, _mm256_srli_epi16( t, 8 )), 8 );
+    return _mm256_blendv_epi8( premultiplied, channels, isAlpha );
+  }
+
+  TARGET( "avx2" ) void
+  premultiplyAlphaAvx2( unsigned char *pixels, std::size_t nPixels, int nChannels )
+  {
+    const AlphaMasks128 masks = getAlphaMasks128( nChannels );
+    const __m256i broadcast = _mm256_broadcastsi128_si256( masks.broadcast );
+    const __m256i isAlpha = _mm256_broadcastsi128_si256( masks.isAlpha );
+    const std::size_t nBytes = nPixels * nChannels;
+
+    std::size_t i = 0;
+    for( ; i + 32 <= nBytes; i += 32 )
+    {
+      const __m256i low = premultiply256(
+          _mm256_cvtepu8_epi16( _mm_loadu_si128( reinterpret_cast< const __m128i * >( pixels + i ))), broadcast, isAlpha );
+      const __m256i high = premultiply256(
+          _mm256_cvtepu8_epi16( _mm_loadu_si128( reinterpret_cast< const __m128i * >( pixels + i + 16 ))), broadcast, isAlpha );
+      // packus works within 128 bit lanes: put the quarters back in order
+      _mm256_storeu_si256( reinterpret_cast< __m256i * >( pixels + i ), _mm256_permute4x64_epi64( _mm256_packus_epi16( low, high ), 0xd8 ));
+    }
+
+    premultiplyAlphaScalar( pixels + i, ( nBytes - i ) / nChannels, nChannels );
+  }
+
+  // 4 pixels a load, which reads 4 bytes past them: the loop stops 2 pixels short of the end
+  TARGET( "sse4.1" ) void
+  expandRgbToRgbaSse41( const unsigned char *rgb, unsigned char *rgba, std::size_t nPixels )
+  {
+    const __m128i spread = _mm_setr_epi8( 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 );
+    const __m128i opaque = _mm_set1_epi32( (int)0xff000000 );
+
+    std::size_t i = 0;
+    for( ; i + 6 <= nPixels; i += 4 )
+    {
+      const __m128i pixels = _mm_loadu_si128( reinterpret_cast< const __m128i * >( rgb + i * 3 ));
+      _mm_storeu_si128( reinterpret_cast< __m128i * >( rgba + i * 4 ), _mm_or_si128( _mm_shuffle_epi8( pixels, spread ), opaque ));
+    }
+
+    expandRgbToRgbaScalar( rgb + i * 3, rgba + i * 4, nPixels - i );
+  }
+
+  // 8 pixels as two loads of 4, the second of which reads 4 bytes past them
+  TARGET( "avx2" ) void
+  expandRgbToRgbaAvx2( const unsigned char *rgb, unsigned char *rgba, std::size_t nPixels )
+  {
+    const __m256i spread = _mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 );
+    const __m256i opaque = _mm256_set1_epi32( (int)0xff000000 );
+
+    std::size_t i = 0;
+    for( ; i + 10 <= nPixels; i += 8 )
+    {
+      const __m256i pixels = _mm256_inserti128_si256(
+          _mm256_castsi128_si256( _mm_loadu_si128( reinterpret_cast< const __m128i * >( rgb + i * 3 ))),
+          _mm_loadu_si128( reinterpret_cast< const __m128i * >( rgb + i * 3 + 12 )), 1 );
+      _mm256_storeu_si256( reinterpret_cast< __m256i * >( rgba + i * 4 ), _mm256_or_si256( _mm256_shuffle_epi8( pixels, spread ), opaque ));
+    }
+
+    expandRgbToRgbaScalar( rgb + i * 3, rgba + i * 4, nPixels - i );
+  }
+
+  // round( x / 257 ) in 16 bits: v = x + 128 (saturating), then ( v - v / 256 ) / 256
+  TARGET( "sse4.1" ) __m128i
+  reduce128( __m128i x )
+  {
+    const __m128i v = _mm_adds_epu16( x, _mm_set1_epi16( 128 ));
+    return _mm_srli_epi16( _mm_sub_epi16( v, _mm_srli_epi16( v, 8 )), 8 );
+  }
+
+  TARGET( "sse4.1" ) void
+  reduce16To8Sse41( const uint16_t *channels, unsigned char *out, std::size_t nChannels )
+  {
+    std::size_t i = 0;
+    for( ; i + 16 <= nChannels; i += 16 )
+    {
+      const __m128i low = reduce128( _mm_loadu_si128( reinterpret_cast< const __m128i * >( channels + i )));
+      const __m128i high = reduce128( _mm_loadu_si128( reinterpret_cast< const __m128i * >( channels + i + 8 )));
+      _mm_storeu_si128( reinterpret_cast< __m128i * >( out + i ), _mm_packus_epi16( low, high ));
+    }
+
+    reduce16To8Scalar( channels + i, out + i, nChannels - i );
+  }
+
+  TARGET( "avx2" ) __m256i
+  reduce256( __m256i x )
+  {
+    const __m256i v = _mm256_adds_epu16( x, _mm256_set1_epi16( 128 ));
+    return _mm256_srli_epi16( _mm256_sub_epi16( v, _mm256_srli_epi16( v, 8 )), 8 );
+  }
+
+  TARGET( "avx2" ) void
+  reduce16To8Avx2( const uint16_t *channels, unsigned char *out, std::size_t nChannels )
+  {
+    std::size_t i = 0;
+    for( ; i + 32 <= nChannels; i += 32 )
+    {
+      const __m256i low = reduce256( _mm256_loadu_si256( reinterpret_cast< const __m256i * >( channels + i )));
+      const __m256i high = reduce256( _mm256_loadu_si256( reinterpret_cast< const __m256i * >( channels + i + 16 )));
+      _mm256_storeu_si256( reinterpret_cast< __m256i * >( out + i ), _mm256_permute4x64_epi64( _mm256_packus_epi16( low, high ), 0xd8 ));
+    }
+
+    reduce16To8Scalar( channels + i, out + i, nChannels - i );
+  }
+
+  constexpr PixelConversions sse41{ "SSE4.1", premultiplyAlphaSse41, expandRgbToRgbaSse41, reduce16To8Sse41 };
+  constexpr PixelConversions avx2{ "AVX2", premultiplyAlphaAvx2, expandRgbToRgbaAvx2, reduce16To8Avx2 };
+
+#endif
+
+//==============================================================================
+// ARM
+
+#ifdef CONVERT_PIXELS_NEON
+
+  // multiplyByAlpha(..): t = c * a, then ( t + 128 + ( t + 128 ) / 256 ) / 256
+  uint8x16_t
+  multiplyByAlphaNeon( uint8x16_t c, uint8x16_t a )
+  {
+    const uint16x8_t low = vmull_u8( vget_low_u8( c ), vget_low_u8( a ));
+    const uint16x8_t high = vmull_u8( vget_high_u8( c ), vget_high_u8( a ));
+    return vcombine_u8( vraddhn_u16( low, vrshrq_n_u16( low, 8 )), vraddhn_u16( high, vrshrq_n_u16( high, 8 )));
+  }
+
+  // 16 pixels at a time, deinterleaved by the loads
+  void
+  premultiplyAlphaNeon( unsigned char *pixels, std::size_t nPixels, int nChannels )
+  {
+    std::size_t i = 0;
+    if( nChannels == 4 )
+      for( ; i + 16 <= nPixels; i += 16 )
+      {
+        uint8x16x4_t p = vld4q_u8( pixels + i * 4 );
+        p.val[ 0 ] = multiplyByAlphaNeon( p.val[ 0 ], p.val[ 3 ] );
+        p.val[ 1 ] = multiplyByAlphaNeon( p.val[ 1 ], p.val[ 3 ] );
+        p.val[ 2 ] = multiplyByAlphaNeon( p.val[ 2 ], p.val[ 3 ] );
+        vst4q_u8( pixels + i * 4, p );
+      }
+    else
+      for( ; i + 16 <= nPixels; i += 16 )
+      {
+        uint8x16x2_t p = vld2q_u8( pixels + i * 2 );
+        p.val[ 0 ] = multiplyByAlphaNeon( p.val[ 0 ], p.val[ 1 ] );
+        vst2q_u8( pixels + i * 2, p );
+      }
+
+    premultiplyAlphaScalar( pixels + i * nChannels, nPixels - i, nChannels );
+  }
+
+  void
+  expandRgbToRgbaNeon( const unsigned char *rgb, unsigned char *rgba, std::size_t nPixels )
+  {
+    std::size_t i = 0;
+    for( ; i + 16 <= nPixels; i += 16 )
+    {
+      const uint8x16x3_t p = vld3q_u8( rgb + i * 3 );
+      vst4q_u8( rgba + i * 4, uint8x16x4_t{{ p.val[ 0 ], p.val[ 1 ], p.val[ 2 ], vdupq_n_u8( 255 ) }} );
+    }
+
+    expandRgbToRgbaScalar( rgb + i * 3, rgba + i * 4, nPixels - i );
+  }
+
+  // round( x / 257 ) in 16 bits, as for x86
+  void
+  reduce16To8Neon( const uint16_t *channels, unsigned char *out, std::size_t nChannels )
+  {
+    std::size_t i = 0;
+    for( ; i + 8 <= nChannels; i += 8 )
+    {
+      const uint16x8_t v = vqaddq_u16( vld1q_u16( channels + i ), vdupq_n_u16( 128 ));
+      vst1_u8( out + i, vshrn_n_u16( vsubq_u16( v, vshrq_n_u16( v, 8 )), 8 ));
+    }
+
+    reduce16To8Scalar( channels + i, out + i, nChannels - i );
+  }
+
+  constexpr PixelConversions neon{ "NEON", premultiplyAlphaNeon, expandRgbToRgbaNeon, reduce16To8Neon };
+
+#endif
+} // namespace
+
+//==============================================================================
+
+const PixelConversions &
+getPixelConversions()
+{
+  static const PixelConversions &best = *getSupportedPixelConversions().back();
+  return best;
+}
+
+std::vector< const PixelConversions * >
+getSupportedPixelConversions()
+{
+  std::vector< const PixelConversions * > supported{ &scalar };
+
+#ifdef CONVERT_PIXELS_X86
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports( "sse4.1" ))
+    supported.push_back( &sse41 );
+  if( __builtin_cpu_supports( "avx2" ))
+    supported.push_back( &avx2 );
+#endif
+
+#ifdef CONVERT_PIXELS_NEON
+  supported.push_back( &neon );
+#endif
+
+  return supported;
+}
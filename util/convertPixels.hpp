@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Conversions of 8 (and 16) bit pixels on their way from the decoder to a texture, each in a scalar version and
+// in SIMD versions for the instruction sets this CPU turns out to have: AVX2 or SSE4.1 on x86, NEON on ARM.
+// All of them give the same results, exactly rounded.
+
+struct PixelConversions
+{
+  const char *name; // "AVX2", "SSE4.1", "NEON" or "scalar"
+
+  // in place, channels times alpha (the last channel), for nChannels 2 (grey and alpha) or 4 (RGBA)
+  void ( *premultiplyAlpha )( unsigned char *pixels, std::size_t nPixels, int nChannels );
+
+  // RGB to RGBA, with alpha 255
+  void ( *expandRgbToRgba )( const unsigned char *rgb, unsigned char *rgba, std::size_t nPixels );
+
+  // 16 bit channels to 8 bit, rounded to nearest
+  void ( *reduce16To8 )( const uint16_t *channels, unsigned char *out, std::size_t nChannels );
+};
+
+// the fastest this CPU supports, chosen on first use
+const PixelConversions &
+getPixelConversions();
+
+// every version this CPU supports, scalar first: for benchmarking and checking them against each other
+std::vector< const PixelConversions * >
+getSupportedPixelConversions();
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string_view>
+
+// The sources of the shaders directory, compiled into the executable (by cmake/embedShaders.cmake),
+// so that it doesn't depend on where it's run from.
+
+// by file name, e.g. "texture.frag"
+std::string_view
+getEmbeddedShader( std::string_view name )
+noexcept( false ); // throws ErrorString
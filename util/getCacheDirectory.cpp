@@ -0,0 +1,34 @@
+#include "getCacheDirectory.hpp"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <utility>
+
+std::optional< std::filesystem::path >
+getCacheDirectory( const char *subdirectory )
+{
+  for( const auto &[ variable, parent ] : {
+      std::pair{ "XDG_CACHE_HOME", "" }, std::pair{ "HOME", ".cache" }, std::pair{ "LOCALAPPDATA", "" }} )
+    if( const char *value = std::getenv( variable ); value && *value )
+      return std::filesystem::path( value ) / parent / "imageviewergl" / subdirectory;
+
+  return std::nullopt;
+}
+
+std::filesystem::path
+getTemporaryPath( const std::filesystem::path &path )
+{
+  static std::atomic< unsigned > counter{};
+
+  std::filesystem::path temporary = path;
+  temporary += "." + std::to_string( getpid()) + "." + std::to_string( counter++ ) + ".tmp";
+  return temporary;
+}
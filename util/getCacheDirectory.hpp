@@ -0,0 +1,14 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+
+// $XDG_CACHE_HOME/imageviewergl/<subdirectory> (~/.cache when unset, %LOCALAPPDATA% on Windows),
+// which may not exist yet; nullopt when none of those variables are set
+std::optional< std::filesystem::path >
+getCacheDirectory( const char *subdirectory );
+
+// Where to write a new version of the file at path, to rename it into place once complete: unique to this process and
+// call, so two writers of the same file (two instances, or two threads of one) can't interleave their writes.
+std::filesystem::path
+getTemporaryPath( const std::filesystem::path &path );
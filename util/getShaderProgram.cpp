@@ -0,0 +1,232 @@
+#include "getShaderProgram.hpp"
+
+#include "Destroyer.hpp"
+#include "ErrorString.hpp"
+#include "embeddedShaders.hpp"
+#include "getCacheDirectory.hpp"
+#include "makeShader.hpp"
+#include "trace.hpp"
+#include "verboseLog.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+  constexpr char magic[ 8 ]{ 'I', 'V', 'G', 'L', 'P', 'B', '1', '\0' };
+
+  // followed by the binary (length bytes)
+  struct Header
+  {
+    char magic[ 8 ];
+    uint32_t format, length;
+  };
+
+  std::string_view
+  getGlString( GLenum name )
+  {
+    const GLubyte *string = glGetString( name );
+    return string ? reinterpret_cast< const char * >( string ) : "";
+  }
+
+  // the #version line has to come first
+  std::string
+  insertDefines( std::string_view source, std::string_view defines )
+  {
+    const std::size_t afterVersion = source.find( '\n' ) + 1; // 0 without one
+    return std::string{ source.substr( 0, afterVersion ) }.append( defines ).append( source.substr( afterVersion ));
+  }
+
+  // FNV-1a of the driver and the sources, so a new driver or a changed shader gets a different cache file
+  std::optional< std::filesystem::path >
+  getBinaryPath( std::string_view vertSource, std::string_view fragSource )
+  {
+    const std::optional< std::filesystem::path > directory = getCacheDirectory( "programs" );
+    if( !directory )
+      return std::nullopt;
+
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [ & ]( std::string_view bytes )
+    {
+      const uint64_t length = bytes.size(); // keeps "ab" + "c" apart from "a" + "bc"
+      for( std::size_t i = 0; i < sizeof( length ); ++i )
+        hash = ( hash ^ ( length >> 8 * i & 0xff )) * 1099511628211ull;
+      for( const char c : bytes )
+        hash = ( hash ^ (unsigned char)c ) * 1099511628211ull;
+    };
+    add( getGlString( GL_VENDOR ));
+    add( getGlString( GL_RENDERER ));
+    add( getGlString( GL_VERSION ));
+    add( vertSource );
+    add( fragSource );
+
+    char name[ 17 + 8 ];
+    std::snprintf( name, sizeof( name ), "%016llx.program", (unsigned long long)hash );
+    return *directory / name;
+  }
+
+  bool
+  isLinked( GLuint program )
+  {
+    GLint linkStatus = GL_FALSE;
+    glGetProgramiv( program, GL_LINK_STATUS, &linkStatus );
+    return linkStatus == GL_TRUE;
+  }
+
+  // 0 when there is no binary, or the driver doesn't take it any more
+  GLuint
+  loadBinary( const std::filesystem::path &path )
+  {
+    std::error_code error;
+    const uintmax_t fileSize = std::filesystem::file_size( path, error );
+    if( error || fileSize < sizeof( Header ))
+      return 0;
+
+    std::ifstream in{ path, std::ios::binary };
+    Header header{};
+    if( !in.read( reinterpret_cast< char * >( &header ), sizeof( header ))
+        || std::memcmp( header.magic, magic, sizeof( magic )) != 0 || fileSize != sizeof( header ) + header.length )
+      return 0;
+
+    std::vector< char > binary( header.length );
+    if( !in.read( binary.data(), (std::streamsize)binary.size()))
+      return 0;
+
+    const GLuint program = glCreateProgram();
+    glProgramBinary( program, header.format, binary.data(), (GLsizei)binary.size());
+    if( isLinked( program ))
+      return program;
+
+    glDeleteProgram( program );
+    return 0;
+  }
+
+  // atomically, like the previews: to a temporary file which is then renamed; failures are only logged
+  void
+  storeBinary( GLuint program, const std::filesystem::path &path )
+  {
+    GLint length = 0;
+    glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length );
+    if( length <= 0 )
+      return;
+
+    std::vector< char > binary( length );
+    GLenum format{};
+    glGetProgramBinary( program, length, &length, &format, binary.data());
+    if( length <= 0 )
+      return;
+
+    Header header{};
+    std::memcpy( header.magic, magic, sizeof( magic ));
+    header.format = format;
+    header.length = (uint32_t)length;
+
+    const std::filesystem::path temporary = getTemporaryPath( path );
+
+    std::error_code error;
+    std::filesystem::create_directories( path.parent_path(), error );
+    {
+      std::ofstream out{ temporary, std::ios::binary | std::ios::trunc };
+      out.write( reinterpret_cast< const char * >( &header ), sizeof( header ));
+      out.write( binary.data(), length );
+      if( !out )
+        error = std::make_error_code( std::errc::io_error );
+    }
+
+    if( !error )
+      std::filesystem::rename( temporary, path, error );
+
+    if( error )
+    {
+      std::filesystem::remove( temporary, error );
+      verboseLog( "program binary not stored: ", error.message());
+    }
+  }
+
+  GLuint
+  compileAndLink( std::string_view vertSource, std::string_view fragSource, bool retrievable )
+  noexcept( false )
+  {
+    const GLuint vertShader = makeShader( vertSource, GL_VERTEX_SHADER );
+    const Destroyer _vertShader{ [ = ] { glDeleteShader( vertShader ); }};
+
+    const GLuint fragShader = makeShader( fragSource, GL_FRAGMENT_SHADER );
+    const Destroyer _fragShader{ [ = ] { glDeleteShader( fragShader ); }};
+
+    const GLuint program = glCreateProgram();
+    if( retrievable )
+      glProgramParameteri( program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+    glAttachShader( program, vertShader );
+    glAttachShader( program, fragShader );
+    glLinkProgram( program );
+
+    // the program doesn't need them once linked
+    glDetachShader( program, vertShader );
+    glDetachShader( program, fragShader );
+
+    if( !isLinked( program ))
+    {
+      GLint logLength = 0;
+      glGetProgramiv( program, GL_INFO_LOG_LENGTH, &logLength );
+      std::vector< GLchar > log( std::max( logLength, 1 ));
+      glGetProgramInfoLog( program, (GLsizei)log.size(), nullptr, log.data());
+      glDeleteProgram( program );
+
+      throw ErrorString( "glLinkProgram(..) failed: ", log.data());
+    }
+
+    return program;
+  }
+} // namespace
+
+//==============================================================================
+
+GLuint
+getShaderProgram( const char *vertShaderName, const char *fragShaderName, const char *defines )
+{
+  // never deleted: they go with the context
+  static std::mutex m;
+  static std::map< std::tuple< std::string, std::string, std::string >, GLuint > programs;
+
+  std::lock_guard lk( m );
+  GLuint &program = programs[ { vertShaderName, fragShaderName, defines } ];
+  if( program )
+    return program;
+
+  const std::string vertSource = insertDefines( getEmbeddedShader( vertShaderName ), defines );
+  const std::string fragSource = insertDefines( getEmbeddedShader( fragShaderName ), defines );
+
+  GLint nBinaryFormats = 0;
+  glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &nBinaryFormats );
+  const std::optional< std::filesystem::path > binaryPath =
+      nBinaryFormats > 0 ? getBinaryPath( vertSource, fragSource ) : std::nullopt;
+
+  if( binaryPath )
+  {
+    TraceScope trace{ "load program binary", fragShaderName };
+    program = loadBinary( *binaryPath );
+  }
+
+  if( program )
+    verboseLog( "program ", vertShaderName, " + ", fragShaderName, " from ", binaryPath->string());
+  else
+  {
+    TraceScope trace{ "compile and link shaders", fragShaderName };
+    program = compileAndLink( vertSource, fragSource, binaryPath.has_value());
+    if( binaryPath )
+      storeBinary( program, *binaryPath );
+  }
+
+  return program;
+}
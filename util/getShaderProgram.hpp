@@ -0,0 +1,20 @@
+#pragma once
+
+#define GL_SILENCE_DEPRECATION // MacOS has deprecated OpenGL - it still works up to 4.1 for now
+#include <gl/glew.h>
+
+// The program linked from two of the embedded shaders (see embeddedShaders.hpp), by their file names.
+// It's made the first time it's asked for, in the GL context current then, and kept for as long as that context:
+// call it with the same context current every time (the viewer only ever has the one, which moves from the main
+// thread to the render thread).
+//
+// Where the driver can save program binaries, a linked program is also kept on disk under
+// $XDG_CACHE_HOME/imageviewergl/programs (see getCacheDirectory.hpp), keyed by the driver and the shader sources,
+// so later launches skip compiling and linking. A binary the driver rejects is just compiled again.
+//
+// defines (e.g. "#define TONE_MAPPING\n") go after each shader's #version line, for a variant of the same shaders;
+// each variant is a program of its own.
+
+GLuint
+getShaderProgram( const char *vertShaderName, const char *fragShaderName, const char *defines = "" )
+noexcept( false ); // throws ErrorString
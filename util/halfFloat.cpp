@@ -0,0 +1,26 @@
+#include "halfFloat.hpp"
+
+#if defined( __F16C__ )
+#include <immintrin.h>
+#elif defined( __aarch64__ )
+#include <arm_neon.h>
+#endif
+
+void
+convertFloatsToHalves( const float *floats, uint16_t *halves, std::size_t n )
+{
+  std::size_t i = 0;
+
+#if defined( __F16C__ )
+  for( ; i + 8 <= n; i += 8 )
+    _mm_storeu_si128(
+        reinterpret_cast< __m128i * >( halves + i ),
+        _mm256_cvtps_ph( _mm256_loadu_ps( floats + i ), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC ));
+#elif defined( __aarch64__ )
+  for( ; i + 4 <= n; i += 4 )
+    vst1_u16( halves + i, vreinterpret_u16_f16( vcvt_f16_f32( vld1q_f32( floats + i ))));
+#endif
+
+  for( ; i < n; ++i )
+    halves[ i ] = floatToHalf( floats[ i ] );
+}
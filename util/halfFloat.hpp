@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// IEEE 754 half precision floats (GL_HALF_FLOAT), as their bits: how HDR images are kept in memory and in textures,
+// at half the size of floats and with more than enough range and precision to display them.
+
+// rounds to nearest even; out of range becomes infinity, NaN stays NaN
+inline uint16_t
+floatToHalf( float f )
+{
+  constexpr uint32_t f32Infinity = 255u << 23, f16Overflow = ( 127u + 16 ) << 23; // 65536: rounds up to infinity from 65520
+  constexpr uint32_t denormMagicBits = (( 127u - 15 ) + ( 23 - 10 ) + 1 ) << 23;
+
+  uint32_t bits;
+  std::memcpy( &bits, &f, sizeof( bits ));
+  const uint32_t sign = bits & 0x80000000u;
+  bits ^= sign;
+
+  uint16_t half;
+  if( bits >= f16Overflow )
+    half = bits > f32Infinity ? 0x7e00 : 0x7c00;
+  else if( bits < 113u << 23 ) // a half denormal: let float addition do the rounding
+  {
+    float magic, value;
+    std::memcpy( &magic, &denormMagicBits, sizeof( magic ));
+    std::memcpy( &value, &bits, sizeof( value ));
+    value += magic;
+    std::memcpy( &bits, &value, sizeof( bits ));
+    half = (uint16_t)( bits - denormMagicBits );
+  }
+  else
+  {
+    const uint32_t mantissaOdd = ( bits >> 13 ) & 1;
+    bits += (( 15u - 127 ) << 23 ) + 0xfff + mantissaOdd; // rebias, and round the 13 bits which go
+    half = (uint16_t)( bits >> 13 );
+  }
+
+  return half | (uint16_t)( sign >> 16 );
+}
+
+inline float
+halfToFloat( uint16_t half )
+{
+  constexpr uint32_t shiftedExponent = 0x7c00u << 13;
+  constexpr uint32_t magicBits = 113u << 23;
+
+  uint32_t bits = ( half & 0x7fffu ) << 13;
+  const uint32_t exponent = bits & shiftedExponent;
+  bits += ( 127u - 15 ) << 23;
+
+  float f;
+  if( exponent == shiftedExponent ) // infinity or NaN
+    bits += ( 128u - 16 ) << 23;
+  else if( exponent == 0 ) // zero or denormal: renormalize
+  {
+    float magic;
+    std::memcpy( &magic, &magicBits, sizeof( magic ));
+    bits += 1u << 23;
+    std::memcpy( &f, &bits, sizeof( f ));
+    f -= magic;
+    std::memcpy( &bits, &f, sizeof( bits ));
+  }
+
+  bits |= ( half & 0x8000u ) << 16;
+  std::memcpy( &f, &bits, sizeof( f ));
+  return f;
+}
+
+// the same as floatToHalf for each of n floats, but several at a time where the CPU converts them itself
+// (F16C on x86, NEON on ARM)
+void
+convertFloatsToHalves( const float *floats, uint16_t *halves, std::size_t n );
@@ -1,10 +1,11 @@
 #include "makeShader.hpp"
 
 #include <stdexcept>
+#include <vector>
 
 GLuint
 makeShader(
-    const std::vector<char> &source,
+    std::string_view source,
     GLenum shaderType )
 {
   const GLchar *pShaderSource[]{ source.data() }; // need GLchar**
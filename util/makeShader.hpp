@@ -3,10 +3,10 @@
 #define GL_SILENCE_DEPRECATION // MacOS has deprecated OpenGL - it still works up to 4.1 for now
 #include <gl/glew.h>
 
-#include <vector>
+#include <string_view>
 
 GLuint
 makeShader(
-    const std::vector< char > &source,
+    std::string_view source,
     GLenum shaderType )
 noexcept( false );
@@ -0,0 +1,263 @@
+#include "pixelBufferPool.hpp"
+
+#include "Mutexed.hpp"
+#include "verboseLog.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#   define NOMINMAX
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <sys/resource.h>
+#endif
+
+namespace
+{
+  // smaller requests (stb's own bookkeeping, small images) are left to malloc
+  constexpr std::size_t minPooledBytes = 1 << 20;
+
+  // big buffers are mapped in multiples of this, aligned to it, so they can be huge pages
+  constexpr std::size_t hugePageBytes = 2 << 20;
+
+  constexpr std::size_t maxRetainedBytes = 512 << 20;
+
+  // in front of every buffer handed out, keeping it as aligned as malloc's
+  struct Header
+  {
+    std::size_t capacity; // of the whole block, header included; 0 for malloc'd ones
+    std::size_t bytes; // asked for
+  };
+
+  // a quarter of a power of two apart (at least a huge page), so no more than a fifth of a buffer is ever unused
+  std::size_t
+  getSizeClass( std::size_t bytes )
+  {
+    std::size_t powerOfTwo = hugePageBytes;
+    while( powerOfTwo * 2 <= bytes )
+      powerOfTwo *= 2;
+
+    const std::size_t step = std::max( powerOfTwo / 4, hugePageBytes );
+    return ( bytes + step - 1 ) / step * step;
+  }
+
+  void *
+  mapBlock( std::size_t capacity )
+  {
+#ifdef _WIN32
+    return VirtualAlloc( nullptr, capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+#else
+    // mapped a huge page over, then trimmed to a huge page boundary at both ends
+    const std::size_t mappedBytes = capacity + hugePageBytes;
+    void *mapped = mmap( nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( mapped == MAP_FAILED )
+      return nullptr;
+
+    char *const start = static_cast< char * >( mapped );
+    char *const aligned = reinterpret_cast< char * >(
+        ( reinterpret_cast< uintptr_t >( start ) + hugePageBytes - 1 ) / hugePageBytes * hugePageBytes );
+    if( aligned != start )
+      munmap( start, aligned - start );
+    if( const std::size_t tail = start + mappedBytes - ( aligned + capacity ))
+      munmap( aligned + capacity, tail );
+
+#   ifdef MADV_HUGEPAGE
+    madvise( aligned, capacity, MADV_HUGEPAGE ); // only a hint: where THP is off it's small pages as usual
+#   endif
+    return aligned;
+#endif
+  }
+
+  void
+  unmapBlock( void *block, std::size_t capacity )
+  {
+#ifdef _WIN32
+    (void)capacity;
+    VirtualFree( block, 0, MEM_RELEASE );
+#else
+    munmap( block, capacity );
+#endif
+  }
+
+  struct Block
+  {
+    void *start;
+    std::size_t capacity;
+  };
+
+  struct Pool
+  {
+    std::vector< Block > freed; // oldest first
+    PixelBufferPoolCounters counters;
+  };
+
+  // never destroyed: stb may free an image's pixels during static destruction
+  Mutexed< Pool > &
+  getPool()
+  {
+    static Mutexed< Pool > &pool = *new Mutexed< Pool >;
+    return pool;
+  }
+
+  void *
+  allocateBlock( std::size_t capacity )
+  {
+    void *block = nullptr;
+    getPool().withLock( [ & ]( Pool &pool )
+    {
+      ++pool.counters.allocations;
+
+      // the most recently freed is the likeliest to still be in the cache
+      const auto it = std::find_if( pool.freed.rbegin(), pool.freed.rend(), [ & ]( const Block &b ) { return b.capacity == capacity; } );
+      if( it != pool.freed.rend())
+      {
+        block = it->start;
+        pool.freed.erase( std::next( it ).base());
+        pool.counters.retainedBytes -= capacity;
+        pool.counters.inUseBytes += capacity;
+        ++pool.counters.reuses;
+      }
+    } );
+
+    if( block )
+      return block;
+
+    // outside the lock, as unmapping is
+    block = mapBlock( capacity );
+    if( block )
+      getPool().withLock( [ & ]( Pool &pool )
+      {
+        pool.counters.mappedBytes += capacity;
+        pool.counters.inUseBytes += capacity;
+      } );
+
+    return block;
+  }
+
+  void
+  freeBlock( void *block, std::size_t capacity )
+  {
+    std::vector< Block > unmapped;
+    getPool().withLock( [ & ]( Pool &pool )
+    {
+      pool.counters.inUseBytes -= capacity;
+      pool.freed.push_back( { block, capacity } );
+      pool.counters.retainedBytes += capacity;
+
+      std::size_t nUnmapped = 0;
+      while( pool.counters.retainedBytes > maxRetainedBytes )
+        pool.counters.retainedBytes -= pool.freed[ nUnmapped++ ].capacity;
+
+      unmapped.assign( pool.freed.begin(), pool.freed.begin() + nUnmapped );
+      pool.freed.erase( pool.freed.begin(), pool.freed.begin() + nUnmapped );
+    } );
+
+    // outside the lock: giving back hundreds of megabytes isn't instant
+    for( const Block &b : unmapped )
+      unmapBlock( b.start, b.capacity );
+  }
+
+  Header *
+  getHeader( void *p )
+  {
+    return static_cast< Header * >( p ) - 1;
+  }
+} // namespace
+
+void *
+allocatePixelBuffer( std::size_t bytes )
+{
+  if( bytes > SIZE_MAX - hugePageBytes * 2 )
+    return nullptr;
+
+  const std::size_t blockBytes = sizeof( Header ) + bytes;
+  const std::size_t capacity = bytes < minPooledBytes ? 0 : getSizeClass( blockBytes );
+
+  void *block = capacity ? allocateBlock( capacity ) : std::malloc( blockBytes );
+  if( !block )
+    return nullptr;
+
+  Header *header = static_cast< Header * >( block );
+  *header = { capacity, bytes };
+  return header + 1;
+}
+
+void
+freePixelBuffer( void *p )
+{
+  if( !p )
+    return;
+
+  Header *header = getHeader( p );
+  if( header->capacity )
+    freeBlock( header, header->capacity );
+  else
+    std::free( header );
+}
+
+void *
+reallocatePixelBuffer( void *p, std::size_t bytes )
+{
+  if( !p )
+    return allocatePixelBuffer( bytes );
+
+  Header *header = getHeader( p );
+
+  // stb grows its zlib output by doubling: a big buffer usually has room already
+  if( header->capacity && sizeof( Header ) + bytes <= header->capacity )
+  {
+    header->bytes = bytes;
+    return p;
+  }
+
+  if( !header->capacity && bytes < minPooledBytes )
+  {
+    Header *moved = static_cast< Header * >( std::realloc( header, sizeof( Header ) + bytes ));
+    if( !moved )
+      return nullptr;
+
+    moved->bytes = bytes;
+    return moved + 1;
+  }
+
+  void *grown = allocatePixelBuffer( bytes );
+  if( !grown )
+    return nullptr;
+
+  std::memcpy( grown, p, std::min( bytes, header->bytes ));
+  freePixelBuffer( p );
+  return grown;
+}
+
+PixelBufferPoolCounters
+getPixelBufferPoolCounters()
+{
+  PixelBufferPoolCounters counters;
+  getPool().withLock( [ & ]( Pool &pool ) { counters = pool.counters; } );
+  return counters;
+}
+
+void
+logPixelBufferPoolCounters( const char *event )
+{
+  if( !isVerbose())
+    return;
+
+  const PixelBufferPoolCounters c = getPixelBufferPoolCounters();
+
+  long pageFaults = -1;
+#ifndef _WIN32
+  rusage usage{};
+  if( getrusage( RUSAGE_SELF, &usage ) == 0 )
+    pageFaults = usage.ru_minflt + usage.ru_majflt;
+#endif
+
+  verboseLog(
+      "pixel buffers ", event, ": ", c.reuses, " of ", c.allocations, " reused, ", c.mappedBytes >> 20, " MiB mapped fresh, ",
+      c.inUseBytes >> 20, " MiB in use, ", c.retainedBytes >> 20, " MiB retained, ", pageFaults, " page faults" );
+}
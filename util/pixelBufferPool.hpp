@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Where decoded pixels live: big buffers (an image's worth) are mapped in size classes a quarter of a power of two
+// apart and, once freed, kept for the next image of the same class instead of being unmapped, so browsing through
+// big images neither churns the heap nor page-faults hundreds of megabytes of fresh memory for every one.
+// Where the OS has them they're backed by transparent huge pages: a 2 MiB fault instead of 512 small ones.
+// At most maxRetainedBytes of freed buffers are kept, the longest unused going first; small requests are just malloc'd.
+//
+// These are also stb_image's STBI_MALLOC, STBI_REALLOC and STBI_FREE (see stb_image.cpp), so what stb decodes comes
+// from here too. Thread safe.
+
+// nullptr when out of memory, as malloc
+void *
+allocatePixelBuffer( std::size_t bytes );
+
+// p from allocatePixelBuffer or reallocatePixelBuffer, or nullptr
+void
+freePixelBuffer( void *p );
+
+// as realloc: p stays valid when this returns nullptr
+void *
+reallocatePixelBuffer( void *p, std::size_t bytes );
+
+struct PixelBufferPoolCounters
+{
+  uint64_t allocations{}, reuses{}; // of big buffers; reuses came from the pool rather than fresh mappings
+  uint64_t mappedBytes{}; // fresh, so every page of them faults when first written
+  std::size_t retainedBytes{}; // freed, waiting to be reused
+  std::size_t inUseBytes{};
+};
+
+PixelBufferPoolCounters
+getPixelBufferPoolCounters();
+
+// the counters, and the process's page faults so far (where the OS counts them), when verbose
+void
+logPixelBufferPoolCounters( const char *event );
@@ -0,0 +1,278 @@
+#include "singleInstance.hpp"
+
+#include "verboseLog.hpp"
+
+#ifdef _WIN32
+
+bool
+sendToRunningInstance( const std::string & )
+{
+  return false;
+}
+
+Destroyer
+listenForOtherInstances( std::function< void( std::string ) > )
+{
+  return {};
+}
+
+#else
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <thread>
+
+namespace
+{
+  // longer than any path, short enough that a stuck or hostile client can't take much
+  constexpr std::size_t maxMessageBytes = 1 << 16;
+
+  // neither side waits longer than this for the other
+  constexpr int timeoutSeconds = 2;
+
+  // the reply once a filename has been taken
+  constexpr char acknowledgement = 1;
+
+#ifdef MSG_NOSIGNAL
+  constexpr int sendFlags = MSG_NOSIGNAL; // a closed socket is an error, not SIGPIPE
+#else
+  constexpr int sendFlags = 0;
+#endif
+
+  bool
+  isEnabled()
+  {
+    const char *value = std::getenv( "IMAGEVIEWERGL_SINGLE_INSTANCE" );
+    return !value || std::strcmp( value, "0" ) != 0;
+  }
+
+  // one per user: their runtime directory is private, and in /tmp the socket's owner is checked before it's used
+  std::string
+  getSocketPath()
+  {
+    if( const char *value = std::getenv( "XDG_RUNTIME_DIR" ); value && *value )
+      return std::string( value ) + "/imageviewergl.sock";
+
+    return "/tmp/imageviewergl-" + std::to_string( getuid()) + ".sock";
+  }
+
+  // nullopt if the path is too long for one
+  std::optional< sockaddr_un >
+  makeAddress( const std::string &path )
+  {
+    sockaddr_un address{};
+    if( path.size() >= sizeof( address.sun_path ))
+      return std::nullopt;
+
+    address.sun_family = AF_UNIX;
+    std::memcpy( address.sun_path, path.c_str(), path.size() + 1 );
+    return address;
+  }
+
+  bool
+  isOwnSocket( const std::string &path )
+  {
+    struct stat status{};
+    return lstat( path.c_str(), &status ) == 0 && S_ISSOCK( status.st_mode ) && status.st_uid == getuid();
+  }
+
+  // for a connected socket only: on a listening one, accept(..) would time out too
+  void
+  setTimeouts( int fd )
+  {
+    const timeval timeout{ timeoutSeconds, 0 };
+    setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ));
+    setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ));
+#ifdef SO_NOSIGPIPE
+    const int on = 1;
+    setsockopt( fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof( on ));
+#endif
+  }
+
+  // a socket connected to the running instance, or -1 if there's none
+  int
+  connectToRunningInstance( const sockaddr_un &address )
+  {
+    if( !isOwnSocket( address.sun_path ))
+      return -1;
+
+    const int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd >= 0 && connect( fd, reinterpret_cast< const sockaddr * >( &address ), sizeof( address )) != 0 )
+    {
+      close( fd );
+      return -1;
+    }
+
+    if( fd >= 0 )
+      setTimeouts( fd );
+    return fd;
+  }
+
+  bool
+  sendAll( int fd, const char *data, std::size_t size )
+  {
+    while( size > 0 )
+    {
+      const ssize_t sent = send( fd, data, size, sendFlags );
+      if( sent < 0 && errno == EINTR )
+        continue;
+      if( sent <= 0 )
+        return false;
+
+      data += sent;
+      size -= (std::size_t)sent;
+    }
+    return true;
+  }
+
+  // until the other side shuts down its writing; nullopt on an error, a timeout, or too much
+  std::optional< std::string >
+  receiveAll( int fd )
+  {
+    std::string message;
+    for( char buffer[ 4096 ]; ; )
+    {
+      const ssize_t received = recv( fd, buffer, sizeof( buffer ), 0 );
+      if( received < 0 && errno == EINTR )
+        continue;
+      if( received < 0 || message.size() + (std::size_t)received > maxMessageBytes )
+        return std::nullopt;
+      if( received == 0 )
+        return message;
+
+      message.append( buffer, (std::size_t)received );
+    }
+  }
+
+  // bound and listening, or -1: an instance already has the socket, or it can't be made
+  int
+  listenOnSocket( const sockaddr_un &address )
+  {
+    const int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd < 0 )
+      return -1;
+
+    for( int tries = 0; tries < 2; ++tries )
+    {
+      if( bind( fd, reinterpret_cast< const sockaddr * >( &address ), sizeof( address )) == 0 )
+      {
+        // only this user may connect, where the directory doesn't already see to that
+        chmod( address.sun_path, S_IRUSR | S_IWUSR );
+
+        if( listen( fd, SOMAXCONN ) == 0 )
+          return fd;
+        break;
+      }
+
+      if( errno != EADDRINUSE )
+        break;
+
+      // left behind by an instance which didn't exit cleanly, unless something answers
+      if( const int running = connectToRunningInstance( address ); running >= 0 )
+      {
+        close( running );
+        break;
+      }
+      if( !isOwnSocket( address.sun_path ) || unlink( address.sun_path ) != 0 )
+        break;
+    }
+
+    close( fd );
+    return -1;
+  }
+} // namespace
+
+//==============================================================================
+
+bool
+sendToRunningInstance( const std::string &filename )
+{
+  const std::optional< sockaddr_un > address = makeAddress( getSocketPath());
+  if( !isEnabled() || !address )
+    return false;
+
+  const int fd = connectToRunningInstance( *address );
+  if( fd < 0 )
+    return false;
+
+  char reply = 0;
+  const bool sent = sendAll( fd, filename.data(), filename.size()) && shutdown( fd, SHUT_WR ) == 0
+      && recv( fd, &reply, 1, 0 ) == 1 && reply == acknowledgement;
+  close( fd );
+
+  verboseLog( sent ? "sent " : "couldn't send ", filename, " to the running instance at ", address->sun_path );
+  return sent;
+}
+
+Destroyer
+listenForOtherInstances( std::function< void( std::string ) > onFilename )
+{
+  const std::optional< sockaddr_un > address = makeAddress( getSocketPath());
+  if( !isEnabled() || !address )
+    return {};
+
+  const int fd = listenOnSocket( *address );
+  if( fd < 0 )
+    return {};
+
+  verboseLog( "listening for other instances at ", address->sun_path );
+
+  struct Listener
+  {
+    std::atomic< bool > stopping{ false };
+    std::thread thread;
+  };
+  auto listener = std::make_shared< Listener >();
+
+  listener->thread = std::thread{ [ fd, listener = listener.get(), onFilename = std::move( onFilename ) ]
+  {
+    while( !listener->stopping )
+    {
+      const int client = accept( fd, nullptr, nullptr );
+      if( client < 0 )
+      {
+        if( errno == EINTR || errno == ECONNABORTED )
+          continue;
+        break;
+      }
+      setTimeouts( client );
+
+      // an empty message is only from the Destroyer below, waking this up to stop
+      std::optional< std::string > filename = receiveAll( client );
+      if( filename && !filename->empty())
+        sendAll( client, &acknowledgement, 1 );
+      close( client );
+
+      if( filename && !filename->empty() && !listener->stopping )
+        onFilename( std::move( *filename ));
+    }
+  }};
+
+  return Destroyer{ [ fd, address = *address, listener ]
+  {
+    listener->stopping = true;
+    if( const int wake = connectToRunningInstance( address ); wake >= 0 )
+    {
+      shutdown( wake, SHUT_WR );
+      close( wake );
+    }
+    else // e.g. the socket's file was removed: at least on Linux this fails the accept(..) instead
+      shutdown( fd, SHUT_RDWR );
+
+    listener->thread.join();
+    close( fd );
+    unlink( address.sun_path );
+  }};
+}
+
+#endif
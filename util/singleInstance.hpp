@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Destroyer.hpp"
+
+#include <functional>
+#include <string>
+
+// One process per user shows every image opened: the first listens on a Unix domain socket ($XDG_RUNTIME_DIR/
+// imageviewergl.sock, or /tmp/imageviewergl-<uid>.sock), and later ones hand it their filename and exit,
+// instead of paying again for GLFW, a GL context and the shader programs.
+// Off when the environment variable IMAGEVIEWERGL_SINGLE_INSTANCE is 0, and on Windows, where both do nothing.
+
+// returns true once a running instance has taken filename (absolute: its working directory may be another)
+bool
+sendToRunningInstance( const std::string &filename );
+
+// Calls onFilename, on a thread of its own, with each filename sent until the returned Destroyer goes.
+// Does nothing if there's no socket to listen on, e.g. another instance started at the same time has it.
+Destroyer
+listenForOtherInstances( std::function< void( std::string filename ) > onFilename );
@@ -1,4 +1,11 @@
 // This cpp file is necessary for proper linking of the header-only stb_image.h
 
+#include "pixelBufferPool.hpp"
+
+// decoded pixels come from the pool, see pixelBufferPool.hpp
+#define STBI_MALLOC( bytes ) allocatePixelBuffer( bytes )
+#define STBI_REALLOC( p, bytes ) reallocatePixelBuffer( p, bytes )
+#define STBI_FREE( p ) freePixelBuffer( p )
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
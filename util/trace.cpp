@@ -0,0 +1,131 @@
+#include "trace.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+  struct Event
+  {
+    const char *name;
+    std::string detail;
+    char phase; // 'X' span, 'i' instant, 'M' thread name
+    int64_t timestamp, duration; // microseconds
+    int thread;
+  };
+
+  std::string
+  escapeJson( const std::string &s )
+  {
+    std::string escaped;
+    for( const char c : s )
+      if( c == '"' || c == '\\' )
+        escaped += { '\\', c };
+      else if( (unsigned char)c < 0x20 )
+      {
+        char code[ 7 ];
+        std::snprintf( code, sizeof( code ), "\\u%04x", c );
+        escaped += code;
+      }
+      else
+        escaped += c;
+
+    return escaped;
+  }
+
+  // written out as the process exits, after Main has joined its threads
+  struct Trace
+  {
+    const std::chrono::steady_clock::time_point processStart = std::chrono::steady_clock::now();
+    const char *const filename = std::getenv( "IMAGEVIEWERGL_TRACE" );
+
+    std::mutex m;
+    std::vector< Event > events;
+    std::atomic< int > nThreads{};
+
+    ~Trace()
+    {
+      if( !filename || !*filename )
+        return;
+
+      std::lock_guard lk( m );
+      std::ofstream out{ filename, std::ios::trunc };
+      out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+          << R"({"name":"process start","ph":"i","s":"p","ts":0,"pid":1,"tid":0})";
+
+      for( const Event &e : events )
+      {
+        out << ",\n{\"name\":\"" << ( e.phase == 'M' ? "thread_name" : escapeJson( e.name )) << "\",\"ph\":\"" << e.phase
+            << "\",\"ts\":" << e.timestamp << ",\"pid\":1,\"tid\":" << e.thread;
+        if( e.phase == 'X' )
+          out << ",\"dur\":" << e.duration;
+        if( e.phase == 'i' )
+          out << ",\"s\":\"t\"";
+
+        if( e.phase == 'M' )
+          out << ",\"args\":{\"name\":\"" << escapeJson( e.name ) << "\"}";
+        else if( !e.detail.empty())
+          out << ",\"args\":{\"detail\":\"" << escapeJson( e.detail ) << "\"}";
+        out << "}";
+      }
+
+      out << "\n]}\n";
+    }
+
+    int64_t microseconds( std::chrono::steady_clock::time_point t ) const
+    {
+      return std::chrono::duration_cast< std::chrono::microseconds >( t - processStart ).count();
+    }
+
+    int getThread()
+    {
+      thread_local const int thread = nThreads++;
+      return thread;
+    }
+
+    void add( Event &&event )
+    {
+      std::lock_guard lk( m );
+      events.push_back( std::move( event ));
+    }
+  } trace;
+} // namespace
+
+bool
+isTracing()
+{
+  return trace.filename && *trace.filename;
+}
+
+void
+traceThreadName( const char *name )
+{
+  if( isTracing())
+    trace.add( { name, {}, 'M', 0, 0, trace.getThread() } );
+}
+
+void
+traceInstant( const char *name, std::string detail )
+{
+  if( isTracing())
+    trace.add( { name, std::move( detail ), 'i', trace.microseconds( std::chrono::steady_clock::now()), 0, trace.getThread() } );
+}
+
+TraceScope::TraceScope( const char *name, std::string detail )
+    : name{ name }
+    , detail{ std::move( detail ) }
+    , start{ isTracing() ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{} } {}
+
+TraceScope::~TraceScope()
+{
+  if( !isTracing())
+    return;
+
+  const int64_t begin = trace.microseconds( start );
+  trace.add( { name, std::move( detail ), 'X', begin, trace.microseconds( std::chrono::steady_clock::now()) - begin, trace.getThread() } );
+}
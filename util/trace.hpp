@@ -0,0 +1,36 @@
+#pragma once
+
+#include "NoCopy.hpp"
+
+#include <chrono>
+#include <string>
+
+// Where the time goes, e.g. before the first pixel is on screen: spans and instants recorded from any thread
+// and written as Chrome trace JSON (open it in chrome://tracing or https://ui.perfetto.dev) when the process exits.
+// Only recorded when the environment variable IMAGEVIEWERGL_TRACE names the file to write.
+// Timestamps are monotonic, from process start (as near as static initialization gets to it).
+
+bool
+isTracing();
+
+// names the calling thread in the trace
+void
+traceThreadName( const char *name );
+
+// a point in time on the calling thread; name must outlive the process (a string literal)
+void
+traceInstant( const char *name, std::string detail = {} );
+
+// a span on the calling thread, from construction to destruction; name must be a string literal
+struct TraceScope : NoCopy
+{
+  explicit
+  TraceScope( const char *name, std::string detail = {} );
+
+  ~TraceScope();
+
+private:
+  const char *name;
+  std::string detail;
+  std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,27 @@
+#include "verboseLog.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+bool
+isVerbose()
+{
+  static const bool verbose = []
+  {
+    const char *value = std::getenv( "IMAGEVIEWERGL_VERBOSE" );
+    return value && *value && std::strcmp( value, "0" ) != 0;
+  }();
+
+  return verbose;
+}
+
+void
+writeVerboseLog( const std::string &line )
+{
+  // lines from different threads don't interleave
+  static std::mutex m;
+  std::lock_guard lk( m );
+  std::cerr << line << std::endl;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "toString.hpp"
+
+#include <string>
+
+// Diagnostics for tuning (timings, memory use) which are only printed, to stderr,
+// when the environment variable IMAGEVIEWERGL_VERBOSE is set to something other than 0.
+
+bool
+isVerbose();
+
+void
+writeVerboseLog( const std::string &line );
+
+template< class ... Ts >
+void
+verboseLog( const Ts &... vs )
+{
+  if( isVerbose())
+    writeVerboseLog( toString( vs... ));
+}